@@ -0,0 +1,282 @@
+/*
+ * File:    Analytics.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Distribution statistics of a counted table
+ *
+ * One scan over the buckets, in parallel on the table's executor, feeds
+ * per bucket accumulators that are summed afterwards: tokens, distinct
+ * words, hapax and dis legomena, word lengths by type and by token, and
+ * the frequency spectrum (how many words have each frequency). Nothing is
+ * sorted per word; the spectrum has at most sqrt(2 * tokens) entries, so
+ * the Zipf fit over it costs next to nothing beside the scan.
+ *
+ * Zipf: the words with frequency f hold ranks r+1..r+c, where r counts
+ * the words more frequent. log f against log of the middle rank is fitted
+ * by least squares, the exponent is minus the slope. Heaps' law comes from
+ * a VocabularyGrowth fed during ingestion, if there was one.
+ */
+
+#ifndef PROJ3_ANALYTICS_H
+#define PROJ3_ANALYTICS_H
+
+#include <vector>
+#include <map>
+#include <unordered_map>
+#include <string>
+#include <stdint.h>
+#include "HashedSplays.h"
+#include "VocabularyGrowth.h"
+#include "ReportSink.h"
+
+#define ANALYTICS_MAX_LENGTH 32     // longer words share the last slot
+#define ANALYTICS_DENSE 1024        // frequencies below this are counted in an array
+#define ANALYTICS_CURVE_POINTS 48   // rank/frequency points in a report
+
+class Analytics {
+
+public:
+    Analytics();
+
+    /**********************************************************************
+     * Name: Scan
+     * PreCondition: Counted table, not written during the scan
+     *
+     * PostCondition: Statistics of the table, replacing any earlier scan.
+     *                Buckets are scanned on the table's executor
+     *********************************************************************/
+    void Scan(const HashedSplays& table);
+
+    /**********************************************************************
+     * Name: SetGrowth
+     * PreCondition: Growth curve recorded while the table was filled,
+     *               NULL for none
+     *
+     * PostCondition: Report includes Heaps' law
+     *********************************************************************/
+    void SetGrowth(const VocabularyGrowth* growth) { m_growth = growth; }
+
+    /**********************************************************************
+     * Name: Report
+     * PreCondition: Sink to write to
+     *
+     * PostCondition: Sections distribution, zipf, word_length and, with a
+     *                growth curve, heaps written and the sink finished
+     *********************************************************************/
+    void Report(ReportSink& sink) const;
+
+    /**********************************************************************
+     * Name: FitZipf
+     * PreCondition: None
+     *
+     * PostCondition: Exponent s and constant C of f = C r^-s, R squared
+     *********************************************************************/
+    void FitZipf(double& exponent, double& constant, double& r2) const;
+
+    uint64_t GetTokens() const { return m_total.tokens; }
+    uint64_t GetDistinct() const { return m_total.distinct; }
+    uint64_t GetHapax() const { return m_total.hapax; }
+    const map<Frequency, uint64_t>& GetSpectrum() const { return m_spectrum; }
+
+private:
+    // per bucket sums, added together after the scan
+    struct Accumulator
+    {
+        uint64_t tokens;
+        uint64_t distinct;
+        uint64_t hapax;
+        uint64_t dislegomena;
+        Frequency maxFrequency;
+        vector<uint64_t> lengthTypes;       // distinct words by length
+        vector<uint64_t> lengthTokens;      // tokens by length
+        vector<uint64_t> denseSpectrum;     // words by frequency, small ones
+        unordered_map<Frequency, uint64_t> sparseSpectrum;
+
+        Accumulator();
+        void Add(const Accumulator& other);
+    };
+
+    Accumulator m_total;
+    map<Frequency, uint64_t> m_spectrum;
+    const VocabularyGrowth* m_growth;
+
+    // (middle rank, frequency) for every frequency in the spectrum
+    vector<pair<double, double> > RankFrequency() const;
+};
+
+// Accumulator Constructor
+Analytics::Accumulator::Accumulator()
+    : tokens(0), distinct(0), hapax(0), dislegomena(0), maxFrequency(0),
+      lengthTypes(ANALYTICS_MAX_LENGTH + 1, 0), lengthTokens(ANALYTICS_MAX_LENGTH + 1, 0),
+      denseSpectrum(ANALYTICS_DENSE, 0)
+{
+}
+
+// Accumulator Add
+void Analytics::Accumulator::Add(const Accumulator& other)
+{
+    tokens += other.tokens;
+    distinct += other.distinct;
+    hapax += other.hapax;
+    dislegomena += other.dislegomena;
+    maxFrequency = max(maxFrequency, other.maxFrequency);
+    for (size_t l = 0; l < lengthTypes.size(); ++l)
+    {
+        lengthTypes[l] += other.lengthTypes[l];
+        lengthTokens[l] += other.lengthTokens[l];
+    }
+    for (size_t f = 0; f < denseSpectrum.size(); ++f)
+    {
+        denseSpectrum[f] += other.denseSpectrum[f];
+    }
+    for (unordered_map<Frequency, uint64_t>::const_iterator it = other.sparseSpectrum.begin();
+         it != other.sparseSpectrum.end(); ++it)
+    {
+        sparseSpectrum[it->first] += it->second;
+    }
+}
+
+// Constructor
+Analytics::Analytics() : m_growth(NULL)
+{
+}
+
+// Scan
+void Analytics::Scan(const HashedSplays& table)
+{
+    vector<Accumulator> buckets(table.m_trees);
+    table.ForEachBucket([&](int b) {
+        Accumulator& sums = buckets[b];
+        table.GetBucket(b).inOrder([&](const Node& node) {
+            Frequency frequency = node.GetFrequency();
+            size_t length = min(node.GetWord().length(), (size_t)ANALYTICS_MAX_LENGTH);
+            sums.tokens += frequency;
+            sums.distinct++;
+            sums.hapax += frequency == 1;
+            sums.dislegomena += frequency == 2;
+            sums.maxFrequency = max(sums.maxFrequency, frequency);
+            sums.lengthTypes[length]++;
+            sums.lengthTokens[length] += frequency;
+            if (frequency < ANALYTICS_DENSE)
+            {
+                sums.denseSpectrum[frequency]++;
+            }
+            else
+            {
+                sums.sparseSpectrum[frequency]++;
+            }
+        });
+    });
+
+    m_total = Accumulator();
+    for (size_t b = 0; b < buckets.size(); ++b)
+    {
+        m_total.Add(buckets[b]);
+    }
+    m_spectrum.clear();
+    for (size_t f = 1; f < m_total.denseSpectrum.size(); ++f)
+    {
+        if (m_total.denseSpectrum[f] > 0)
+        {
+            m_spectrum[f] = m_total.denseSpectrum[f];
+        }
+    }
+    m_spectrum.insert(m_total.sparseSpectrum.begin(), m_total.sparseSpectrum.end());
+}
+
+// Rank Frequency
+vector<pair<double, double> > Analytics::RankFrequency() const
+{
+    vector<pair<double, double> > points;
+    uint64_t above = 0;
+    for (map<Frequency, uint64_t>::const_reverse_iterator it = m_spectrum.rbegin(); it != m_spectrum.rend(); ++it)
+    {
+        points.push_back(make_pair(above + (it->second + 1) / 2.0, (double)it->first));
+        above += it->second;
+    }
+    return points;
+}
+
+// Fit Zipf
+void Analytics::FitZipf(double& exponent, double& constant, double& r2) const
+{
+    double slope, intercept;
+    FitLogLog(RankFrequency(), slope, intercept, r2);
+    exponent = -slope;
+    constant = exp(intercept);
+}
+
+// Report
+void Analytics::Report(ReportSink& sink) const
+{
+    const Accumulator& t = m_total;
+    sink.BeginSection("distribution");
+    sink.Integer("tokens", t.tokens);
+    sink.Integer("distinct", t.distinct);
+    sink.Integer("hapax", t.hapax);
+    sink.Integer("dis_legomena", t.dislegomena);
+    sink.Real("hapax_share", t.distinct == 0 ? 0.0 : (double)t.hapax / t.distinct);
+    sink.Real("type_token_ratio", t.tokens == 0 ? 0.0 : (double)t.distinct / t.tokens);
+    sink.Integer("max_frequency", t.maxFrequency);
+    sink.EndSection();
+
+    double exponent, constant, r2;
+    FitZipf(exponent, constant, r2);
+    vector<pair<double, double> > ranks = RankFrequency();
+    vector<pair<double, double> > curve;
+    double nextRank = 1.0;
+    for (size_t i = 0; i < ranks.size(); ++i)
+    {
+        // about ANALYTICS_CURVE_POINTS points spread evenly in log rank
+        if (ranks[i].first >= nextRank || i + 1 == ranks.size())
+        {
+            curve.push_back(ranks[i]);
+            nextRank = ranks[i].first * pow(max(2.0, (double)t.distinct), 1.0 / ANALYTICS_CURVE_POINTS);
+        }
+    }
+    sink.BeginSection("zipf");
+    sink.Real("exponent", exponent);
+    sink.Real("constant", constant);
+    sink.Real("r2", r2);
+    sink.Integer("spectrum_size", m_spectrum.size());
+    sink.Series("rank_frequency", curve);
+    sink.EndSection();
+
+    vector<pair<double, double> > types, tokens;
+    double typeLength = 0, tokenLength = 0;
+    for (size_t l = 1; l < t.lengthTypes.size(); ++l)
+    {
+        if (t.lengthTypes[l] > 0)
+        {
+            types.push_back(make_pair((double)l, (double)t.lengthTypes[l]));
+            tokens.push_back(make_pair((double)l, (double)t.lengthTokens[l]));
+            typeLength += (double)l * t.lengthTypes[l];
+            tokenLength += (double)l * t.lengthTokens[l];
+        }
+    }
+    sink.BeginSection("word_length");
+    sink.Real("mean_by_type", t.distinct == 0 ? 0.0 : typeLength / t.distinct);
+    sink.Real("mean_by_token", t.tokens == 0 ? 0.0 : tokenLength / t.tokens);
+    sink.Integer("longest_slot", ANALYTICS_MAX_LENGTH);
+    sink.Series("types", types);
+    sink.Series("tokens", tokens);
+    sink.EndSection();
+
+    if (m_growth != NULL)
+    {
+        double k, beta;
+        m_growth->FitHeaps(k, beta, r2);
+        sink.BeginSection("heaps");
+        sink.Real("k", k);
+        sink.Real("beta", beta);
+        sink.Real("r2", r2);
+        sink.Series("vocabulary_growth", m_growth->GetCurve());
+        sink.EndSection();
+    }
+    sink.Finish();
+}
+
+#endif //PROJ3_ANALYTICS_H
@@ -0,0 +1,432 @@
+/*
+ * File:    ApproxCounter.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Approximate word counting in fixed memory
+ *
+ * CountMinSketch is a depth x width grid of counters. Every word adds one
+ * to a counter in each row, and its estimate is the smallest of those
+ * counters, which never undercounts and overcounts by at most
+ * epsilon * total with probability 1 - delta.
+ *
+ * ApproxCounter keeps a fixed number of heavy hitters with exact counts on
+ * top of the sketch. A word enters the heavy hitters when its estimate beats
+ * the smallest one tracked, starting from that estimate; from then on it is
+ * counted exactly. An evicted word has its count folded back into the sketch.
+ * Memory is the sketch plus the heavy hitters, whatever the vocabulary.
+ */
+
+#ifndef PROJ3_APPROXCOUNTER_H
+#define PROJ3_APPROXCOUNTER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <algorithm>
+#include <unordered_map>
+#include <cmath>
+#include <stdint.h>
+#include "Node.h"
+#include "Util.h"
+#include "TokenFilter.h"
+#include "dsexceptions.h"
+
+class CountMinSketch {
+
+public:
+    /**********************************************************************
+     * Name: CountMinSketch (Constructor)
+     * PreCondition: Error bound epsilon (share of the total count) and
+     *               failure probability delta, both in (0, 1)
+     *
+     * PostCondition: Sketch of ceil(e / epsilon) x ceil(ln(1 / delta))
+     *                zeroed counters
+     *********************************************************************/
+    CountMinSketch(double epsilon, double delta);
+
+    /**********************************************************************
+     * Name: Add
+     * PreCondition: Word and the count to add
+     *
+     * PostCondition: Word counted in every row
+     *********************************************************************/
+    void Add(const string& word, Frequency count = 1);
+
+    /**********************************************************************
+     * Name: Estimate
+     * PreCondition: Word
+     *
+     * PostCondition: Count-Min estimate, never below the true count
+     *********************************************************************/
+    Frequency Estimate(const string& word) const;
+
+    size_t GetWidth() const { return m_width; }
+    size_t GetDepth() const { return m_depth; }
+    long long GetTotal() const { return m_total; }
+    size_t GetMemoryBytes() const { return m_counters.size() * sizeof(Frequency); }
+
+private:
+    size_t m_width;
+    size_t m_depth;
+    long long m_total;
+    vector<Frequency> m_counters;  // row major, depth rows of width counters
+
+    // column of the word in a row, double hashing off one 64 bit hash
+    size_t Column(uint64_t hash, size_t row) const
+    {
+        uint64_t h2 = (hash >> 32) | 1;
+        return (size_t)((hash + row * h2) % m_width);
+    }
+
+    static uint64_t Hash(const string& word);
+};
+
+class ApproxCounter {
+
+public:
+    /**********************************************************************
+     * Name: ApproxCounter (Constructor)
+     * PreCondition: Sketch error bound and failure probability, and the
+     *               number of heavy hitters to count exactly
+     *
+     * PostCondition: Empty counter, all memory allocated up front
+     *********************************************************************/
+    ApproxCounter(double epsilon, double delta, size_t heavyHitters);
+
+    /**********************************************************************
+     * Name: FileReader
+     * PreCondition: Passed value inFileName = input file
+     *
+     * PostCondition: Every token of the file counted
+     *********************************************************************/
+    void FileReader(string inFileName);
+
+    /**********************************************************************
+     * Name: InsertWord
+     * PreCondition: Passed one raw whitespace separated token
+     *
+     * PostCondition: Token stripped and counted, same rules as HashedSplays
+     *********************************************************************/
+    void InsertWord(const string& word);
+
+    /**********************************************************************
+     * Name: GetFrequency
+     * PreCondition: Passed a word as it was counted, in any case when
+     *               SetFoldCase is on
+     *
+     * PostCondition: Exact count for a heavy hitter, otherwise the sketch
+     *                estimate
+     *********************************************************************/
+    Frequency GetFrequency(string inWord) const;
+
+    /**********************************************************************
+     * Name: CollectTopK
+     * PreCondition: Passed the number of nodes wanted
+     *
+     * PostCondition: outNodes holds the k most frequent heavy hitters,
+     *                most frequent first
+     *********************************************************************/
+    void CollectTopK(int k, vector<Node>& outNodes) const;
+
+    /**********************************************************************
+     * Name: SetFilter
+     * PreCondition: Filter that outlives the counter, NULL for none
+     *
+     * PostCondition: Tokens are passed through the filter before counting
+     *********************************************************************/
+    void SetFilter(const TokenFilter* filter);
+
+    /**********************************************************************
+     * Name: SetFoldCase
+     * PreCondition: Nothing counted yet, true for the folded and surface
+     *               key policies
+     *
+     * PostCondition: Words are counted and looked up lowercased, like the
+     *                folded table. Surface forms are not kept
+     *********************************************************************/
+    void SetFoldCase(bool fold) { m_fold = fold; }
+
+    /**********************************************************************
+     * Name: PrintApproxResults
+     * PreCondition: None
+     *
+     * PostCondition: Sketch size, memory and the top heavy hitters to cout
+     *********************************************************************/
+    void PrintApproxResults(int k) const;
+
+    size_t GetMemoryBytes() const;
+
+    uint64_t GetRejectCount() const { return m_rejectCount; }
+
+private:
+    struct HeavyHitter
+    {
+        string word;
+        Frequency count;
+    };
+
+    CountMinSketch m_sketch;
+    size_t m_capacity;
+    vector<HeavyHitter> m_heap;                 // min heap on count
+    unordered_map<string, size_t> m_position;   // word to heap index
+    const TokenFilter* m_filter;
+    uint64_t m_rejectCount;
+    bool m_fold;                                // key policy is not exact
+
+    void Count(const string& word);
+    void SiftUp(size_t index);
+    void SiftDown(size_t index);
+    void Swap(size_t lhs, size_t rhs);
+};
+
+// Count Min Sketch Constructor
+CountMinSketch::CountMinSketch(double epsilon, double delta) : m_total(0)
+{
+    if (epsilon <= 0.0 || epsilon >= 1.0 || delta <= 0.0 || delta >= 1.0)
+    {
+        throw IllegalArgumentException();
+    }
+    m_width = (size_t)ceil(exp(1.0) / epsilon);
+    m_depth = (size_t)ceil(log(1.0 / delta));
+    m_counters.assign(m_width * m_depth, 0);
+}
+
+// Add
+void CountMinSketch::Add(const string& word, Frequency count)
+{
+    uint64_t hash = Hash(word);
+    for (size_t row = 0; row < m_depth; ++row)
+    {
+        Frequency& counter = m_counters[row * m_width + Column(hash, row)];
+        // saturate rather than wrap around
+        counter = SaturatingAdd(counter, count);
+    }
+    m_total += count;
+}
+
+// Estimate
+Frequency CountMinSketch::Estimate(const string& word) const
+{
+    uint64_t hash = Hash(word);
+    Frequency estimate = numeric_limits<Frequency>::max();
+    for (size_t row = 0; row < m_depth; ++row)
+    {
+        estimate = min(estimate, m_counters[row * m_width + Column(hash, row)]);
+    }
+    return estimate;
+}
+
+// Hash, FNV-1a
+uint64_t CountMinSketch::Hash(const string& word)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < word.length(); ++i)
+    {
+        hash ^= (unsigned char)word[i];
+        hash *= 1099511628211ull;
+    }
+    // murmur3 finalizer, FNV alone is weak in the high bits used by Column
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Approx Counter Constructor
+ApproxCounter::ApproxCounter(double epsilon, double delta, size_t heavyHitters)
+    : m_sketch(epsilon, delta), m_capacity(heavyHitters), m_filter(NULL), m_rejectCount(0),
+      m_fold(false)
+{
+    m_heap.reserve(m_capacity);
+    m_position.reserve(m_capacity);
+}
+
+// File Reader
+void ApproxCounter::FileReader(string inFileName)
+{
+    ifstream ifs(inFileName.c_str());
+    if (!ifs)
+    {
+        throw IllegalArgumentException();
+    }
+    string word;
+    while (ifs >> word)
+    {
+        InsertWord(word);
+    }
+}
+
+// Insert Word
+void ApproxCounter::InsertWord(const string& word)
+{
+    // malformed tokens are counted and skipped, same as HashedSplays
+    string strippedWord = Util::Strip(word);
+    if (strippedWord.length() == 0)
+    {
+        if (!Util::IsWellFormed(word))
+        {
+            m_rejectCount++;
+        }
+        return;
+    }
+    string lowerWord = Util::Lower(strippedWord);
+    if (m_filter != NULL && !m_filter->Apply(strippedWord, lowerWord))
+    {
+        return;
+    }
+    Count(m_fold ? lowerWord : strippedWord);
+}
+
+// Count
+void ApproxCounter::Count(const string& word)
+{
+    // heavy hitters are counted exactly and stay out of the sketch
+    unordered_map<string, size_t>::iterator found = m_position.find(word);
+    if (found != m_position.end())
+    {
+        m_heap[found->second].count = CheckedAdd<Frequency>(m_heap[found->second].count, 1);
+        SiftDown(found->second);
+        return;
+    }
+
+    m_sketch.Add(word);
+    if (m_capacity == 0)
+    {
+        return;
+    }
+
+    Frequency estimate = m_sketch.Estimate(word);
+    if (m_heap.size() < m_capacity)
+    {
+        HeavyHitter entry = { word, estimate };
+        m_heap.push_back(entry);
+        m_position[word] = m_heap.size() - 1;
+        SiftUp(m_heap.size() - 1);
+    }
+    else if (estimate > m_heap[0].count)
+    {
+        // the least frequent heavy hitter goes back into the sketch
+        HeavyHitter& smallest = m_heap[0];
+        Frequency estimated = m_sketch.Estimate(smallest.word);
+        if (smallest.count > estimated)
+        {
+            m_sketch.Add(smallest.word, smallest.count - estimated);
+        }
+        m_position.erase(smallest.word);
+        smallest.word = word;
+        smallest.count = estimate;
+        m_position[word] = 0;
+        SiftDown(0);
+    }
+}
+
+// Get Frequency
+Frequency ApproxCounter::GetFrequency(string inWord) const
+{
+    if (m_fold)
+    {
+        inWord = Util::Lower(inWord);
+    }
+    unordered_map<string, size_t>::const_iterator found = m_position.find(inWord);
+    if (found != m_position.end())
+    {
+        return m_heap[found->second].count;
+    }
+    return m_sketch.Estimate(inWord);
+}
+
+// Collect Top K
+void ApproxCounter::CollectTopK(int k, vector<Node>& outNodes) const
+{
+    outNodes.clear();
+    for (size_t i = 0; i < m_heap.size(); ++i)
+    {
+        outNodes.push_back(Node(m_heap[i].word, m_heap[i].count));
+    }
+    sort(outNodes.begin(), outNodes.end(), [](const Node& lhs, const Node& rhs) {
+        if (lhs.GetFrequency() != rhs.GetFrequency())
+        {
+            return lhs.GetFrequency() > rhs.GetFrequency();
+        }
+        return lhs < rhs;
+    });
+    if (k >= 0 && outNodes.size() > (size_t)k)
+    {
+        outNodes.resize(k);
+    }
+}
+
+// Set Filter
+void ApproxCounter::SetFilter(const TokenFilter* filter)
+{
+    m_filter = filter;
+}
+
+// Print Approx Results
+void ApproxCounter::PrintApproxResults(int k) const
+{
+    cout << "***************PRINT APPROXIMATE RESULTS********************" << endl;
+    cout << "Sketch of " << m_sketch.GetDepth() << " x " << m_sketch.GetWidth() << " counters, "
+         << m_heap.size() << " heavy hitters, " << GetMemoryBytes() << " bytes" << endl;
+    if (m_rejectCount > 0)
+    {
+        cout << "Rejected " << m_rejectCount << " malformed tokens" << endl;
+    }
+
+    vector<Node> top;
+    CollectTopK(k, top);
+    for (size_t i = 0; i < top.size(); ++i)
+    {
+        cout << top[i] << endl;
+    }
+    cout << endl << endl;
+}
+
+// Get Memory Bytes
+size_t ApproxCounter::GetMemoryBytes() const
+{
+    // words are bounded by the token length, this counts the fixed part
+    return m_sketch.GetMemoryBytes() + m_capacity * (sizeof(HeavyHitter) + sizeof(string) + 2 * sizeof(void*));
+}
+
+// Sift Up
+void ApproxCounter::SiftUp(size_t index)
+{
+    while (index > 0 && m_heap[index].count < m_heap[(index - 1) / 2].count)
+    {
+        Swap(index, (index - 1) / 2);
+        index = (index - 1) / 2;
+    }
+}
+
+// Sift Down
+void ApproxCounter::SiftDown(size_t index)
+{
+    for (;;)
+    {
+        size_t smallest = index;
+        size_t left = 2 * index + 1;
+        size_t right = left + 1;
+        if (left < m_heap.size() && m_heap[left].count < m_heap[smallest].count)
+            smallest = left;
+        if (right < m_heap.size() && m_heap[right].count < m_heap[smallest].count)
+            smallest = right;
+        if (smallest == index)
+            return;
+        Swap(index, smallest);
+        index = smallest;
+    }
+}
+
+// Swap
+void ApproxCounter::Swap(size_t lhs, size_t rhs)
+{
+    swap(m_heap[lhs], m_heap[rhs]);
+    m_position[m_heap[lhs].word] = lhs;
+    m_position[m_heap[rhs].word] = rhs;
+}
+
+#endif //PROJ3_APPROXCOUNTER_H
@@ -0,0 +1,605 @@
+/*
+ * File:    AsyncReader.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Counting many files with reads kept in flight through io_uring
+ *
+ * FileReader blocks on one read of one file at a time. This reader keeps up
+ * to depth reads in flight over all the files at once: a large file gets
+ * several chunks in flight, and small files are opened one after another
+ * until the queue is full. The ring is driven with the raw io_uring system
+ * calls, there is no liburing. The read buffers are one arena registered
+ * with the ring (IORING_OP_READ_FIXED), and a completed buffer is tokenized
+ * where the kernel wrote it, then handed back to the ring.
+ *
+ * Chunks of one file can complete out of order. They are tokenized in file
+ * order, a chunk that completes early waits for the ones before it, and the
+ * token cut by a chunk boundary carries over as in FileReaderFrom. When
+ * io_uring is missing (older kernels, seccomp) or turned off, the same
+ * files are read one at a time with read() into the same arena.
+ */
+
+#ifndef PROJ3_ASYNCREADER_H
+#define PROJ3_ASYNCREADER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <iostream>
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <cerrno>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#include "HashedSplays.h"
+#include "dsexceptions.h"
+
+#define ASYNC_DEPTH 32              // reads in flight
+#define ASYNC_BUFFER (64 * 1024)    // bytes per read
+
+class AsyncReader {
+
+public:
+    /**********************************************************************
+     * Name: AsyncReader (Constructor)
+     * PreCondition: Table to count into, reads in flight, bytes per read,
+     *               false to skip io_uring and read() every file
+     *
+     * PostCondition: Buffers allocated, the ring set up and the buffers
+     *                registered if the kernel allows it
+     *********************************************************************/
+    AsyncReader(HashedSplays& inTable, int depth = ASYNC_DEPTH, size_t bufferSize = ASYNC_BUFFER,
+                bool useUring = true);
+
+    /**********************************************************************
+     * Name: ~AsyncReader
+     * PreCondition: No FileReader running
+     *
+     * PostCondition: Ring closed, buffers unmapped
+     *********************************************************************/
+    ~AsyncReader();
+
+    /**********************************************************************
+     * Name: FileReader
+     * PreCondition: Input files
+     *
+     * PostCondition: Every file counted, same counts as HashedSplays::
+     *                FileReader on each. Throws IllegalArgumentException
+     *                for a file that does not open, before counting
+     *                anything of it, and ReadFailedException on a failed
+     *                read
+     *********************************************************************/
+    void FileReader(const vector<string>& inFileNames);
+
+    /**********************************************************************
+     * Name: UsesUring
+     * PreCondition: None
+     *
+     * PostCondition: True if reads go through io_uring
+     *********************************************************************/
+    bool UsesUring() const { return m_ring >= 0; }
+
+    /**********************************************************************
+     * Name: PrintStats
+     * PreCondition: None
+     *
+     * PostCondition: Backend, files, bytes, reads, system calls and the
+     *                most reads that were in flight to cout
+     *********************************************************************/
+    void PrintStats() const;
+
+    uint64_t GetBytes() const { return m_bytes; }
+    uint64_t GetSyscalls() const { return m_syscalls; }
+
+private:
+    struct FileState
+    {
+        int fd;
+        uint64_t size;          // from fstat, lowered if the file ends early
+        uint64_t submitted;     // bytes asked for
+        uint64_t consumed;      // bytes tokenized, always a prefix
+        int inFlight;
+        string word;            // token cut by the last chunk boundary
+        map<uint64_t, int> ready;   // completed chunks by offset, waiting their turn
+    };
+
+    // one read, one buffer of the arena
+    struct Slot
+    {
+        int file;
+        uint64_t offset;
+        uint32_t length;
+        uint32_t done;          // bytes in so far, short reads are resumed
+    };
+
+    HashedSplays& m_table;
+    int m_depth;
+    size_t m_bufferSize;
+    char* m_arena;
+    vector<Slot> m_slots;
+    vector<int> m_freeSlots;
+
+    // ring, mapped from the kernel
+    int m_ring;
+    bool m_fixed;               // buffers registered
+    void* m_sqRing;
+    size_t m_sqRingSize;
+    void* m_cqRing;
+    size_t m_cqRingSize;
+    io_uring_sqe* m_sqes;
+    size_t m_sqesSize;
+    unsigned* m_sqTail;
+    unsigned m_sqMask;
+    unsigned* m_sqArray;
+    unsigned* m_cqHead;
+    unsigned* m_cqTail;
+    unsigned m_cqMask;
+    io_uring_cqe* m_cqes;
+    unsigned m_unsubmitted;     // queued entries the kernel has not taken
+
+    // stats
+    uint64_t m_files;
+    uint64_t m_bytes;
+    uint64_t m_reads;
+    uint64_t m_syscalls;
+    int m_inFlight;
+    int m_maxInFlight;
+
+    bool SetupRing();
+    void CloseRing();
+
+    // open, fstat, and the file's state. Throws if it does not open
+    void OpenFile(const string& name, FileState& file);
+
+    // queue a read of the rest of slot's chunk
+    void QueueRead(const FileState& file, int slot);
+
+    // submit what is queued, wait for at least one completion
+    void Enter(unsigned waitFor);
+
+    void ReadUring(const vector<string>& inFileNames);
+    void ReadSequential(int fd, string& word);
+
+    // count the tokens of one chunk, word carries across chunks
+    void Tokenize(string& word, const char* data, size_t length);
+
+    // last token of a file, then close it
+    void FinishFile(FileState& file);
+};
+
+// Constructor
+AsyncReader::AsyncReader(HashedSplays& inTable, int depth, size_t bufferSize, bool useUring)
+    : m_table(inTable), m_depth(max(1, depth)), m_bufferSize(bufferSize), m_arena(NULL),
+      m_ring(-1), m_fixed(false), m_sqRing(MAP_FAILED), m_sqRingSize(0), m_cqRing(MAP_FAILED),
+      m_cqRingSize(0), m_sqes((io_uring_sqe*)MAP_FAILED), m_sqesSize(0), m_unsubmitted(0),
+      m_files(0), m_bytes(0), m_reads(0), m_syscalls(0), m_inFlight(0), m_maxInFlight(0)
+{
+    void* arena = mmap(NULL, m_depth * m_bufferSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (arena == MAP_FAILED)
+    {
+        throw IllegalArgumentException();
+    }
+    m_arena = (char*)arena;
+    m_slots.resize(m_depth);
+    for (int s = m_depth - 1; s >= 0; --s)
+    {
+        m_freeSlots.push_back(s);
+    }
+    if (useUring && !SetupRing())
+    {
+        CloseRing();
+    }
+}
+
+// Destructor
+AsyncReader::~AsyncReader()
+{
+    CloseRing();
+    munmap(m_arena, m_depth * m_bufferSize);
+}
+
+// Setup Ring
+bool AsyncReader::SetupRing()
+{
+    io_uring_params params;
+    memset(&params, 0, sizeof(params));
+    m_ring = (int)syscall(__NR_io_uring_setup, (unsigned)m_depth, &params);
+    if (m_ring < 0)
+    {
+        m_ring = -1;
+        return false;
+    }
+
+    // the submission ring, completion ring and entries are mapped from the ring's fd
+    m_sqRingSize = params.sq_off.array + params.sq_entries * sizeof(unsigned);
+    m_cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(io_uring_cqe);
+    bool single = (params.features & IORING_FEAT_SINGLE_MMAP) != 0;
+    if (single)
+    {
+        m_sqRingSize = m_cqRingSize = max(m_sqRingSize, m_cqRingSize);
+    }
+    m_sqRing = mmap(NULL, m_sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring,
+                    IORING_OFF_SQ_RING);
+    if (m_sqRing == MAP_FAILED)
+    {
+        return false;
+    }
+    if (!single)
+    {
+        m_cqRing = mmap(NULL, m_cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring,
+                        IORING_OFF_CQ_RING);
+        if (m_cqRing == MAP_FAILED)
+        {
+            return false;
+        }
+    }
+    char* cq = (char*)(single ? m_sqRing : m_cqRing);
+    m_sqesSize = params.sq_entries * sizeof(io_uring_sqe);
+    m_sqes = (io_uring_sqe*)mmap(NULL, m_sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, m_ring,
+                                 IORING_OFF_SQES);
+    if (m_sqes == MAP_FAILED)
+    {
+        return false;
+    }
+
+    char* sq = (char*)m_sqRing;
+    m_sqTail = (unsigned*)(sq + params.sq_off.tail);
+    m_sqMask = *(unsigned*)(sq + params.sq_off.ring_mask);
+    m_sqArray = (unsigned*)(sq + params.sq_off.array);
+    m_cqHead = (unsigned*)(cq + params.cq_off.head);
+    m_cqTail = (unsigned*)(cq + params.cq_off.tail);
+    m_cqMask = *(unsigned*)(cq + params.cq_off.ring_mask);
+    m_cqes = (io_uring_cqe*)(cq + params.cq_off.cqes);
+
+    // registered buffers are pinned once instead of on every read; without
+    // enough locked memory allowed, plain reads into the same buffers
+    vector<iovec> buffers(m_depth);
+    for (int s = 0; s < m_depth; ++s)
+    {
+        buffers[s].iov_base = m_arena + s * m_bufferSize;
+        buffers[s].iov_len = m_bufferSize;
+    }
+    m_fixed = syscall(__NR_io_uring_register, m_ring, IORING_REGISTER_BUFFERS, buffers.data(), m_depth) == 0;
+    return true;
+}
+
+// Close Ring
+void AsyncReader::CloseRing()
+{
+    if (m_sqes != MAP_FAILED)
+    {
+        munmap(m_sqes, m_sqesSize);
+        m_sqes = (io_uring_sqe*)MAP_FAILED;
+    }
+    if (m_cqRing != MAP_FAILED)
+    {
+        munmap(m_cqRing, m_cqRingSize);
+        m_cqRing = MAP_FAILED;
+    }
+    if (m_sqRing != MAP_FAILED)
+    {
+        munmap(m_sqRing, m_sqRingSize);
+        m_sqRing = MAP_FAILED;
+    }
+    if (m_ring >= 0)
+    {
+        close(m_ring);
+        m_ring = -1;
+    }
+    m_fixed = false;
+}
+
+// File Reader
+void AsyncReader::FileReader(const vector<string>& inFileNames)
+{
+    if (UsesUring())
+    {
+        ReadUring(inFileNames);
+        return;
+    }
+    for (size_t f = 0; f < inFileNames.size(); ++f)
+    {
+        FileState file;
+        OpenFile(inFileNames[f], file);
+        ReadSequential(file.fd, file.word);
+        FinishFile(file);
+    }
+}
+
+// Open File
+void AsyncReader::OpenFile(const string& name, FileState& file)
+{
+    file.fd = open(name.c_str(), O_RDONLY);
+    m_syscalls++;
+    if (file.fd < 0)
+    {
+        throw IllegalArgumentException();
+    }
+    struct stat info;
+    m_syscalls++;
+    // anything but a regular file has no size to cut into chunks
+    file.size = fstat(file.fd, &info) == 0 && S_ISREG(info.st_mode) ? (uint64_t)info.st_size : 0;
+    file.submitted = 0;
+    file.consumed = 0;
+    file.inFlight = 0;
+    file.word.clear();
+    file.ready.clear();
+    m_files++;
+}
+
+// Queue Read
+void AsyncReader::QueueRead(const FileState& file, int slot)
+{
+    const Slot& read = m_slots[slot];
+    unsigned tail = *m_sqTail;
+    unsigned index = tail & m_sqMask;
+    io_uring_sqe& sqe = m_sqes[index];
+    memset(&sqe, 0, sizeof(sqe));
+    sqe.opcode = m_fixed ? IORING_OP_READ_FIXED : IORING_OP_READ;
+    sqe.fd = file.fd;
+    sqe.off = read.offset + read.done;
+    sqe.addr = (uint64_t)(uintptr_t)(m_arena + slot * m_bufferSize + read.done);
+    sqe.len = read.length - read.done;
+    sqe.buf_index = m_fixed ? slot : 0;
+    sqe.user_data = slot;
+    m_sqArray[index] = index;
+    // the entry must be visible before the kernel sees the new tail
+    __atomic_store_n(m_sqTail, tail + 1, __ATOMIC_RELEASE);
+    m_unsubmitted++;
+    m_reads++;
+}
+
+// Enter
+void AsyncReader::Enter(unsigned waitFor)
+{
+    for (;;)
+    {
+        m_syscalls++;
+        int taken = (int)syscall(__NR_io_uring_enter, m_ring, m_unsubmitted, waitFor, IORING_ENTER_GETEVENTS,
+                                 NULL, 0);
+        if (taken >= 0)
+        {
+            m_unsubmitted -= taken;
+            return;
+        }
+        if (errno != EINTR && errno != EAGAIN && errno != EBUSY)
+        {
+            throw ReadFailedException();
+        }
+    }
+}
+
+// Read Uring
+void AsyncReader::ReadUring(const vector<string>& inFileNames)
+{
+    vector<FileState> files(inFileNames.size());
+    vector<int> active;         // open files, in the order they were opened
+    size_t nextFile = 0;
+    size_t turn = 0;
+
+    for (;;)
+    {
+        // fill free buffers: open files with bytes left first, round
+        // robin, then open the next file
+        while (!m_freeSlots.empty())
+        {
+            int chosen = -1;
+            for (size_t tried = 0; tried < active.size() && chosen < 0; ++tried)
+            {
+                int f = active[(turn + tried) % active.size()];
+                if (files[f].submitted < files[f].size)
+                {
+                    chosen = f;
+                    turn = (turn + tried + 1) % active.size();
+                }
+            }
+            if (chosen < 0)
+            {
+                if (nextFile == inFileNames.size() || (int)active.size() >= m_depth)
+                {
+                    break;
+                }
+                int f = (int)nextFile++;
+                OpenFile(inFileNames[f], files[f]);
+                if (files[f].size == 0)
+                {
+                    // empty, or a pipe or device: read it here and now
+                    ReadSequential(files[f].fd, files[f].word);
+                    FinishFile(files[f]);
+                }
+                else
+                {
+                    active.push_back(f);
+                }
+                continue;
+            }
+
+            FileState& file = files[chosen];
+            int slot = m_freeSlots.back();
+            m_freeSlots.pop_back();
+            m_slots[slot].file = chosen;
+            m_slots[slot].offset = file.submitted;
+            m_slots[slot].length = (uint32_t)min((uint64_t)m_bufferSize, file.size - file.submitted);
+            m_slots[slot].done = 0;
+            file.submitted += m_slots[slot].length;
+            file.inFlight++;
+            m_inFlight++;
+            QueueRead(file, slot);
+        }
+        m_maxInFlight = max(m_maxInFlight, m_inFlight);
+        if (m_inFlight == 0)
+        {
+            break;
+        }
+
+        Enter(1);
+
+        // reap every completion there is
+        unsigned head = *m_cqHead;
+        unsigned tail = __atomic_load_n(m_cqTail, __ATOMIC_ACQUIRE);
+        vector<int> touched;
+        for (; head != tail; ++head)
+        {
+            const io_uring_cqe& cqe = m_cqes[head & m_cqMask];
+            int slot = (int)cqe.user_data;
+            Slot& read = m_slots[slot];
+            FileState& file = files[read.file];
+            if (cqe.res == -EAGAIN || cqe.res == -EINTR)
+            {
+                QueueRead(file, slot);
+                continue;
+            }
+            if (cqe.res < 0)
+            {
+                __atomic_store_n(m_cqHead, head + 1, __ATOMIC_RELEASE);
+                throw ReadFailedException();
+            }
+            read.done += cqe.res;
+            if (cqe.res > 0 && read.done < read.length)
+            {
+                // short read, ask for the rest into the same buffer
+                QueueRead(file, slot);
+                continue;
+            }
+            if (read.done < read.length)
+            {
+                // end of file came early, the file shrank since fstat
+                read.length = read.done;
+                file.size = min(file.size, read.offset + read.done);
+            }
+            file.ready[read.offset] = slot;
+            touched.push_back(read.file);
+        }
+        __atomic_store_n(m_cqHead, head, __ATOMIC_RELEASE);
+
+        // tokenize the chunks that are next in their file, in place
+        for (size_t t = 0; t < touched.size(); ++t)
+        {
+            FileState& file = files[touched[t]];
+            map<uint64_t, int>::iterator next;
+            while (!file.ready.empty() && (next = file.ready.begin())->first <= file.consumed)
+            {
+                int slot = next->second;
+                file.ready.erase(next);
+                if (m_slots[slot].offset == file.consumed && file.consumed < file.size)
+                {
+                    Tokenize(file.word, m_arena + slot * m_bufferSize, m_slots[slot].length);
+                    file.consumed += m_slots[slot].length;
+                    m_bytes += m_slots[slot].length;
+                }
+                file.inFlight--;
+                m_inFlight--;
+                m_freeSlots.push_back(slot);
+            }
+            // chunks past an early end come back empty and are dropped above
+            if (file.consumed >= file.size)
+            {
+                while (!file.ready.empty())
+                {
+                    m_freeSlots.push_back(file.ready.begin()->second);
+                    file.ready.erase(file.ready.begin());
+                    file.inFlight--;
+                    m_inFlight--;
+                }
+                if (file.inFlight == 0 && file.fd >= 0)
+                {
+                    FinishFile(file);
+                    for (size_t a = 0; a < active.size(); ++a)
+                    {
+                        if (active[a] == touched[t])
+                        {
+                            active.erase(active.begin() + a);
+                            break;
+                        }
+                    }
+                    turn = active.empty() ? 0 : turn % active.size();
+                }
+            }
+        }
+    }
+}
+
+// Read Sequential
+void AsyncReader::ReadSequential(int fd, string& word)
+{
+    for (;;)
+    {
+        m_syscalls++;
+        m_reads++;
+        ssize_t got = read(fd, m_arena, m_bufferSize);
+        if (got < 0)
+        {
+            if (errno == EINTR)
+            {
+                continue;
+            }
+            throw ReadFailedException();
+        }
+        if (got == 0)
+        {
+            break;
+        }
+        Tokenize(word, m_arena, got);
+        m_bytes += got;
+    }
+    m_maxInFlight = max(m_maxInFlight, 1);
+}
+
+// Tokenize
+void AsyncReader::Tokenize(string& word, const char* data, size_t length)
+{
+    // same token boundaries as ifs >> word
+    size_t i = 0;
+    while (i < length)
+    {
+        if (isspace((unsigned char)data[i]))
+        {
+            if (word.length() > 0)
+            {
+                m_table.InsertWord(word);
+                word.clear();
+            }
+            i++;
+            continue;
+        }
+        size_t start = i;
+        while (i < length && !isspace((unsigned char)data[i]))
+        {
+            i++;
+        }
+        word.append(data + start, i - start);
+    }
+}
+
+// Finish File
+void AsyncReader::FinishFile(FileState& file)
+{
+    if (file.word.length() > 0)
+    {
+        m_table.InsertWord(file.word);
+        file.word.clear();
+    }
+    close(file.fd);
+    m_syscalls++;
+    file.fd = -1;
+}
+
+// Print Stats
+void AsyncReader::PrintStats() const
+{
+    const char* backend = !UsesUring() ? "read()" : m_fixed ? "io_uring, registered buffers" : "io_uring";
+    cout << "Read " << m_files << " files, " << m_bytes << " bytes with " << backend << ": " << m_reads
+         << " reads, " << m_syscalls << " system calls, at most " << m_maxInFlight << " in flight" << endl;
+}
+
+#endif //PROJ3_ASYNCREADER_H
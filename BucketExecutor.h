@@ -0,0 +1,193 @@
+/*
+ * File:    BucketExecutor.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Task executor for independent per bucket work
+ *
+ * A fixed pool of worker threads that runs one task per bucket. Buckets
+ * are handed out one at a time from a shared counter, so a big bucket does
+ * not hold up a worker's whole share. The calling thread works too and
+ * ParallelFor only returns once every bucket is done, so callers write each
+ * bucket's result into its own slot and gather them in bucket order, which
+ * keeps the output deterministic.
+ *
+ * The pool runs one job at a time. ParallelFor may be called from several
+ * threads at once (the query server's threads all search through one
+ * table); the later calls wait for the running job to finish. A task must
+ * not call ParallelFor on the executor running it, that would wait on
+ * itself.
+ */
+
+#ifndef PROJ3_BUCKETEXECUTOR_H
+#define PROJ3_BUCKETEXECUTOR_H
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <functional>
+#include <exception>
+#include "dsexceptions.h"
+
+class BucketExecutor {
+
+public:
+    /**********************************************************************
+     * Name: BucketExecutor (Constructor)
+     * PreCondition: Number of threads to run tasks on, the calling thread
+     *               included, at least 1
+     *
+     * PostCondition: threads - 1 workers waiting for work
+     *********************************************************************/
+    BucketExecutor(int threads);
+
+    /**********************************************************************
+     * Name: ~BucketExecutor
+     * PreCondition: No ParallelFor running
+     *
+     * PostCondition: Workers stopped and joined
+     *********************************************************************/
+    ~BucketExecutor();
+
+    /**********************************************************************
+     * Name: ParallelFor
+     * PreCondition: Number of buckets and a task taking a bucket index.
+     *               Tasks for different buckets must not share state, and
+     *               must not call ParallelFor on this executor. Safe to
+     *               call from any thread, calls run one after another
+     *
+     * PostCondition: task ran once for every index. The first exception a
+     *                task threw is rethrown here
+     *********************************************************************/
+    void ParallelFor(int count, const function<void(int)>& task);
+
+    int GetThreads() const { return (int)m_workers.size() + 1; }
+
+private:
+    vector<thread> m_workers;
+    mutex m_job;                // held by the ParallelFor whose job is current
+    mutex m_mutex;
+    condition_variable m_wake;
+    condition_variable m_finished;
+
+    // current job, replaced under m_mutex for every ParallelFor
+    const function<void(int)>* m_task;
+    int m_count;
+    atomic<int> m_next;
+    int m_busy;                 // workers still inside the current job
+    unsigned long m_generation; // bumped per job so workers join each once
+    bool m_stop;
+    exception_ptr m_error;
+
+    void WorkerLoop();
+    void Drain();
+};
+
+// Constructor
+BucketExecutor::BucketExecutor(int threads)
+    : m_task(NULL), m_count(0), m_next(0), m_busy(0), m_generation(0), m_stop(false)
+{
+    if (threads < 1)
+    {
+        throw IllegalArgumentException();
+    }
+    for (int i = 1; i < threads; ++i)
+    {
+        m_workers.push_back(thread(&BucketExecutor::WorkerLoop, this));
+    }
+}
+
+// Destructor
+BucketExecutor::~BucketExecutor()
+{
+    {
+        lock_guard<mutex> lock(m_mutex);
+        m_stop = true;
+    }
+    m_wake.notify_all();
+    for (size_t i = 0; i < m_workers.size(); ++i)
+    {
+        m_workers[i].join();
+    }
+}
+
+// Parallel For
+void BucketExecutor::ParallelFor(int count, const function<void(int)>& task)
+{
+    // the job state below is shared, one call owns it at a time
+    lock_guard<mutex> job(m_job);
+    {
+        unique_lock<mutex> lock(m_mutex);
+        m_task = &task;
+        m_count = count;
+        m_next = 0;
+        m_busy = (int)m_workers.size();
+        m_error = exception_ptr();
+        m_generation++;
+    }
+    m_wake.notify_all();
+
+    Drain();
+
+    // every worker has to leave the job before the task goes out of scope
+    unique_lock<mutex> lock(m_mutex);
+    m_finished.wait(lock, [this]() { return m_busy == 0; });
+    m_task = NULL;
+    if (m_error)
+    {
+        rethrow_exception(m_error);
+    }
+}
+
+// Worker Loop
+void BucketExecutor::WorkerLoop()
+{
+    unsigned long seen = 0;
+    for (;;)
+    {
+        {
+            unique_lock<mutex> lock(m_mutex);
+            m_wake.wait(lock, [&]() { return m_stop || m_generation != seen; });
+            if (m_stop)
+            {
+                return;
+            }
+            seen = m_generation;
+        }
+
+        Drain();
+
+        {
+            lock_guard<mutex> lock(m_mutex);
+            m_busy--;
+        }
+        m_finished.notify_one();
+    }
+}
+
+// Drain, run buckets until none are left
+void BucketExecutor::Drain()
+{
+    int index;
+    while ((index = m_next.fetch_add(1)) < m_count)
+    {
+        try
+        {
+            (*m_task)(index);
+        }
+        catch (...)
+        {
+            lock_guard<mutex> lock(m_mutex);
+            if (!m_error)
+            {
+                m_error = current_exception();
+            }
+        }
+    }
+}
+
+#endif //PROJ3_BUCKETEXECUTOR_H
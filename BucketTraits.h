@@ -0,0 +1,114 @@
+/*
+ * File:    BucketTraits.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Compile time bucket mapping and key order
+ *
+ * BucketMap<Alphabet, CasePolicy> turns a word's first byte into its
+ * bucket with one load from a 256 entry table built by the compiler: the
+ * case policy folds the byte, the alphabet gives its slot or -1. The table
+ * the HashedSplays trees use is TableBuckets, ASCII letters folded to
+ * lowercase, which is what "firstLetter - 97" computed at run time.
+ *
+ * KeyOrder<T> is how SplayTree orders its items, a < b unless specialized.
+ * Nodes are specialized to ByteOrder, a memcmp of the common prefix and
+ * then the lengths: the order std::string's operator< gives, so runs,
+ * snapshots and frozen copies stay valid, but inlined into the tree loops
+ * instead of a call into Node.o for every comparison.
+ */
+
+#ifndef PROJ3_BUCKETTRAITS_H
+#define PROJ3_BUCKETTRAITS_H
+
+#include <string>
+#include <cstring>
+
+using namespace std;
+
+// 0..N-1 as a template parameter pack, to build tables at compile time
+template <int... I>
+struct IndexList {};
+
+template <int N, int... I>
+struct MakeIndexList : MakeIndexList<N - 1, N - 1, I...> {};
+
+template <int... I>
+struct MakeIndexList<0, I...>
+{
+    typedef IndexList<I...> Type;
+};
+
+/*
+ * Alphabets, the slot of an already folded byte, -1 for no bucket
+ */
+struct AsciiLetters
+{
+    static const int Size = 26;
+    static constexpr int Slot(int c) { return c >= 'a' && c <= 'z' ? c - 'a' : -1; }
+};
+
+/*
+ * Case policies, the byte an alphabet sees
+ */
+struct FoldAscii
+{
+    static constexpr int Fold(int c) { return c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c; }
+};
+
+struct ExactCase
+{
+    static constexpr int Fold(int c) { return c; }
+};
+
+// bucket of every byte value
+struct BucketTable
+{
+    signed char slot[256];
+};
+
+template <typename Alphabet, typename CasePolicy, int... I>
+constexpr BucketTable MakeBucketTable(IndexList<I...>)
+{
+    return BucketTable{ { (signed char)Alphabet::Slot(CasePolicy::Fold(I))... } };
+}
+
+template <typename Alphabet, typename CasePolicy>
+struct BucketMap
+{
+    static const int Size = Alphabet::Size;
+    static constexpr BucketTable s_table = MakeBucketTable<Alphabet, CasePolicy>(MakeIndexList<256>::Type());
+
+    // bucket of a byte, -1 if it has none
+    static int Index(char c) { return s_table.slot[(unsigned char)c]; }
+};
+
+template <typename Alphabet, typename CasePolicy>
+constexpr BucketTable BucketMap<Alphabet, CasePolicy>::s_table;
+
+typedef BucketMap<AsciiLetters, FoldAscii> TableBuckets;
+
+/*
+ * Byte order of two strings: memcmp over the shorter length, then the
+ * shorter first. Same order as std::string's operator<
+ */
+struct ByteOrder
+{
+    static bool Less(const string& a, const string& b)
+    {
+        size_t common = a.size() < b.size() ? a.size() : b.size();
+        int order = memcmp(a.data(), b.data(), common);
+        return order < 0 || (order == 0 && a.size() < b.size());
+    }
+};
+
+// Order of SplayTree items, specialize to replace a < b
+template <typename T>
+struct KeyOrder
+{
+    static bool Less(const T& a, const T& b) { return a < b; }
+};
+
+#endif //PROJ3_BUCKETTRAITS_H
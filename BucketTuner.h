@@ -0,0 +1,307 @@
+/*
+ * File:    BucketTuner.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Per bucket choice between splaying, a static tree and a frozen copy
+ *
+ * A tuner watches the accesses to one bucket in windows of TUNER_WINDOW.
+ * One access in TUNER_SAMPLE is sampled: its key goes to a small
+ * Misra-Gries heavy hitter summary and its time is recorded against the
+ * bucket's current mode. At the end of a window the skew is the share of
+ * sampled accesses the heavy hitters account for, and with the share of
+ * writes it picks a mode:
+ *
+ *   almost no writes             --> BUCKET_FROZEN, reads use a FrozenBucket
+ *   skew at least TUNER_SKEW_HIGH --> BUCKET_SPLAY, hot words stay near the root
+ *   skew at most TUNER_SKEW_LOW   --> BUCKET_STATIC, no rotations at all
+ *
+ * Between the two skew limits the bucket keeps its tree mode, and a new
+ * mode has to win TUNER_CONFIRM windows in a row before the bucket
+ * switches. A write to a frozen bucket thaws it at once, and the bucket
+ * then needs twice as many windows as before to freeze again.
+ */
+
+#ifndef PROJ3_BUCKETTUNER_H
+#define PROJ3_BUCKETTUNER_H
+
+#include <string>
+#include <iostream>
+#include <cstdio>
+#include <stdint.h>
+#include "FrozenBucket.h"
+
+#define TUNER_WINDOW 4096       // accesses per decision
+#define TUNER_SAMPLE 8          // one access in this many is sampled
+#define TUNER_HEAVY 16          // heavy hitter counters
+#define TUNER_SKEW_HIGH 0.40
+#define TUNER_SKEW_LOW 0.20
+#define TUNER_READ_ONLY 0.01    // write share a bucket freezes under
+#define TUNER_CONFIRM 2         // windows a new mode must win in a row
+#define TUNER_CONFIRM_MAX 64    // most windows a thawed bucket waits
+
+// How a bucket serves its accesses
+enum BucketMode { BUCKET_SPLAY, BUCKET_STATIC, BUCKET_FROZEN };
+
+class BucketTuner {
+
+public:
+    /**********************************************************************
+     * Name: BucketTuner (Constructor)
+     * PreCondition: None
+     *
+     * PostCondition: Bucket in BUCKET_SPLAY, an empty window
+     *********************************************************************/
+    BucketTuner();
+
+    /**********************************************************************
+     * Name: Tick
+     * PreCondition: One access to the bucket is about to run
+     *
+     * PostCondition: Access counted as a read or a write. True if it is
+     *                sampled, then the caller times it and calls Sample
+     *********************************************************************/
+    bool Tick(bool write)
+    {
+        m_accesses++;
+        m_writes += write;
+        return m_accesses % TUNER_SAMPLE == 0;
+    }
+
+    /**********************************************************************
+     * Name: Sample
+     * PreCondition: Key and time of a sampled access
+     *
+     * PostCondition: Key in the heavy hitter summary, time recorded for
+     *                the current mode
+     *********************************************************************/
+    void Sample(const string& key, double nanoseconds);
+
+    bool WindowFull() const { return m_accesses >= TUNER_WINDOW; }
+
+    /**********************************************************************
+     * Name: Decide
+     * PreCondition: A full window
+     *
+     * PostCondition: The mode the bucket should be in, with hysteresis.
+     *                The window is reset, the mode is not changed
+     *********************************************************************/
+    BucketMode Decide();
+
+    /**********************************************************************
+     * Name: SetMode
+     * PreCondition: Mode the bucket was switched to
+     *
+     * PostCondition: Switch counted, a frozen copy dropped if the bucket
+     *                left BUCKET_FROZEN
+     *********************************************************************/
+    void SetMode(BucketMode mode);
+
+    /**********************************************************************
+     * Name: Thaw
+     * PreCondition: Bucket frozen and about to be written
+     *
+     * PostCondition: The tree mode to go back to. Freezing again takes
+     *                twice as many windows
+     *********************************************************************/
+    BucketMode Thaw();
+
+    BucketMode GetMode() const { return m_mode; }
+    FrozenBucket& GetFrozen() { return m_frozen; }
+    const FrozenBucket& GetFrozen() const { return m_frozen; }
+
+    /**********************************************************************
+     * Name: Print
+     * PreCondition: Stream and the bucket's index
+     *
+     * PostCondition: Mode, last skew and write share, switches and the
+     *                sampled time per access in each mode, one line
+     *********************************************************************/
+    void Print(ostream& out, int index) const;
+
+    static const char* ModeName(BucketMode mode);
+
+private:
+    BucketMode m_mode;
+    BucketMode m_treeMode;      // mode to go back to from frozen
+    BucketMode m_pending;       // mode winning the last windows
+    int m_votes;                // windows in a row m_pending won
+    int m_freezeConfirm;        // windows freezing has to win
+
+    // current window
+    uint32_t m_accesses;
+    uint32_t m_writes;
+    uint32_t m_samples;
+    string m_heavyKeys[TUNER_HEAVY];
+    uint32_t m_heavyCounts[TUNER_HEAVY];
+
+    // metrics
+    double m_lastSkew;
+    double m_lastWriteShare;
+    uint64_t m_windows;
+    uint64_t m_switches;
+    uint64_t m_timed[3];        // sampled accesses per mode
+    double m_nanoseconds[3];    // their total time per mode
+
+    FrozenBucket m_frozen;
+};
+
+// Constructor
+BucketTuner::BucketTuner()
+    : m_mode(BUCKET_SPLAY), m_treeMode(BUCKET_SPLAY), m_pending(BUCKET_SPLAY), m_votes(0),
+      m_freezeConfirm(TUNER_CONFIRM), m_accesses(0), m_writes(0), m_samples(0),
+      m_lastSkew(0.0), m_lastWriteShare(0.0), m_windows(0), m_switches(0)
+{
+    for (int h = 0; h < TUNER_HEAVY; ++h)
+    {
+        m_heavyCounts[h] = 0;
+    }
+    for (int m = 0; m < 3; ++m)
+    {
+        m_timed[m] = 0;
+        m_nanoseconds[m] = 0.0;
+    }
+}
+
+// Sample
+void BucketTuner::Sample(const string& key, double nanoseconds)
+{
+    m_samples++;
+    m_timed[m_mode]++;
+    m_nanoseconds[m_mode] += nanoseconds;
+
+    // Misra-Gries: count a tracked key, take a free counter, or age them all
+    int free = -1;
+    for (int h = 0; h < TUNER_HEAVY; ++h)
+    {
+        if (m_heavyCounts[h] > 0 && m_heavyKeys[h] == key)
+        {
+            m_heavyCounts[h]++;
+            return;
+        }
+        if (m_heavyCounts[h] == 0 && free < 0)
+        {
+            free = h;
+        }
+    }
+    if (free >= 0)
+    {
+        m_heavyKeys[free] = key;
+        m_heavyCounts[free] = 1;
+        return;
+    }
+    for (int h = 0; h < TUNER_HEAVY; ++h)
+    {
+        m_heavyCounts[h]--;
+    }
+}
+
+// Decide
+BucketMode BucketTuner::Decide()
+{
+    // the counters undercount, so the skew is a lower bound
+    uint32_t heavy = 0;
+    for (int h = 0; h < TUNER_HEAVY; ++h)
+    {
+        heavy += m_heavyCounts[h];
+        m_heavyCounts[h] = 0;
+    }
+    m_lastSkew = m_samples == 0 ? 0.0 : (double)heavy / m_samples;
+    m_lastWriteShare = m_accesses == 0 ? 0.0 : (double)m_writes / m_accesses;
+    m_windows++;
+    m_accesses = 0;
+    m_writes = 0;
+    m_samples = 0;
+
+    BucketMode want;
+    if (m_lastWriteShare <= TUNER_READ_ONLY)
+    {
+        want = BUCKET_FROZEN;
+    }
+    else if (m_lastSkew >= TUNER_SKEW_HIGH)
+    {
+        want = BUCKET_SPLAY;
+    }
+    else if (m_lastSkew <= TUNER_SKEW_LOW)
+    {
+        want = BUCKET_STATIC;
+    }
+    else
+    {
+        want = m_mode == BUCKET_FROZEN ? m_treeMode : m_mode;
+    }
+
+    if (want == m_mode)
+    {
+        m_votes = 0;
+        return m_mode;
+    }
+    m_votes = want == m_pending ? m_votes + 1 : 1;
+    m_pending = want;
+    int needed = want == BUCKET_FROZEN ? m_freezeConfirm : TUNER_CONFIRM;
+    return m_votes >= needed ? want : m_mode;
+}
+
+// Set Mode
+void BucketTuner::SetMode(BucketMode mode)
+{
+    if (mode == m_mode)
+    {
+        return;
+    }
+    if (m_mode == BUCKET_FROZEN)
+    {
+        m_frozen = FrozenBucket();
+    }
+    if (mode != BUCKET_FROZEN)
+    {
+        m_treeMode = mode;
+    }
+    m_mode = mode;
+    m_votes = 0;
+    m_switches++;
+}
+
+// Thaw
+BucketMode BucketTuner::Thaw()
+{
+    m_freezeConfirm = min(m_freezeConfirm * 2, TUNER_CONFIRM_MAX);
+    return m_treeMode;
+}
+
+// Print
+void BucketTuner::Print(ostream& out, int index) const
+{
+    char line[256];
+    snprintf(line, sizeof(line), "bucket %2d  %-7s skew %.2f  writes %.2f  windows %6llu  switches %4llu",
+             index, ModeName(m_mode), m_lastSkew, m_lastWriteShare,
+             (unsigned long long)m_windows, (unsigned long long)m_switches);
+    out << line;
+    for (int m = 0; m < 3; ++m)
+    {
+        if (m_timed[m] > 0)
+        {
+            snprintf(line, sizeof(line), "  %s %.0f ns", ModeName((BucketMode)m), m_nanoseconds[m] / m_timed[m]);
+            out << line;
+        }
+    }
+    out << endl;
+}
+
+// Mode Name
+const char* BucketTuner::ModeName(BucketMode mode)
+{
+    switch (mode)
+    {
+    case BUCKET_SPLAY:
+        return "splay";
+    case BUCKET_STATIC:
+        return "static";
+    default:
+        return "frozen";
+    }
+}
+
+#endif //PROJ3_BUCKETTUNER_H
@@ -0,0 +1,220 @@
+/*
+ * File:    Checkpoint.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Checkpoint for incremental counting of append only files
+ *
+ * A checkpoint records how far into a file the table has counted: the byte
+ * offset, the partial token left at that offset (carry), and the identity of
+ * the file (device, inode and a hash of the bytes just before the offset).
+ * If the file was replaced or truncated the identity no longer matches and
+ * the caller has to count from byte zero again.
+ *
+ * The table snapshot and the checkpoint are two files renamed one after the
+ * other. Both carry the same generation, a fresh value per save, and a
+ * snapshot is only loaded with the checkpoint of its own generation. A crash
+ * between the two renames leaves them mismatched, so the next run counts
+ * from byte zero instead of counting the new bytes twice.
+ */
+
+#ifndef PROJ3_CHECKPOINT_H
+#define PROJ3_CHECKPOINT_H
+
+#include <string>
+#include <fstream>
+#include <sstream>
+#include <cstdio>
+#include <chrono>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include "dsexceptions.h"
+
+// bytes before the offset hashed to detect a rewritten file
+#define CHECKPOINT_TAIL_BYTES 4096
+
+class Checkpoint {
+
+public:
+    /**********************************************************************
+     * Name: Checkpoint (Constructor)
+     * PreCondition: None
+     *
+     * PostCondition: Checkpoint at byte zero of no particular file
+     *********************************************************************/
+    Checkpoint() : m_offset(0), m_device(0), m_inode(0), m_tailHash(0), m_generation(0) {}
+
+    /**********************************************************************
+     * Name: Capture
+     * PreCondition: Counted file, the offset counted up to, the partial
+     *               token left at that offset and the generation of the
+     *               snapshot saved with it
+     *
+     * PostCondition: Checkpoint describes the file as it is right now
+     *********************************************************************/
+    void Capture(string inFileName, long long offset, string carry, uint64_t generation);
+
+    /**********************************************************************
+     * Name: Matches
+     * PreCondition: File about to be counted incrementally
+     *
+     * PostCondition: True if the file is the one that was checkpointed and
+     *                only grew since, so counting can resume at the offset
+     *********************************************************************/
+    bool Matches(string inFileName) const;
+
+    /**********************************************************************
+     * Name: Load
+     * PreCondition: Path of a checkpoint written by Save
+     *
+     * PostCondition: True if the checkpoint was read, false if missing
+     *                or damaged (then the checkpoint is unchanged)
+     *********************************************************************/
+    bool Load(string inPath);
+
+    /**********************************************************************
+     * Name: Save
+     * PreCondition: Path for the checkpoint
+     *
+     * PostCondition: Checkpoint written, replacing any older one atomically.
+     *                Throws WriteFailedException if it could not be written
+     *                or renamed
+     *********************************************************************/
+    void Save(string inPath) const;
+
+    long long GetOffset() const { return m_offset; }
+    string GetCarry() const { return m_carry; }
+    uint64_t GetGeneration() const { return m_generation; }
+
+    // value for the next snapshot and checkpoint pair, never 0
+    static uint64_t NewGeneration();
+
+private:
+    long long m_offset;       // bytes of the file already counted
+    string m_carry;           // partial token at the offset, not yet counted
+    unsigned long long m_device;
+    unsigned long long m_inode;
+    uint64_t m_tailHash;      // FNV-1a of the bytes just before the offset
+    uint64_t m_generation;    // snapshot this checkpoint goes with
+
+    static uint64_t HashTail(string inFileName, long long offset);
+};
+
+// Capture
+void Checkpoint::Capture(string inFileName, long long offset, string carry, uint64_t generation)
+{
+    struct stat info;
+    if (stat(inFileName.c_str(), &info) != 0)
+    {
+        throw IllegalArgumentException();
+    }
+    m_offset = offset;
+    m_carry = carry;
+    m_device = info.st_dev;
+    m_inode = info.st_ino;
+    m_tailHash = HashTail(inFileName, offset);
+    m_generation = generation;
+}
+
+// Matches
+bool Checkpoint::Matches(string inFileName) const
+{
+    struct stat info;
+    if (stat(inFileName.c_str(), &info) != 0)
+    {
+        return false;
+    }
+
+    // same file, not truncated, and the counted bytes were not rewritten
+    return (unsigned long long)info.st_dev == m_device
+        && (unsigned long long)info.st_ino == m_inode
+        && (long long)info.st_size >= m_offset
+        && HashTail(inFileName, m_offset) == m_tailHash;
+}
+
+// Load
+bool Checkpoint::Load(string inPath)
+{
+    ifstream ifs(inPath.c_str());
+    string magic;
+    Checkpoint loaded;
+    size_t carryLength = 0;
+
+    if (!(ifs >> magic >> loaded.m_offset >> loaded.m_device >> loaded.m_inode
+              >> loaded.m_tailHash >> loaded.m_generation >> carryLength) || magic != "WFCHECKPOINT2")
+    {
+        return false;
+    }
+
+    // carry is stored length prefixed after a single space, it has no whitespace
+    ifs.get();
+    loaded.m_carry.resize(carryLength);
+    if (carryLength > 0 && !ifs.read(&loaded.m_carry[0], carryLength))
+    {
+        return false;
+    }
+    *this = loaded;
+    return true;
+}
+
+// Save
+void Checkpoint::Save(string inPath) const
+{
+    string temporary = inPath + ".tmp";
+    {
+        ofstream ofs(temporary.c_str());
+        if (!ofs)
+        {
+            throw IllegalArgumentException();
+        }
+        ofs << "WFCHECKPOINT2 " << m_offset << " " << m_device << " " << m_inode << " "
+            << m_tailHash << " " << m_generation << " " << m_carry.length() << " " << m_carry << "\n";
+        ofs.close();
+        if (!ofs)
+        {
+            remove(temporary.c_str());
+            throw WriteFailedException();
+        }
+    }
+    if (rename(temporary.c_str(), inPath.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        throw WriteFailedException();
+    }
+}
+
+// New Generation
+uint64_t Checkpoint::NewGeneration()
+{
+    // the clock tells runs apart, the pid two runs in the same tick
+    uint64_t now = chrono::system_clock::now().time_since_epoch().count();
+    uint64_t generation = now ^ ((uint64_t)getpid() << 40);
+    return generation != 0 ? generation : 1;
+}
+
+// Hash Tail
+uint64_t Checkpoint::HashTail(string inFileName, long long offset)
+{
+    long long start = offset > CHECKPOINT_TAIL_BYTES ? offset - CHECKPOINT_TAIL_BYTES : 0;
+    string tail(offset - start, '\0');
+
+    ifstream ifs(inFileName.c_str(), ios::binary);
+    ifs.seekg(start);
+    if (tail.length() > 0 && !ifs.read(&tail[0], tail.length()))
+    {
+        return 0;
+    }
+
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < tail.length(); ++i)
+    {
+        hash ^= (unsigned char)tail[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+#endif //PROJ3_CHECKPOINT_H
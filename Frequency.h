@@ -0,0 +1,61 @@
+/*
+ * File:    Frequency.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Counter type for word frequencies, and overflow safe additions
+ *
+ * Frequency is 64 bits unless built with -DWF_COUNT_BITS=32 (make
+ * COUNT_BITS=32), for deployments where no word is seen 4 billion times and
+ * compact counts matter. Every translation unit must be built with the same
+ * setting. Counts are unsigned and never wrap around silently: CheckedAdd
+ * throws OverflowException in debug builds (no NDEBUG), SaturatingAdd sticks
+ * at the maximum.
+ */
+
+#ifndef PROJ3_FREQUENCY_H
+#define PROJ3_FREQUENCY_H
+
+#include <stdint.h>
+#include <limits>
+#include "dsexceptions.h"
+
+#ifndef WF_COUNT_BITS
+#define WF_COUNT_BITS 64
+#endif
+
+#if WF_COUNT_BITS == 32
+typedef uint32_t Frequency;
+#elif WF_COUNT_BITS == 64
+typedef uint64_t Frequency;
+#else
+#error "WF_COUNT_BITS must be 32 or 64"
+#endif
+
+/*
+ * count + added, checked for overflow in debug builds
+ */
+template <typename CountT>
+inline CountT CheckedAdd(CountT count, CountT added)
+{
+#ifndef NDEBUG
+    if (count > numeric_limits<CountT>::max() - added)
+    {
+        throw OverflowException();
+    }
+#endif
+    return count + added;
+}
+
+/*
+ * count + added, stuck at the maximum instead of wrapping around
+ */
+template <typename CountT>
+inline CountT SaturatingAdd(CountT count, CountT added)
+{
+    return count > numeric_limits<CountT>::max() - added ? numeric_limits<CountT>::max() : count + added;
+}
+
+#endif //PROJ3_FREQUENCY_H
@@ -0,0 +1,298 @@
+/*
+ * File:    FrozenBucket.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Read only, cache friendly copy of one HashedSplays bucket
+ *
+ * Words are kept sorted in one contiguous pool with their frequencies in a
+ * parallel array. Searches go through an Eytzinger (BFS order) layout of
+ * 16 byte slots: the first 8 bytes of the word, its length and its sorted
+ * rank. The children of slot k are 2k and 2k+1, so the four grandchildren
+ * of k share a cache line that is prefetched while k is compared, and the
+ * descent is branch free: k = 2k + (slot < key).
+ *
+ * Most comparisons are settled by the 8 byte prefix alone and never touch
+ * the pool.
+ */
+
+#ifndef PROJ3_FROZENBUCKET_H
+#define PROJ3_FROZENBUCKET_H
+
+#include <string>
+#include <vector>
+#include <cstring>
+#include <stdint.h>
+#include "SplayTree.h"
+#include "Node.h"
+
+class FrozenBucket {
+
+public:
+    /**********************************************************************
+     * Name: FrozenBucket (Constructor)
+     * PreCondition: None
+     *
+     * PostCondition: Empty bucket
+     *********************************************************************/
+    FrozenBucket() {}
+
+    /**********************************************************************
+     * Name: Build
+     * PreCondition: Tree to copy, not modified
+     *
+     * PostCondition: Bucket holds every word and frequency of the tree
+     *********************************************************************/
+    void Build(const SplayTree<Node>& tree);
+
+    /**********************************************************************
+     * Name: Find
+     * PreCondition: Word and its length
+     *
+     * PostCondition: Sorted rank of the word, or Size() if not found
+     *********************************************************************/
+    size_t Find(const char* word, size_t length) const;
+
+    /**********************************************************************
+     * Name: FindBatch
+     * PreCondition: count nodes whose words are looked up
+     *
+     * PostCondition: ranks[i] is Find of the i-th word. The descents run
+     *                eight at a time in lockstep, so their misses overlap
+     *********************************************************************/
+    void FindBatch(const Node* words, size_t count, size_t* ranks) const;
+
+    /**********************************************************************
+     * Name: LowerBound
+     * PreCondition: Word and its length
+     *
+     * PostCondition: Rank of the first word not less than the given one
+     *********************************************************************/
+    size_t LowerBound(const char* word, size_t length) const;
+
+    /**********************************************************************
+     * Name: PrefixRange
+     * PreCondition: Prefix (case sensitive) and its length
+     *
+     * PostCondition: first and last (exclusive) rank of the words that
+     *                start with the prefix
+     *********************************************************************/
+    void PrefixRange(const char* prefix, size_t length, size_t& first, size_t& last) const;
+
+    size_t Size() const { return m_frequencies.size(); }
+    Frequency GetFrequency(size_t rank) const { return m_frequencies[rank]; }
+    const char* GetWordData(size_t rank) const { return m_pool.data() + m_offsets[rank]; }
+    size_t GetWordLength(size_t rank) const { return m_offsets[rank + 1] - m_offsets[rank]; }
+    string GetWord(size_t rank) const { return string(GetWordData(rank), GetWordLength(rank)); }
+
+    /*
+     * Eytzinger slot, 16 bytes so four fit in a cache line
+     */
+    struct Slot
+    {
+        uint64_t prefix;     // first 8 bytes, big endian, zero padded
+        uint32_t length;
+        uint32_t rank;
+    };
+
+    /*
+     * Key prepared once per search, same encoding as the slots
+     */
+    struct Key
+    {
+        uint64_t prefix;
+        const char* word;
+        size_t length;
+    };
+
+    static Key MakeKey(const char* word, size_t length);
+
+    // slot k is less than the key, for callers running their own descent
+    bool SlotLess(size_t k, const Key& key) const;
+
+    const Slot* GetSlots() const { return m_slots.data(); }
+
+    // rank of the lower bound once a descent has run off the bottom at k
+    size_t RankAfterDescent(size_t k) const
+    {
+        k >>= __builtin_ffsll(~k);
+        return k == 0 ? Size() : m_slots[k].rank;
+    }
+
+private:
+    string m_pool;                  // every word, sorted, back to back
+    vector<uint32_t> m_offsets;     // start of each word in the pool, plus the end
+    vector<Frequency> m_frequencies;    // by sorted rank
+    vector<Slot> m_slots;           // Eytzinger order, slot 0 unused
+
+    void Fill(const vector<uint64_t>& prefixes);
+    static uint64_t Prefix(const char* word, size_t length);
+};
+
+// Build
+void FrozenBucket::Build(const SplayTree<Node>& tree)
+{
+    m_pool.clear();
+    m_offsets.clear();
+    m_frequencies.clear();
+
+    // in order traversal already yields the words sorted
+    tree.inOrder([&](const Node& node) {
+        m_offsets.push_back(m_pool.length());
+        m_pool += node.GetWord();
+        m_frequencies.push_back(node.GetFrequency());
+    });
+    m_offsets.push_back(m_pool.length());
+
+    vector<uint64_t> prefixes(Size());
+    for (size_t r = 0; r < Size(); ++r)
+    {
+        prefixes[r] = Prefix(GetWordData(r), GetWordLength(r));
+    }
+    m_slots.assign(Size() + 1, Slot());
+    Fill(prefixes);
+}
+
+// Fill, in order walk of the implicit tree hands out sorted ranks
+void FrozenBucket::Fill(const vector<uint64_t>& prefixes)
+{
+    size_t rank = 0;
+    size_t k = 1;
+    vector<size_t> stack;
+    while (k < m_slots.size() || !stack.empty())
+    {
+        while (k < m_slots.size())
+        {
+            stack.push_back(k);
+            k = 2 * k;
+        }
+        k = stack.back();
+        stack.pop_back();
+        m_slots[k].prefix = prefixes[rank];
+        m_slots[k].length = GetWordLength(rank);
+        m_slots[k].rank = rank;
+        rank++;
+        k = 2 * k + 1;
+    }
+}
+
+// Make Key
+FrozenBucket::Key FrozenBucket::MakeKey(const char* word, size_t length)
+{
+    Key key = { Prefix(word, length), word, length };
+    return key;
+}
+
+// Slot Less
+bool FrozenBucket::SlotLess(size_t k, const Key& key) const
+{
+    const Slot& slot = m_slots[k];
+    if (slot.prefix != key.prefix)
+    {
+        return slot.prefix < key.prefix;
+    }
+    // same first 8 bytes, only longer words need the pool
+    if (slot.length <= 8 || key.length <= 8)
+    {
+        return slot.length < key.length;
+    }
+    size_t common = min((size_t)slot.length, key.length) - 8;
+    int compared = memcmp(GetWordData(slot.rank) + 8, key.word + 8, common);
+    return compared < 0 || (compared == 0 && slot.length < key.length);
+}
+
+// Lower Bound
+size_t FrozenBucket::LowerBound(const char* word, size_t length) const
+{
+    Key key = MakeKey(word, length);
+    size_t n = Size();
+    size_t k = 1;
+    while (k <= n)
+    {
+        // grandchildren 4k..4k+3 share one cache line
+        __builtin_prefetch(m_slots.data() + 4 * k);
+        k = 2 * k + SlotLess(k, key);
+    }
+    return RankAfterDescent(k);
+}
+
+// Find
+size_t FrozenBucket::Find(const char* word, size_t length) const
+{
+    size_t rank = LowerBound(word, length);
+    if (rank < Size() && GetWordLength(rank) == length && memcmp(GetWordData(rank), word, length) == 0)
+    {
+        return rank;
+    }
+    return Size();
+}
+
+// Find Batch
+void FrozenBucket::FindBatch(const Node* words, size_t count, size_t* ranks) const
+{
+    const size_t lanes = 8;
+    size_t n = Size();
+    for (size_t first = 0; first < count; first += lanes)
+    {
+        size_t width = min(lanes, count - first);
+        Key keys[lanes];
+        size_t k[lanes];
+        for (size_t l = 0; l < width; ++l)
+        {
+            const string& word = words[first + l].GetWord();
+            keys[l] = MakeKey(word.data(), word.length());
+            k[l] = 1;
+        }
+
+        // every descent is the same depth give or take a level
+        bool moving = true;
+        while (moving)
+        {
+            moving = false;
+            for (size_t l = 0; l < width; ++l)
+            {
+                if (k[l] <= n)
+                {
+                    __builtin_prefetch(m_slots.data() + 4 * k[l]);
+                    k[l] = 2 * k[l] + SlotLess(k[l], keys[l]);
+                    moving = true;
+                }
+            }
+        }
+
+        for (size_t l = 0; l < width; ++l)
+        {
+            size_t rank = RankAfterDescent(k[l]);
+            const Key& key = keys[l];
+            bool match = rank < n && GetWordLength(rank) == key.length
+                         && memcmp(GetWordData(rank), key.word, key.length) == 0;
+            ranks[first + l] = match ? rank : n;
+        }
+    }
+}
+
+// Prefix Range
+void FrozenBucket::PrefixRange(const char* prefix, size_t length, size_t& first, size_t& last) const
+{
+    first = LowerBound(prefix, length);
+    last = first;
+    while (last < Size() && GetWordLength(last) >= length && memcmp(GetWordData(last), prefix, length) == 0)
+    {
+        last++;
+    }
+}
+
+// Prefix, first 8 bytes as a big endian number so < matches string order
+uint64_t FrozenBucket::Prefix(const char* word, size_t length)
+{
+    uint64_t prefix = 0;
+    for (size_t i = 0; i < 8; ++i)
+    {
+        prefix = (prefix << 8) | (i < length ? (unsigned char)word[i] : 0);
+    }
+    return prefix;
+}
+
+#endif //PROJ3_FROZENBUCKET_H
@@ -15,12 +15,49 @@
 #include <iostream>
 #include <string>
 #include <map>
+#include <unordered_map>
 #include <sstream>
+#include <algorithm>
+#include <cstdio>
 #include "SplayTree.h"
 #include "dsexceptions.h"
 #include "Node.h"
 #include "Util.h"
+#include "TokenFilter.h"
+#include "FrozenBucket.h"
+#include "BucketExecutor.h"
+#include "BucketTuner.h"
+#include "VocabularyGrowth.h"
+#include "SpillStore.h"
+#include "TraceRecorder.h"
+#include "NodeArena.h"
+#include <chrono>
 #define ALPHABET_SIZE 26
+static_assert(ALPHABET_SIZE == TableBuckets::Size, "one tree per letter of the bucket alphabet");
+
+// batches smaller than this are looked up one key at a time, grouping and
+// sorting them costs more than the overlapped misses save
+#define LOOKUP_BATCH_MIN 512
+
+// InsertBatch's mark for a malformed token, bucket indices are >= 0
+#define BATCH_MALFORMED -2
+
+// rejected tokens kept as examples for the report
+#define REJECT_SAMPLES 8
+
+// What PrepareWord made of a token, only TOKEN_COUNTED goes into a tree
+// TOKEN_EMPTY     --> nothing left after stripping, e.g. "--" or "1999"
+// TOKEN_FILTERED  --> dropped by the token filter
+// TOKEN_MALFORMED --> no letter left and not well formed, e.g. a lone control
+//                     byte or non-ASCII dash, counted as a reject
+enum TokenStatus { TOKEN_COUNTED, TOKEN_EMPTY, TOKEN_FILTERED, TOKEN_MALFORMED };
+
+// How words are keyed in the trees
+// KEY_EXACT   --> as written, "The" and "the" are two nodes
+// KEY_FOLDED  --> lowercased once on insert, one node per word
+// KEY_SURFACE --> folded, and the case variants are counted so the most
+//                 frequent way of writing the word is known
+enum KeyPolicy { KEY_EXACT, KEY_FOLDED, KEY_SURFACE };
 
 class HashedSplays {
 
@@ -35,9 +72,20 @@ public:
     HashedSplays(int size)
     {
         m_trees = size;
+        m_filter = NULL;
+        m_isFrozen = false;
+        m_executor = NULL;
+        m_rejectCount = 0;
+        m_keyPolicy = KEY_EXACT;
+        m_growth = NULL;
+        m_trace = NULL;
+        m_spill = NULL;
+        m_budget = 0;
+        m_memoryUsed = 0;
 
         // set table containing splay trees to size of alphabet given
         table.resize(m_trees);
+        m_surfaces.resize(m_trees);
     }
 
     /**********************************************************************
@@ -57,6 +105,135 @@ public:
      *********************************************************************/
     void FileReader(string inFileName);
 
+    /**********************************************************************
+     * Name: InsertWord
+     * PreCondition: Passed one raw whitespace separated token
+     *
+     * PostCondition: Token stripped and counted, ignored if nothing is left,
+     *                a malformed token goes to the reject bucket. Never
+     *                throws for bad input
+     *********************************************************************/
+    void InsertWord(const string& word);
+
+    /**********************************************************************
+     * Name: PrepareWord
+     * PreCondition: Passed one raw whitespace separated token
+     *
+     * PostCondition: The token's status. For TOKEN_COUNTED, the stripped
+     *                (and filtered) word and its bucket index, already
+     *                checked against the table size. Read only, safe to
+     *                call from any thread, never throws for bad input
+     *********************************************************************/
+    TokenStatus PrepareWord(const string& word, string& strippedWord, int& index) const;
+
+    /**********************************************************************
+     * Name: InsertPrepared
+     * PreCondition: Bucket index and word from PrepareWord, which has
+     *               validated the index, it is not checked again. Only touches
+     *               that bucket, so threads owning different buckets may
+     *               insert at the same time (on an already thawed table)
+     *
+     * PostCondition: Word counted in that bucket. Pass the word with
+     *                move() to have a new node take it over uncopied
+     *********************************************************************/
+    void InsertPrepared(int index, string strippedWord);
+
+    /**********************************************************************
+     * Name: Reject
+     * PreCondition: Raw token PrepareWord found malformed. Only one thread
+     *               may reject at a time
+     *
+     * PostCondition: Reject count up by one, token kept if fewer than
+     *                REJECT_SAMPLES are
+     *********************************************************************/
+    void Reject(const string& word);
+
+    /**********************************************************************
+     * Name: AddRejects
+     * PreCondition: Number of tokens rejected elsewhere, e.g. by a worker
+     *
+     * PostCondition: Reject count up by count
+     *********************************************************************/
+    void AddRejects(uint64_t count) { m_rejectCount += count; }
+
+    uint64_t GetRejectCount() const { return m_rejectCount; }
+    const vector<string>& GetRejectSamples() const { return m_rejectSamples; }
+
+    /**********************************************************************
+     * Name: PrintRejects
+     * PreCondition: None
+     *
+     * PostCondition: Reject count and the kept examples to cout, nothing
+     *                if no token was rejected
+     *********************************************************************/
+    void PrintRejects() const;
+
+    /**********************************************************************
+     * Name: InsertBatch
+     * PreCondition: Passed count raw whitespace separated tokens
+     *
+     * PostCondition: Same counts as InsertWord on every token. A batch
+     *                small next to the table is inserted token by token.
+     *                Otherwise repeats are counted in a hash map of the
+     *                tokens, then each bucket merges its sorted distinct
+     *                words in one pass
+     *********************************************************************/
+    void InsertBatch(const string* words, size_t count);
+    void InsertBatch(const vector<string>& words) { InsertBatch(words.data(), words.size()); }
+
+    /**********************************************************************
+     * Name: MergeCounts
+     * PreCondition: One vector of counted words per bucket, in any order,
+     *               repeats allowed. The vectors are sorted in place
+     *
+     * PostCondition: Every count added to the table, repeats combined
+     *********************************************************************/
+    void MergeCounts(vector<vector<Node> >& buckets);
+
+    /**********************************************************************
+     * Name: FileReaderBatched
+     * PreCondition: Passed value inFileName = input file, tokens per batch
+     *
+     * PostCondition: Same table as FileReader, inserted with InsertBatch
+     *********************************************************************/
+    void FileReaderBatched(string inFileName, size_t batchSize);
+
+    /**********************************************************************
+     * Name: FileReaderFrom
+     * PreCondition: Input file, byte offset to start at, and the partial
+     *               token left at that offset by the previous read
+     *
+     * PostCondition: Every complete token after the offset counted. Returns
+     *                the offset read up to, carry holds the trailing token
+     *                if the file does not end in whitespace (not counted)
+     *********************************************************************/
+    long long FileReaderFrom(string inFileName, long long offset, string& carry);
+
+    /**********************************************************************
+     * Name: SaveSnapshot
+     * PreCondition: Path for the snapshot, generation tying it to the
+     *               checkpoint saved with it
+     *
+     * PostCondition: Key policy, filter settings, generation, every word
+     *                and frequency, the written forms of KEY_SURFACE and
+     *                the rejects written, replacing any older snapshot
+     *                atomically. Throws WriteFailedException if the
+     *                snapshot could not be written or renamed
+     *********************************************************************/
+    void SaveSnapshot(string inPath, uint64_t generation) const;
+
+    /**********************************************************************
+     * Name: LoadSnapshot
+     * PreCondition: Path of a snapshot written by SaveSnapshot, generation
+     *               it was saved with
+     *
+     * PostCondition: Table holds the snapshot counts in addition to its
+     *                own. False if the snapshot is missing, damaged or cut
+     *                short, of another generation, or written under another
+     *                key policy or token filter
+     *********************************************************************/
+    bool LoadSnapshot(string inPath, uint64_t generation);
+
     /**********************************************************************
      * Name: PrintTree (given index)
      * PreCondition: Passed value index referring to index in HashedSplay table
@@ -91,10 +268,411 @@ public:
      *********************************************************************/
     void FindAll(string inPart);
 
+    /**********************************************************************
+     * Name: FindAllBatch
+     * PreCondition: Passed a list of word segments
+     *
+     * PostCondition: Same output as FindAll for every segment, in the
+     *                order given. Segments are grouped by bucket and the
+     *                buckets searched in parallel
+     *********************************************************************/
+    void FindAllBatch(const vector<string>& inParts);
+
+    /**********************************************************************
+     * Name: DumpTable
+     * PreCondition: Stream to write to
+     *
+     * PostCondition: Every node of every tree, in bucket and word order
+     *********************************************************************/
+    void DumpTable(ostream& out) const;
+
+    /**********************************************************************
+     * Name: GetFrequency
+     * PreCondition: Passed a word exactly as it was counted, in any case
+     *               unless the key policy is KEY_EXACT
+     *
+     * PostCondition: Frequency of the word, 0 if it was never seen.
+     *                Read only, the trees are not splayed.
+     *********************************************************************/
+    Frequency GetFrequency(string inWord) const;
+
+    /**********************************************************************
+     * Name: LookupBatch
+     * PreCondition: count words as GetFrequency takes them, room for count
+     *               frequencies
+     *
+     * PostCondition: counts[i] is GetFrequency(words[i]). Keys are grouped
+     *                by bucket, sorted and repeats looked up once, then
+     *                each bucket resolves them with interleaved searches.
+     *                Small batches are looked up one by one. Read only,
+     *                the trees are not splayed
+     *********************************************************************/
+    void LookupBatch(const string* words, size_t count, Frequency* counts) const;
+    void LookupBatch(const vector<string>& words, vector<Frequency>& counts) const
+    {
+        counts.resize(words.size());
+        LookupBatch(words.data(), words.size(), counts.data());
+    }
+
+    /**********************************************************************
+     * Name: LookupFrequency
+     * PreCondition: Passed a word exactly as it was counted, in any case
+     *               unless the key policy is KEY_EXACT
+     *
+     * PostCondition: Frequency of the word, 0 if it was never seen. The
+     *                bucket is splayed according to its splay policy.
+     *********************************************************************/
+    Frequency LookupFrequency(string inWord);
+
+    /**********************************************************************
+     * Name: SetSplayPolicy
+     * PreCondition: Policy, and the fraction of accesses that splay when
+     *               the policy is SPLAY_SOMETIMES
+     *
+     * PostCondition: Every tree in the table uses the policy
+     *********************************************************************/
+    void SetSplayPolicy(SplayPolicy policy, double fraction = 1.0);
+
+    /**********************************************************************
+     * Name: SetKeyPolicy
+     * PreCondition: Key policy, set before anything is counted
+     *
+     * PostCondition: Words are keyed by the policy from now on. Throws
+     *                IllegalArgumentException if the table is not empty
+     *********************************************************************/
+    void SetKeyPolicy(KeyPolicy policy);
+
+    KeyPolicy GetKeyPolicy() const { return m_keyPolicy; }
+
+    /**********************************************************************
+     * Name: KeyOf
+     * PreCondition: Stripped word
+     *
+     * PostCondition: The word as the trees order it, lowercased unless
+     *                the key policy is KEY_EXACT
+     *********************************************************************/
+    string KeyOf(const string& strippedWord) const;
+
+    /**********************************************************************
+     * Name: GetSurfaceForm
+     * PreCondition: Passed a word in any case, key policy KEY_SURFACE
+     *
+     * PostCondition: The way the word was most often written, ties to the
+     *                form that sorts first, empty if it was never seen.
+     *                Under the other policies, the key itself
+     *********************************************************************/
+    string GetSurfaceForm(string inWord) const;
+
+    /**********************************************************************
+     * Name: PrintSurfaceForms
+     * PreCondition: Number of words to show
+     *
+     * PostCondition: The k most frequent words and how they were most
+     *                often written to cout
+     *********************************************************************/
+    void PrintSurfaceForms(int k) const;
+
+    /**********************************************************************
+     * Name: SetFilter
+     * PreCondition: Filter that outlives the table, NULL for none
+     *
+     * PostCondition: Tokens are passed through the filter before insert
+     *********************************************************************/
+    void SetFilter(const TokenFilter* filter);
+
+    /**********************************************************************
+     * Name: Freeze
+     * PreCondition: Ingestion finished
+     *
+     * PostCondition: Every bucket copied into a cache friendly read only
+     *                FrozenBucket that the read only queries use from now
+     *                on. Counting again thaws the table.
+     *********************************************************************/
+    void Freeze();
+
+    /**********************************************************************
+     * Name: Thaw
+     * PreCondition: None
+     *
+     * PostCondition: Frozen copies dropped, queries use the trees again
+     *********************************************************************/
+    void Thaw();
+
+    bool IsFrozen() const { return m_isFrozen; }
+
+    /**********************************************************************
+     * Name: SetAdaptive
+     * PreCondition: True to let every bucket pick its own representation
+     *
+     * PostCondition: With adaptive on, each bucket samples its accesses
+     *                (LookupFrequency and inserts) and switches between
+     *                splaying, a static tree and a frozen copy as the skew
+     *                and the share of writes change, see BucketTuner.h.
+     *                Off, every tree splays again
+     *********************************************************************/
+    void SetAdaptive(bool adaptive);
+
+    bool IsAdaptive() const { return !m_tuners.empty(); }
+    BucketMode GetBucketMode(int index) const { return m_tuners.empty() ? BUCKET_SPLAY : m_tuners[index].GetMode(); }
+
+    /**********************************************************************
+     * Name: PrintTuning
+     * PreCondition: None
+     *
+     * PostCondition: Mode, measured skew and write share, switches and
+     *                sampled time per access of every bucket to cout,
+     *                nothing unless adaptive
+     *********************************************************************/
+    void PrintTuning() const;
+
+    /**********************************************************************
+     * Name: SetExecutor
+     * PreCondition: Executor that outlives the table, NULL for none
+     *
+     * PostCondition: Per bucket operations fan out over its threads
+     *********************************************************************/
+    void SetExecutor(BucketExecutor* executor);
+
+    /**********************************************************************
+     * Name: ForEachBucket
+     * PreCondition: Task taking a bucket index, touching only that bucket
+     *
+     * PostCondition: Task ran for every bucket, on the executor if set
+     *********************************************************************/
+    void ForEachBucket(const function<void(int)>& task) const;
+
+    /**********************************************************************
+     * Name: SetGrowthTracker
+     * PreCondition: Tracker that outlives the table, NULL for none
+     *
+     * PostCondition: Every token counted by InsertPrepared is reported to
+     *                it, new word or not. Merged counts (MergeCounts, the
+     *                pipeline and batch paths) are not tokens in reading
+     *                order and are not reported
+     *********************************************************************/
+    void SetGrowthTracker(VocabularyGrowth* growth) { m_growth = growth; }
+
+    /**********************************************************************
+     * Name: SetTraceRecorder
+     * PreCondition: Open recorder that outlives the table, NULL for none
+     *
+     * PostCondition: Every call to InsertWord, the lookups, the prefix
+     *                and top k searches and the prints is recorded, calls
+     *                they make themselves are not
+     *********************************************************************/
+    void SetTraceRecorder(TraceRecorder* trace) { m_trace = trace; }
+
+    /**********************************************************************
+     * Name: SetMemoryBudget
+     * PreCondition: Empty table, the bytes its nodes may take and an
+     *               existing directory for spilled runs. Inserts from one
+     *               thread only
+     *
+     * PostCondition: Once the words counted by InsertPrepared take more
+     *                than bytes, the largest buckets are written out as
+     *                sorted runs and emptied until half the budget is in
+     *                use. After a spill lookups and prints see only what
+     *                is still in memory, ForEachMerged and DumpMerged see
+     *                the whole table. Throws IllegalArgumentException if
+     *                the table is not empty or the directory is unusable
+     *********************************************************************/
+    void SetMemoryBudget(size_t bytes, const string& directory);
+
+    bool HasSpilled() const { return m_spill != NULL && m_spill->GetRunCount() > 0; }
+
+    /**********************************************************************
+     * Name: SetPageMode
+     * PreCondition: Empty table, page mode for its nodes
+     *
+     * PostCondition: Every bucket takes its nodes from its own NodeArena,
+     *                in 2 MB chunks of that page size, each placed on the
+     *                NUMA node of the thread that maps it. Throws
+     *                IllegalArgumentException if the table is not empty
+     *********************************************************************/
+    void SetPageMode(PageMode mode);
+
+    // arena of a bucket, NULL until SetPageMode
+    const NodeArena* GetArena(int index) const { return m_arenas.empty() ? NULL : m_arenas[index]; }
+
+    /**********************************************************************
+     * Name: PrintPageStats
+     * PreCondition: None
+     *
+     * PostCondition: Chunks mapped, how many are huge pages and on which
+     *                NUMA nodes, if SetPageMode was called
+     *********************************************************************/
+    void PrintPageStats() const;
+    size_t GetMemoryUsed() const { return m_memoryUsed; }
+    const SpillStore* GetSpillStore() const { return m_spill; }
+
+    /**********************************************************************
+     * Name: ForEachMerged
+     * PreCondition: Visitor
+     *
+     * PostCondition: visit called once per word of the whole table, in
+     *                bucket and word order, with its total frequency.
+     *                Spilled buckets are k-way merged from their runs and
+     *                what is in memory, holding one word per run
+     *********************************************************************/
+    void ForEachMerged(const function<void(const Node&)>& visit);
+
+    /**********************************************************************
+     * Name: DumpMerged
+     * PreCondition: Stream to write to
+     *
+     * PostCondition: What DumpTable would print had nothing been spilled
+     *********************************************************************/
+    void DumpMerged(ostream& out);
+
+    /**********************************************************************
+     * Name: PrintSpillStats
+     * PreCondition: None
+     *
+     * PostCondition: Budget, memory in use, runs and bytes spilled to
+     *                cout, nothing without a budget
+     *********************************************************************/
+    void PrintSpillStats() const;
+
+    /**********************************************************************
+     * Name: GetFrozenBucket
+     * PreCondition: Frozen table, index in the HashedSplay table
+     *
+     * PostCondition: Read only reference to the frozen copy of that bucket
+     *********************************************************************/
+    const FrozenBucket& GetFrozenBucket(int index) const;
+
+    /**********************************************************************
+     * Name: CollectPrefix
+     * PreCondition: Passed a segment of a word as inPart
+     *
+     * PostCondition: outNodes holds every node beginning with that
+     *                substring (ignoring case) in sorted order. Read only.
+     *********************************************************************/
+    void CollectPrefix(string inPart, vector<Node>& outNodes) const;
+
+    /**********************************************************************
+     * Name: CollectTopK
+     * PreCondition: Passed the number of nodes wanted
+     *
+     * PostCondition: outNodes holds the k most frequent nodes of the whole
+     *                table, most frequent first. Read only.
+     *********************************************************************/
+    void CollectTopK(int k, vector<Node>& outNodes) const;
+
+    /**********************************************************************
+     * Name: GetBucket
+     * PreCondition: Passed value index referring to index in HashedSplay table
+     *
+     * PostCondition: Read only reference to the tree at that index
+     *********************************************************************/
+    const SplayTree<Node>& GetBucket(int index) const;
+
     int m_trees;
 
 private:
     vector<SplayTree<Node>> table;
+    const TokenFilter* m_filter;
+    vector<FrozenBucket> m_frozen;
+    bool m_isFrozen;
+    BucketExecutor* m_executor;
+    uint64_t m_rejectCount;             // malformed tokens seen
+    vector<string> m_rejectSamples;     // the first REJECT_SAMPLES of them
+    KeyPolicy m_keyPolicy;
+    // per bucket, folded key -> its written forms other than the key
+    // itself, with their counts. Only filled under KEY_SURFACE
+    vector<unordered_map<string, vector<Node> > > m_surfaces;
+    vector<BucketTuner> m_tuners;       // one per bucket when adaptive
+    VocabularyGrowth* m_growth;         // vocabulary curve, NULL for none
+    TraceRecorder* m_trace;             // operation trace, NULL for none
+    SpillStore* m_spill;                // runs of spilled buckets, NULL without a budget
+    size_t m_budget;
+    size_t m_memoryUsed;                // estimated bytes of all nodes
+    vector<size_t> m_bucketBytes;       // the same per bucket
+    vector<NodeArena*> m_arenas;        // node memory per bucket, empty for new
+
+    // InsertBatch's scratch, kept between batches: raw token -> bucket and
+    // position of its word, or BATCH_MALFORMED, or -1 when it is filtered
+    struct TokenHash
+    {
+        size_t operator()(const string* token) const { return hash<string>()(*token); }
+    };
+    struct TokenEqual
+    {
+        bool operator()(const string* a, const string* b) const { return *a == *b; }
+    };
+    unordered_map<const string*, pair<int, size_t>, TokenHash, TokenEqual> m_batchTokens;
+    vector<vector<Node> > m_batchBuckets;
+
+    /**********************************************************************
+     * Name: SpillLargest
+     * PreCondition: Over the memory budget
+     *
+     * PostCondition: Largest buckets written to runs and emptied until
+     *                half the budget is in use
+     *********************************************************************/
+    void SpillLargest();
+
+    // heap bytes of a tree node holding the word, the string's own
+    // allocation included once it outgrows the small string buffer
+    static size_t NodeBytes(const string& word)
+    {
+        size_t bytes = sizeof(Node) + 2 * sizeof(void*) + 16;
+        return word.length() > 15 ? bytes + word.length() + 1 + 16 : bytes;
+    }
+
+    /**********************************************************************
+     * Name: Retune
+     * PreCondition: Adaptive, the bucket's tuner has a full window
+     *
+     * PostCondition: Bucket switched to the mode its tuner decided on
+     *********************************************************************/
+    void Retune(int index);
+
+    /**********************************************************************
+     * Name: ApplyMode
+     * PreCondition: Adaptive, bucket and the mode to put it in
+     *
+     * PostCondition: Frozen copy built or dropped, splay policy set
+     *********************************************************************/
+    void ApplyMode(int index, BucketMode mode);
+
+    /**********************************************************************
+     * Name: ThawBucket
+     * PreCondition: Bucket about to be written
+     *
+     * PostCondition: If adaptive froze it, back to its tree mode
+     *********************************************************************/
+    void ThawBucket(int index)
+    {
+        if (!m_tuners.empty() && m_tuners[index].GetMode() == BUCKET_FROZEN)
+        {
+            ApplyMode(index, m_tuners[index].Thaw());
+        }
+    }
+
+    // frozen copy reads of a bucket use, NULL for the tree
+    const FrozenBucket* FrozenFor(int index) const
+    {
+        if (m_isFrozen)
+        {
+            return &m_frozen[index];
+        }
+        if (!m_tuners.empty() && m_tuners[index].GetMode() == BUCKET_FROZEN)
+        {
+            return &m_tuners[index].GetFrozen();
+        }
+        return NULL;
+    }
+
+    /**********************************************************************
+     * Name: CountSurface
+     * PreCondition: Bucket, folded key, the form it was written in (not
+     *               the key itself) and how many times
+     *
+     * PostCondition: Count of that form of the key up by count. Touches
+     *                only that bucket
+     *********************************************************************/
+    void CountSurface(int index, const string& key, const string& surface, Frequency count);
 
     /**********************************************************************
      * Name: Node (Constructor)
@@ -103,7 +681,11 @@ private:
      *
      * PostCondition:  Empty node object.
      *********************************************************************/
-    int GetIndex(string inLetter);
+    int GetIndex(string inLetter) const;
+
+    // owns the spill store and arenas, a copy would free them twice
+    HashedSplays(const HashedSplays&);
+    HashedSplays& operator=(const HashedSplays&);
 };
 
 // Destructor
@@ -117,17 +699,20 @@ HashedSplays::~HashedSplays()
 
     // built in vector function clear will empty the vector object
     table.clear();
+    delete m_spill;
+
+    // after the trees, their spare nodes are in the arenas too
+    for (size_t i = 0; i < m_arenas.size(); ++i)
+    {
+        delete m_arenas[i];
+    }
 }
 
 // File Reader
 void HashedSplays::FileReader(string inFileName)
 {
 
-    // open fstream with input file and define word and firstLetter, variable declarations
-    string lowerWord;
-    string strippedWord;
-    char firstLetter;
-    int index = 0;
+    // open fstream with input file, variable declarations
     fstream ifs;
     string word;
 
@@ -143,75 +728,640 @@ void HashedSplays::FileReader(string inFileName)
         // iterate through file as long as word can still be parsed from fstream
         while (ifs >> word)
         {
-            // use util strip to remove punctuation and numbers
-            strippedWord = Util::Strip(word);
-
-            // check that strip didnt leave the string empty, empty string meant word was not alphabet data
-            if (strippedWord.length() == 0)
-            {
-                continue;
-            }
-
-            // set word to lowercase for easier math operation
-            lowerWord = Util::Lower(strippedWord);
-
-            // variable holding firstLetter in word, determine position in vector
-            firstLetter = lowerWord.at(0);
-
-            // index equals ascii value - 97, 'a' = 97, 'a' - 97 = 0
-            index = int(firstLetter) - 97;
-
-            // declare new node to hold word to check equality
-            // Node* wordNode = new Node(lowerWord, 1);
-            Node wordNode(strippedWord, 1);
-
-            // check that the table at pos=index contains the word found
-            if (table.at(index).contains(wordNode))
-            {
-                // increment frequency of word, word already in tree
-                table.at(index).getRootElement().IncrementFrequency();
-            }
-            else
-            {
-                // if the node isnt found, insert it and increment splay counter and nodeCounter
-                table.at(index).insert(wordNode);
-            }
+            InsertWord(word);
         }
     }
     ifs.close();
 }
 
-// Print Hash Count Results
-void HashedSplays::PrintHashCountResults()
+// Insert Word
+void HashedSplays::InsertWord(const string& word)
 {
-    cout << "***************PRINT HASH COUNT RESULTS********************" << endl;
-    for (int i = 0; i < m_trees; ++i)
+    TraceScope trace(m_trace, TRACE_INSERT, &word);
+    string strippedWord;
+    int index;
+    TokenStatus status = PrepareWord(word, strippedWord, index);
+    if (status == TOKEN_COUNTED)
     {
-        // error check for empty tree, return special message
-        if (table.at(i).isEmpty())
-        {
-            cout << "The tree at position " << i << " has no elements" << endl;
-        }
-        // tree has values, cout << TYPE=Node will format print statement properly
-        else {
-            cout << "The tree at position " << i << " starts with ";
-            cout << table.at(i).getRootElement();
-            cout << " and has " << table.at(i).GetNodeCounter() << " nodes" << endl;
-        }
+        InsertPrepared(index, move(strippedWord));
+    }
+    else if (status == TOKEN_MALFORMED)
+    {
+        Reject(word);
     }
-    cout << endl << endl;
 }
 
-// Print Tree given Index
-void HashedSplays::PrintTree(int index)
+// Prepare Word
+TokenStatus HashedSplays::PrepareWord(const string& word, string& strippedWord, int& index) const
 {
-    cout << "**********PRINT TREE GIVEN INDEX************" << endl;
-    // index greater than number of spaces in the array, terminate program
-    if (index > m_trees)
+    // use util strip to remove punctuation, numbers and non ASCII bytes,
+    // in the caller's buffer so a reused strippedWord does not allocate
+    strippedWord.assign(word);
+    Util::StripInPlace(strippedWord);
+
+    // check that strip didnt leave the string empty, empty string meant word
+    // was not alphabet data. Nothing but non ASCII or control bytes is a
+    // reject, the one validation of the token: nothing after this throws
+    if (strippedWord.length() == 0)
     {
-        throw ArrayIndexOutOfBoundsException();
+        return Util::IsWellFormed(word) ? TOKEN_EMPTY : TOKEN_MALFORMED;
     }
-    else
+
+    // stopwords and length limits are dropped before they cost an insert,
+    // the lowercase copy is only made for the filter
+    if (m_filter != NULL)
+    {
+        string lowerWord = Util::Lower(strippedWord);
+        if (!m_filter->Apply(strippedWord, lowerWord))
+        {
+            return TOKEN_FILTERED;
+        }
+    }
+
+    // bucket of the first letter from the compile time table, -1 for none
+    index = TableBuckets::Index(strippedWord[0]);
+    if (index < 0 || index >= m_trees)
+    {
+        return TOKEN_MALFORMED;
+    }
+    return TOKEN_COUNTED;
+}
+
+// Insert Prepared
+void HashedSplays::InsertPrepared(int index, string strippedWord)
+{
+    // frozen copies would go stale
+    if (m_isFrozen)
+    {
+        Thaw();
+    }
+
+    // adaptive buckets count the write, and time one in TUNER_SAMPLE
+    bool sampled = false;
+    chrono::steady_clock::time_point start;
+    if (!m_tuners.empty())
+    {
+        ThawBucket(index);
+        sampled = m_tuners[index].Tick(true);
+        if (sampled)
+        {
+            start = chrono::steady_clock::now();
+        }
+    }
+
+    // folded once here, comparisons in the tree never lowercase
+    if (m_keyPolicy != KEY_EXACT)
+    {
+        string key = Util::Lower(strippedWord);
+        if (m_keyPolicy == KEY_SURFACE && key != strippedWord)
+        {
+            CountSurface(index, key, strippedWord, 1);
+        }
+        strippedWord = move(key);
+    }
+
+    // declare new node to hold word to check equality
+    // Node* wordNode = new Node(lowerWord, 1);
+    Node wordNode(move(strippedWord), 1);
+    string sampledKey;
+    if (sampled)
+    {
+        sampledKey = wordNode.GetWord();
+    }
+
+    // check that the table at pos=index contains the word found,
+    // access splays it to the root unless the splay policy says not to
+    Node* found = table[index].access(wordNode);
+    if (found != NULL)
+    {
+        // increment frequency of word, word already in tree
+        found->IncrementFrequency();
+    }
+    else
+    {
+        // if the node isnt found, insert it and increment splay counter and nodeCounter,
+        // the node's word moves into the tree without a copy
+        size_t bytes = m_spill != NULL ? NodeBytes(wordNode.GetWord()) : 0;
+        table[index].insert(move(wordNode));
+        if (m_spill != NULL)
+        {
+            m_bucketBytes[index] += bytes;
+            m_memoryUsed += bytes;
+        }
+    }
+    if (m_growth != NULL)
+    {
+        m_growth->Observe(found == NULL);
+    }
+
+    if (sampled)
+    {
+        m_tuners[index].Sample(sampledKey, chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+    }
+    if (!m_tuners.empty() && m_tuners[index].WindowFull())
+    {
+        Retune(index);
+    }
+    if (m_spill != NULL && m_memoryUsed > m_budget)
+    {
+        SpillLargest();
+    }
+}
+
+// Reject
+void HashedSplays::Reject(const string& word)
+{
+    m_rejectCount++;
+    if (m_rejectSamples.size() < REJECT_SAMPLES)
+    {
+        m_rejectSamples.push_back(word);
+    }
+}
+
+// Print Rejects
+void HashedSplays::PrintRejects() const
+{
+    if (m_rejectCount == 0)
+    {
+        return;
+    }
+    cout << "Rejected " << m_rejectCount << " malformed tokens";
+    if (!m_rejectSamples.empty())
+    {
+        cout << ", first ones (escaped):";
+    }
+    for (size_t i = 0; i < m_rejectSamples.size(); ++i)
+    {
+        cout << " ";
+        for (size_t c = 0; c < m_rejectSamples[i].length(); ++c)
+        {
+            unsigned char byte = m_rejectSamples[i][c];
+            if (byte < 32 || byte > 126 || byte == '\\')
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\x%02x", byte);
+                cout << escaped;
+            }
+            else
+            {
+                cout << byte;
+            }
+        }
+    }
+    cout << endl;
+}
+
+// Insert Batch
+void HashedSplays::InsertBatch(const string* words, size_t count)
+{
+    string strippedWord;
+    int index;
+
+    // a batch small next to the table would be merged item by item in
+    // sorted order, which costs the splay trees the locality of the token
+    // order and saves nothing, so its tokens go in one at a time
+    uint64_t nodes = 0;
+    for (int i = 0; i < m_trees; ++i)
+    {
+        nodes += table[i].GetNodeCounter();
+    }
+    uint64_t logNodes = 1;
+    while (((uint64_t)1 << logNodes) <= nodes)
+    {
+        logNodes++;
+    }
+    if (count * logNodes < nodes)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            TokenStatus status = PrepareWord(words[i], strippedWord, index);
+            if (status == TOKEN_COUNTED)
+            {
+                InsertPrepared(index, move(strippedWord));
+            }
+            else if (status == TOKEN_MALFORMED)
+            {
+                Reject(words[i]);
+            }
+        }
+        return;
+    }
+
+    // repeats of a raw token are found by the token itself, so nothing is
+    // copied and each distinct token is prepared once. The map and the
+    // bucket vectors keep their memory from batch to batch, and are
+    // emptied first in case the last batch threw
+    m_batchBuckets.resize(m_trees);
+    for (int i = 0; i < m_trees; ++i)
+    {
+        m_batchBuckets[i].clear();
+    }
+    m_batchTokens.clear();
+    bool counted = false;
+    for (size_t i = 0; i < count; ++i)
+    {
+        pair<unordered_map<const string*, pair<int, size_t>, TokenHash, TokenEqual>::iterator, bool> seen =
+            m_batchTokens.insert(make_pair(&words[i], make_pair(-1, (size_t)0)));
+        pair<int, size_t>& slot = seen.first->second;
+        if (seen.second)
+        {
+            TokenStatus status = PrepareWord(words[i], strippedWord, index);
+            if (status == TOKEN_COUNTED)
+            {
+                slot.first = index;
+                slot.second = m_batchBuckets[index].size();
+                m_batchBuckets[index].push_back(Node(move(strippedWord), 1));
+                counted = true;
+            }
+            else if (status == TOKEN_MALFORMED)
+            {
+                slot.first = BATCH_MALFORMED;
+                Reject(words[i]);
+            }
+        }
+        else if (slot.first >= 0)
+        {
+            m_batchBuckets[slot.first][slot.second].IncrementFrequency();
+        }
+        else if (slot.first == BATCH_MALFORMED)
+        {
+            Reject(words[i]);
+        }
+    }
+    m_batchTokens.clear();
+    if (counted)
+    {
+        MergeCounts(m_batchBuckets);
+    }
+}
+
+// Merge Counts
+void HashedSplays::MergeCounts(vector<vector<Node> >& buckets)
+{
+    if ((int)buckets.size() != m_trees)
+    {
+        throw IllegalArgumentException();
+    }
+    if (m_isFrozen)
+    {
+        Thaw();
+    }
+
+    // buckets are independent, each sorts, combines and merges its own words
+    ForEachBucket([&](int i) {
+        vector<Node>& bucket = buckets[i];
+        if (bucket.empty())
+        {
+            return;
+        }
+        ThawBucket(i);
+        if (m_keyPolicy != KEY_EXACT)
+        {
+            for (size_t j = 0; j < bucket.size(); ++j)
+            {
+                string key = Util::Lower(bucket[j].GetWord());
+                if (key != bucket[j].GetWord())
+                {
+                    if (m_keyPolicy == KEY_SURFACE)
+                    {
+                        CountSurface(i, key, bucket[j].GetWord(), bucket[j].GetFrequency());
+                    }
+                    bucket[j] = Node(move(key), bucket[j].GetFrequency());
+                }
+            }
+        }
+        sort(bucket.begin(), bucket.end());
+        size_t distinct = 0;
+        for (size_t j = 1; j < bucket.size(); ++j)
+        {
+            if (bucket[distinct] < bucket[j])
+            {
+                bucket[++distinct] = move(bucket[j]);
+            }
+            else
+            {
+                bucket[distinct].AddFrequency(bucket[j].GetFrequency());
+            }
+        }
+        bucket.resize(distinct + 1);
+        table[i].insertSorted(bucket, [](Node& existing, const Node& added) {
+            existing.AddFrequency(added.GetFrequency());
+        });
+    });
+}
+
+// File Reader Batched
+void HashedSplays::FileReaderBatched(string inFileName, size_t batchSize)
+{
+    ifstream ifs(inFileName.c_str());
+    if (!ifs || batchSize == 0)
+    {
+        throw IllegalArgumentException();
+    }
+
+    // token strings are reused from batch to batch
+    vector<string> batch(batchSize);
+    size_t filled = 0;
+    while (ifs >> batch[filled])
+    {
+        if (++filled == batchSize)
+        {
+            InsertBatch(batch.data(), filled);
+            filled = 0;
+        }
+    }
+    InsertBatch(batch.data(), filled);
+}
+
+// File Reader From
+long long HashedSplays::FileReaderFrom(string inFileName, long long offset, string& carry)
+{
+    ifstream ifs(inFileName.c_str(), ios::binary);
+    if (!ifs)
+    {
+        throw IllegalArgumentException();
+    }
+    ifs.seekg(offset);
+
+    // same token boundaries as ifs >> word, the carry continues the first token
+    string word = carry;
+    char buffer[65536];
+    while (ifs.read(buffer, sizeof(buffer)) || ifs.gcount() > 0)
+    {
+        streamsize got = ifs.gcount();
+        for (streamsize i = 0; i < got; ++i)
+        {
+            if (isspace((unsigned char)buffer[i]))
+            {
+                if (word.length() > 0)
+                {
+                    InsertWord(word);
+                    word.clear();
+                }
+            }
+            else
+            {
+                word += buffer[i];
+            }
+        }
+        offset += got;
+    }
+
+    // may still grow on the next append, so it is left for the next read
+    carry = word;
+    return offset;
+}
+
+// Save Snapshot
+void HashedSplays::SaveSnapshot(string inPath, uint64_t generation) const
+{
+    string temporary = inPath + ".tmp";
+    {
+        ofstream ofs(temporary.c_str());
+        if (!ofs)
+        {
+            throw IllegalArgumentException();
+        }
+        uint64_t filter = m_filter != NULL ? m_filter->Signature() : TokenFilter().Signature();
+        ofs << "WFSNAPSHOT4 " << m_trees << " " << (int)m_keyPolicy << " " << filter << " "
+            << generation << "\n";
+
+        // buckets are formatted in parallel and written in order: N lines
+        // are nodes, F lines the written forms KEY_SURFACE keeps of a key
+        vector<string> chunks(m_trees);
+        vector<size_t> lines(m_trees, 0);
+        ForEachBucket([&](int i) {
+            ostringstream chunk;
+            table[i].inOrder([&](const Node& node) {
+                chunk << "N " << i << " " << node.GetWord() << " " << node.GetFrequency() << "\n";
+                ++lines[i];
+            });
+            for (unordered_map<string, vector<Node> >::const_iterator it = m_surfaces[i].begin();
+                 it != m_surfaces[i].end(); ++it)
+            {
+                for (size_t f = 0; f < it->second.size(); ++f)
+                {
+                    chunk << "F " << i << " " << it->first << " " << it->second[f].GetWord() << " "
+                          << it->second[f].GetFrequency() << "\n";
+                    ++lines[i];
+                }
+            }
+            chunks[i] = chunk.str();
+        });
+        size_t records = 0;
+        for (int i = 0; i < m_trees; ++i)
+        {
+            ofs << chunks[i];
+            records += lines[i];
+        }
+        // rejects, then the kept examples length prefixed, they may hold
+        // any byte
+        ofs << "R " << m_rejectCount << "\n";
+        for (size_t r = 0; r < m_rejectSamples.size(); ++r)
+        {
+            ofs << "S " << m_rejectSamples[r].length() << " " << m_rejectSamples[r] << "\n";
+        }
+        records += 1 + m_rejectSamples.size();
+
+        // trailer, a snapshot cut at a line boundary is missing it
+        ofs << "E " << records << "\n";
+        ofs.close();
+        if (!ofs)
+        {
+            remove(temporary.c_str());
+            throw WriteFailedException();
+        }
+    }
+    if (rename(temporary.c_str(), inPath.c_str()) != 0)
+    {
+        remove(temporary.c_str());
+        throw WriteFailedException();
+    }
+}
+
+// Load Snapshot
+bool HashedSplays::LoadSnapshot(string inPath, uint64_t generation)
+{
+    ifstream ifs(inPath.c_str());
+    string magic;
+    int trees = 0;
+    int keyPolicy = 0;
+    uint64_t filter = 0;
+    uint64_t saved = 0;
+
+    // keys of another policy or words of another filter would split or
+    // merge counts of this one
+    uint64_t expected = m_filter != NULL ? m_filter->Signature() : TokenFilter().Signature();
+    if (!(ifs >> magic >> trees >> keyPolicy >> filter >> saved) || magic != "WFSNAPSHOT4"
+        || trees != m_trees || keyPolicy != (int)m_keyPolicy || filter != expected || saved != generation)
+    {
+        return false;
+    }
+
+    // read everything first so a damaged snapshot leaves the table alone
+    vector<vector<Node> > buckets(m_trees);
+    vector<pair<int, pair<string, Node> > > forms;
+    uint64_t rejects = 0;
+    vector<string> samples;
+    size_t length;
+    string tag;
+    int index;
+    string word;
+    string form;
+    Frequency frequency;
+    size_t records = 0;
+    bool ended = false;
+    while (!ended && ifs >> tag)
+    {
+        if (tag == "E")
+        {
+            size_t written = 0;
+            if (!(ifs >> written) || written != records)
+            {
+                return false;
+            }
+            ended = true;
+            continue;
+        }
+        ++records;
+        if (tag == "R")
+        {
+            if (!(ifs >> rejects))
+            {
+                return false;
+            }
+            continue;
+        }
+        if (tag == "S")
+        {
+            if (!(ifs >> length) || length > (1u << 20) || ifs.get() != ' ')
+            {
+                return false;
+            }
+            samples.push_back(string(length, '\0'));
+            if (length > 0 && !ifs.read(&samples.back()[0], length))
+            {
+                return false;
+            }
+            continue;
+        }
+        if (!(ifs >> index) || index < 0 || index >= m_trees || !(ifs >> word)
+            || (tag == "F" && !(ifs >> form)) || !(ifs >> frequency))
+        {
+            return false;
+        }
+        if (tag == "N")
+        {
+            buckets[index].emplace_back(word, frequency);
+        }
+        else if (tag == "F")
+        {
+            forms.push_back(make_pair(index, make_pair(word, Node(form, frequency))));
+        }
+        else
+        {
+            return false;
+        }
+    }
+    // nothing may follow the trailer
+    if (!ended || ifs >> tag || !ifs.eof())
+    {
+        return false;
+    }
+    Thaw();
+
+    // written forms and rejects, so a resumed run reports like a recount
+    for (size_t f = 0; f < forms.size(); ++f)
+    {
+        CountSurface(forms[f].first, forms[f].second.first, forms[f].second.second.GetWord(),
+                     forms[f].second.second.GetFrequency());
+    }
+    m_rejectCount += rejects;
+    m_rejectSamples.insert(m_rejectSamples.begin(), samples.begin(), samples.end());
+    if (m_rejectSamples.size() > REJECT_SAMPLES)
+    {
+        m_rejectSamples.resize(REJECT_SAMPLES);
+    }
+
+    for (int i = 0; i < m_trees; ++i)
+    {
+        // insert medians first so the tree comes out balanced whatever the
+        // splay policy, sorted insertion would build a list
+        vector<pair<int, int> > ranges;
+        if (!buckets[i].empty())
+        {
+            ranges.push_back(make_pair(0, (int)buckets[i].size()));
+        }
+        while (!ranges.empty())
+        {
+            pair<int, int> range = ranges.back();
+            ranges.pop_back();
+            int middle = range.first + (range.second - range.first) / 2;
+
+            Node* found = table[i].access(buckets[i][middle]);
+            if (found != NULL)
+            {
+                found->AddFrequency(buckets[i][middle].GetFrequency());
+            }
+            else
+            {
+                table[i].insert(buckets[i][middle]);
+            }
+
+            if (range.first < middle)
+            {
+                ranges.push_back(make_pair(range.first, middle));
+            }
+            if (middle + 1 < range.second)
+            {
+                ranges.push_back(make_pair(middle + 1, range.second));
+            }
+        }
+    }
+    return true;
+}
+
+// Print Hash Count Results
+void HashedSplays::PrintHashCountResults()
+{
+    TraceScope trace(m_trace, TRACE_PRINT_COUNTS);
+    cout << "***************PRINT HASH COUNT RESULTS********************" << endl;
+
+    // format every bucket's line in parallel, print them in order
+    vector<string> lines(m_trees);
+    ForEachBucket([&](int i) {
+        ostringstream line;
+        // error check for empty tree, return special message
+        if (table[i].isEmpty())
+        {
+            line << "The tree at position " << i << " has no elements" << endl;
+        }
+        // tree has values, << TYPE=Node will format print statement properly
+        else {
+            line << "The tree at position " << i << " starts with ";
+            line << table[i].getRootElement();
+            line << " and has " << table[i].GetNodeCounter() << " nodes" << endl;
+        }
+        lines[i] = line.str();
+    });
+    for (int i = 0; i < m_trees; ++i)
+    {
+        cout << lines[i];
+    }
+    cout << endl << endl;
+}
+
+// Print Tree given Index
+void HashedSplays::PrintTree(int index)
+{
+    TraceScope trace(m_trace, TRACE_PRINT_TREE, NULL, 0, (uint64_t)index);
+    cout << "**********PRINT TREE GIVEN INDEX************" << endl;
+    // index greater than number of spaces in the array, terminate program
+    if (index > m_trees)
+    {
+        throw ArrayIndexOutOfBoundsException();
+    }
+    else
     {
         // call printTree function from SplayTree.h, cout << Node will format the output
         table.at(index).printTree();
@@ -223,6 +1373,7 @@ void HashedSplays::PrintTree(int index)
 // Print tree given letter
 void HashedSplays::PrintTree(string letter)
 {
+    TraceScope trace(m_trace, TRACE_PRINT_LETTER, &letter);
     cout << "*************PRINT TREE GIVEN LETTER***************" << endl;
     // passed non single letter string
     if (letter.length() > 1)
@@ -250,9 +1401,10 @@ void HashedSplays::PrintTree(string letter)
 // Find All
 void HashedSplays::FindAll(string inPart)
 {
+    TraceScope trace(m_trace, TRACE_FIND_ALL, &inPart);
     cout << "************FIND ALL*************" << endl;
     // index given from the first letter of inPart
-    int index = GetIndex(inPart.substr(0, 1));
+    int index = TableBuckets::Index(inPart[0]);
 
     // cast string to Node object for comparison
     Node keyNode(inPart, 1);
@@ -262,6 +1414,21 @@ void HashedSplays::FindAll(string inPart)
     {
         throw ArrayIndexOutOfBoundsException();
     }
+    else if (m_keyPolicy != KEY_EXACT)
+    {
+        // a range search, no node is compared case insensitively
+        cout << "Printing Nodes beginning with substring \'" << inPart << "\'" << endl;
+        vector<Node> found;
+        CollectPrefix(inPart, found);
+        if (table.at(index).isEmpty())
+        {
+            cout << "Tree contains no Nodes" << endl;
+        }
+        for (size_t n = 0; n < found.size(); ++n)
+        {
+            cout << found[n] << endl;
+        }
+    }
     else
     {
         // call PrintSubstringNodes, outputs Node objects formatted with string and frequency
@@ -270,8 +1437,750 @@ void HashedSplays::FindAll(string inPart)
     }
 }
 
+// Find All Batch
+void HashedSplays::FindAllBatch(const vector<string>& inParts)
+{
+    TraceScope trace(m_trace, TRACE_FIND_ALL_BATCH, inParts.data(), inParts.size());
+    // group the segments by bucket, all indices checked before any work
+    vector<vector<size_t> > groups(m_trees);
+    for (size_t p = 0; p < inParts.size(); ++p)
+    {
+        int index = GetIndex(inParts[p].substr(0, 1));
+        if (index < 0 || index >= m_trees)
+        {
+            throw ArrayIndexOutOfBoundsException();
+        }
+        groups[index].push_back(p);
+    }
+
+    vector<vector<Node> > results(inParts.size());
+    ForEachBucket([&](int i) {
+        for (size_t g = 0; g < groups[i].size(); ++g)
+        {
+            CollectPrefix(inParts[groups[i][g]], results[groups[i][g]]);
+        }
+    });
+
+    // same output as calling FindAll on each segment in turn
+    for (size_t p = 0; p < inParts.size(); ++p)
+    {
+        cout << "************FIND ALL*************" << endl;
+        cout << "Printing Nodes beginning with substring \'" << inParts[p] << "\'" << endl;
+        if (table[GetIndex(inParts[p].substr(0, 1))].isEmpty())
+        {
+            cout << "Tree contains no Nodes" << endl;
+        }
+        for (size_t n = 0; n < results[p].size(); ++n)
+        {
+            cout << results[p][n] << endl;
+        }
+    }
+}
+
+// Dump Table
+void HashedSplays::DumpTable(ostream& out) const
+{
+    TraceScope trace(m_trace, TRACE_DUMP);
+    vector<string> chunks(m_trees);
+    ForEachBucket([&](int i) {
+        ostringstream chunk;
+        table[i].inOrder([&](const Node& node) {
+            chunk << node << endl;
+        });
+        chunks[i] = chunk.str();
+    });
+    for (int i = 0; i < m_trees; ++i)
+    {
+        out << chunks[i];
+    }
+}
+
+// Get Frequency
+Frequency HashedSplays::GetFrequency(string inWord) const
+{
+    TraceScope trace(m_trace, TRACE_FREQUENCY, &inWord);
+    // words that could never have been counted have no bucket
+    if (inWord.length() == 0)
+    {
+        return 0;
+    }
+    int index = TableBuckets::Index(inWord[0]);
+    if (index < 0 || index >= m_trees)
+    {
+        return 0;
+    }
+    inWord = KeyOf(inWord);
+
+    const FrozenBucket* frozen = FrozenFor(index);
+    if (frozen != NULL)
+    {
+        size_t rank = frozen->Find(inWord.data(), inWord.length());
+        return rank == frozen->Size() ? 0 : frozen->GetFrequency(rank);
+    }
+
+    // find does not splay, safe for many readers at once
+    const Node* found = table[index].find(Node(inWord, 1));
+    return found == NULL ? 0 : found->GetFrequency();
+}
+
+// Lookup Batch
+void HashedSplays::LookupBatch(const string* words, size_t count, Frequency* counts) const
+{
+    TraceScope trace(m_trace, TRACE_LOOKUP_BATCH, words, count);
+    if (count < LOOKUP_BATCH_MIN)
+    {
+        for (size_t i = 0; i < count; ++i)
+        {
+            counts[i] = GetFrequency(words[i]);
+        }
+        return;
+    }
+
+    // keys are the words themselves unless they have to be folded
+    vector<string> folded;
+    if (m_keyPolicy != KEY_EXACT)
+    {
+        folded.resize(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            folded[i] = KeyOf(words[i]);
+        }
+    }
+    const string* keys = m_keyPolicy == KEY_EXACT ? words : folded.data();
+
+    // positions grouped by bucket with the first 8 bytes of the key as a
+    // number, so most sort comparisons never touch the strings
+    vector<vector<pair<uint64_t, size_t> > > buckets(m_trees);
+    for (size_t i = 0; i < count; ++i)
+    {
+        counts[i] = 0;
+        if (keys[i].length() == 0)
+        {
+            continue;
+        }
+        int index = TableBuckets::Index(keys[i][0]);
+        if (index >= 0 && index < m_trees)
+        {
+            uint64_t prefix = 0;
+            for (size_t c = 0; c < 8; ++c)
+            {
+                prefix = (prefix << 8) | (c < keys[i].length() ? (unsigned char)keys[i][c] : 0);
+            }
+            buckets[index].push_back(make_pair(prefix, i));
+        }
+    }
+
+    ForEachBucket([&](int b) {
+        vector<pair<uint64_t, size_t> >& order = buckets[b];
+        if (order.empty())
+        {
+            return;
+        }
+
+        // sorted, so repeats are looked up once and neighbouring searches
+        // share the top of their paths
+        sort(order.begin(), order.end(), [&](const pair<uint64_t, size_t>& lhs, const pair<uint64_t, size_t>& rhs) {
+            if (lhs.first != rhs.first)
+            {
+                return lhs.first < rhs.first;
+            }
+            return keys[lhs.second] < keys[rhs.second];
+        });
+        vector<Node> distinct;
+        vector<size_t> slot(order.size());
+        for (size_t k = 0; k < order.size(); ++k)
+        {
+            const string& key = keys[order[k].second];
+            if (distinct.empty() || distinct.back().GetWord() != key)
+            {
+                distinct.push_back(Node(key, 0));
+            }
+            slot[k] = distinct.size() - 1;
+        }
+
+        vector<Frequency> found(distinct.size());
+        if (FrozenFor(b) != NULL)
+        {
+            const FrozenBucket& bucket = *FrozenFor(b);
+            vector<size_t> ranks(distinct.size());
+            bucket.FindBatch(distinct.data(), distinct.size(), ranks.data());
+            for (size_t d = 0; d < distinct.size(); ++d)
+            {
+                found[d] = ranks[d] == bucket.Size() ? 0 : bucket.GetFrequency(ranks[d]);
+            }
+        }
+        else
+        {
+            vector<const Node*> nodes(distinct.size());
+            table[b].findBatch(distinct.data(), distinct.size(), nodes.data());
+            for (size_t d = 0; d < distinct.size(); ++d)
+            {
+                found[d] = nodes[d] == NULL ? 0 : nodes[d]->GetFrequency();
+            }
+        }
+        for (size_t k = 0; k < order.size(); ++k)
+        {
+            counts[order[k].second] = found[slot[k]];
+        }
+    });
+}
+
+// Lookup Frequency
+Frequency HashedSplays::LookupFrequency(string inWord)
+{
+    TraceScope trace(m_trace, TRACE_LOOKUP, &inWord);
+    if (inWord.length() == 0)
+    {
+        return 0;
+    }
+    int index = TableBuckets::Index(inWord[0]);
+    if (index < 0 || index >= m_trees)
+    {
+        return 0;
+    }
+    inWord = KeyOf(inWord);
+
+    bool sampled = !m_tuners.empty() && m_tuners[index].Tick(false);
+    chrono::steady_clock::time_point start;
+    if (sampled)
+    {
+        start = chrono::steady_clock::now();
+    }
+
+    // access follows the splay policy of the bucket, a bucket adaptive
+    // froze is read from its frozen copy
+    Frequency frequency;
+    const FrozenBucket* frozen = FrozenFor(index);
+    if (frozen != NULL)
+    {
+        size_t rank = frozen->Find(inWord.data(), inWord.length());
+        frequency = rank == frozen->Size() ? 0 : frozen->GetFrequency(rank);
+    }
+    else
+    {
+        const Node* found = table[index].access(Node(inWord, 1));
+        frequency = found == NULL ? 0 : found->GetFrequency();
+    }
+
+    if (sampled)
+    {
+        m_tuners[index].Sample(inWord, chrono::duration<double, nano>(chrono::steady_clock::now() - start).count());
+    }
+    if (!m_tuners.empty() && m_tuners[index].WindowFull())
+    {
+        Retune(index);
+    }
+    return frequency;
+}
+
+// Set Splay Policy
+void HashedSplays::SetSplayPolicy(SplayPolicy policy, double fraction)
+{
+    for (int i = 0; i < m_trees; ++i)
+    {
+        table.at(i).setSplayPolicy(policy, fraction);
+    }
+}
+
+// Set Key Policy
+void HashedSplays::SetKeyPolicy(KeyPolicy policy)
+{
+    // words already counted under another policy would be split
+    for (int i = 0; i < m_trees; ++i)
+    {
+        if (!table[i].isEmpty())
+        {
+            throw IllegalArgumentException();
+        }
+    }
+    m_keyPolicy = policy;
+}
+
+// Set Memory Budget
+void HashedSplays::SetMemoryBudget(size_t bytes, const string& directory)
+{
+    for (int i = 0; i < m_trees; ++i)
+    {
+        if (!table[i].isEmpty())
+        {
+            throw IllegalArgumentException();
+        }
+    }
+    SpillStore* spill = new SpillStore(directory, m_trees);
+    delete m_spill;
+    m_spill = spill;
+    m_budget = bytes;
+    m_memoryUsed = 0;
+    m_bucketBytes.assign(m_trees, 0);
+}
+
+// Spill Largest
+void HashedSplays::SpillLargest()
+{
+    // down to half the budget, so a spill is not due again on the next word
+    while (m_memoryUsed > m_budget / 2)
+    {
+        int largest = 0;
+        for (int i = 1; i < m_trees; ++i)
+        {
+            if (m_bucketBytes[i] > m_bucketBytes[largest])
+            {
+                largest = i;
+            }
+        }
+        if (m_bucketBytes[largest] == 0)
+        {
+            break;
+        }
+        ThawBucket(largest);
+        m_spill->WriteRun(largest, table[largest]);
+        table[largest].makeEmpty();
+        m_memoryUsed -= m_bucketBytes[largest];
+        m_bucketBytes[largest] = 0;
+    }
+}
+
+// For Each Merged
+void HashedSplays::ForEachMerged(const function<void(const Node&)>& visit)
+{
+    for (int i = 0; i < m_trees; ++i)
+    {
+        if (m_spill != NULL && m_spill->GetRunCount(i) > 0)
+        {
+            m_spill->Merge(i, table[i], visit);
+        }
+        else
+        {
+            table[i].inOrder(visit);
+        }
+    }
+}
+
+// Dump Merged
+void HashedSplays::DumpMerged(ostream& out)
+{
+    ForEachMerged([&](const Node& node) {
+        out << node << "\n";
+    });
+    out.flush();
+}
+
+// Set Page Mode
+void HashedSplays::SetPageMode(PageMode mode)
+{
+    for (int i = 0; i < m_trees; ++i)
+    {
+        if (!table[i].isEmpty())
+        {
+            throw IllegalArgumentException();
+        }
+    }
+    for (int i = 0; i < m_trees; ++i)
+    {
+        NodeArena* arena = new NodeArena(mode);
+        table[i].setArena(arena);
+        if (i < (int)m_arenas.size())
+        {
+            delete m_arenas[i];
+            m_arenas[i] = arena;
+        }
+        else
+        {
+            m_arenas.push_back(arena);
+        }
+    }
+}
+
+// Print Page Stats
+void HashedSplays::PrintPageStats() const
+{
+    if (m_arenas.empty())
+    {
+        return;
+    }
+    static const char* modes[] = { "small", "transparent", "huge" };
+    size_t chunks = 0;
+    size_t huge = 0;
+    size_t placed = 0;
+    vector<size_t> nodes(ARENA_MAX_NODES, 0);
+    for (size_t i = 0; i < m_arenas.size(); ++i)
+    {
+        chunks += m_arenas[i]->GetChunkCount();
+        huge += m_arenas[i]->GetHugeChunkCount();
+        placed += m_arenas[i]->GetPlacedChunkCount();
+        for (int n = 0; n < ARENA_MAX_NODES; ++n)
+        {
+            nodes[n] += m_arenas[i]->GetNodeChunks()[n];
+        }
+    }
+    cout << "Node pages " << modes[m_arenas[0]->GetMode()] << ", " << chunks << " chunks of "
+         << (ARENA_CHUNK >> 20) << " MB, " << huge << " reserved huge pages, " << placed << " bound by mbind;";
+    for (int n = 0; n < ARENA_MAX_NODES; ++n)
+    {
+        if (nodes[n] > 0)
+        {
+            cout << " node " << n << ": " << nodes[n];
+        }
+    }
+    cout << endl;
+}
+
+// Print Spill Stats
+void HashedSplays::PrintSpillStats() const
+{
+    if (m_spill == NULL)
+    {
+        return;
+    }
+    cout << "Memory budget " << m_budget << " bytes, " << m_memoryUsed << " in use, "
+         << m_spill->GetRunCount() << " runs spilled (" << m_spill->GetBytesWritten() << " bytes written)"
+         << endl;
+}
+
+// Key Of
+string HashedSplays::KeyOf(const string& strippedWord) const
+{
+    return m_keyPolicy == KEY_EXACT ? strippedWord : Util::Lower(strippedWord);
+}
+
+// Count Surface
+void HashedSplays::CountSurface(int index, const string& key, const string& surface, Frequency count)
+{
+    // a word rarely has more than a few spellings, a scan is enough
+    vector<Node>& forms = m_surfaces[index][key];
+    for (size_t f = 0; f < forms.size(); ++f)
+    {
+        if (forms[f].GetWord() == surface)
+        {
+            forms[f].AddFrequency(count);
+            return;
+        }
+    }
+    forms.push_back(Node(surface, count));
+}
+
+// Get Surface Form
+string HashedSplays::GetSurfaceForm(string inWord) const
+{
+    Frequency total = GetFrequency(inWord);
+    string key = KeyOf(inWord);
+    if (total == 0 || m_keyPolicy != KEY_SURFACE)
+    {
+        return total == 0 ? "" : key;
+    }
+    int index = TableBuckets::Index(key[0]);
+    unordered_map<string, vector<Node> >::const_iterator it = m_surfaces[index].find(key);
+    if (it == m_surfaces[index].end())
+    {
+        return key;
+    }
+
+    // the key itself was written whatever the other forms do not account for
+    Frequency others = 0;
+    for (size_t f = 0; f < it->second.size(); ++f)
+    {
+        others += it->second[f].GetFrequency();
+    }
+    string best = key;
+    Frequency bestCount = total - others;
+    for (size_t f = 0; f < it->second.size(); ++f)
+    {
+        const Node& form = it->second[f];
+        if (form.GetFrequency() > bestCount || (form.GetFrequency() == bestCount && form.GetWord() < best))
+        {
+            best = form.GetWord();
+            bestCount = form.GetFrequency();
+        }
+    }
+    return best;
+}
+
+// Print Surface Forms
+void HashedSplays::PrintSurfaceForms(int k) const
+{
+    cout << "***************PRINT SURFACE FORMS********************" << endl;
+    vector<Node> top;
+    CollectTopK(k, top);
+    for (size_t i = 0; i < top.size(); ++i)
+    {
+        cout << top[i] << " most often written " << GetSurfaceForm(top[i].GetWord()) << endl;
+    }
+    cout << endl;
+}
+
+// Set Filter
+void HashedSplays::SetFilter(const TokenFilter* filter)
+{
+    m_filter = filter;
+}
+
+// Collect Prefix
+void HashedSplays::CollectPrefix(string inPart, vector<Node>& outNodes) const
+{
+    TraceScope trace(m_trace, TRACE_PREFIX, &inPart);
+    outNodes.clear();
+    if (inPart.length() == 0)
+    {
+        return;
+    }
+    int index = TableBuckets::Index(inPart[0]);
+    if (index < 0 || index >= m_trees)
+    {
+        return;
+    }
+
+    // folded keys are in case insensitive order already, the matches are
+    // one range starting at the lower bound of the prefix
+    if (m_keyPolicy != KEY_EXACT)
+    {
+        string lowerPart = Util::Lower(inPart);
+        if (m_isFrozen)
+        {
+            const FrozenBucket& bucket = m_frozen[index];
+            size_t first, last;
+            bucket.PrefixRange(lowerPart.data(), lowerPart.length(), first, last);
+            for (size_t rank = first; rank < last; ++rank)
+            {
+                outNodes.push_back(Node(bucket.GetWord(rank), bucket.GetFrequency(rank)));
+            }
+            return;
+        }
+        table[index].inOrderFrom(Node(lowerPart, 1), [&](const Node& node) {
+            if (node.GetWord().compare(0, lowerPart.length(), lowerPart) != 0)
+            {
+                return false;
+            }
+            outNodes.push_back(node);
+            return true;
+        });
+        return;
+    }
+
+    if (m_isFrozen)
+    {
+        // case insensitive matches are spread over the bucket, but the
+        // frozen words are one contiguous scan
+        string lowerPart = Util::Lower(inPart);
+        const FrozenBucket& bucket = m_frozen[index];
+        for (size_t rank = 0; rank < bucket.Size(); ++rank)
+        {
+            const char* word = bucket.GetWordData(rank);
+            size_t length = bucket.GetWordLength(rank);
+            size_t i = 0;
+            while (i < lowerPart.length() && i < length && tolower(word[i]) == lowerPart[i])
+            {
+                i++;
+            }
+            if (i == lowerPart.length())
+            {
+                outNodes.push_back(Node(string(word, length), bucket.GetFrequency(rank)));
+            }
+        }
+        return;
+    }
+
+    // same matching rule as FindAll, operator% ignores case
+    Node keyNode(inPart, 1);
+    table[index].inOrder([&](const Node& node) {
+        if (keyNode % node)
+        {
+            outNodes.push_back(node);
+        }
+    });
+}
+
+// Collect Top K
+void HashedSplays::CollectTopK(int k, vector<Node>& outNodes) const
+{
+    TraceScope trace(m_trace, TRACE_TOP_K, NULL, 0, (uint64_t)(k < 0 ? 0 : k));
+    outNodes.clear();
+    if (k <= 0)
+    {
+        return;
+    }
+
+    // min heap on frequency, the least frequent of the current k is on top,
+    // ties broken alphabetically so the answer is deterministic
+    auto moreFrequent = [](const Node& lhs, const Node& rhs) {
+        if (lhs.GetFrequency() != rhs.GetFrequency())
+        {
+            return lhs.GetFrequency() > rhs.GetFrequency();
+        }
+        return lhs < rhs;
+    };
+    auto offer = [&](vector<Node>& heap, const Node& node) {
+        if ((int)heap.size() < k)
+        {
+            heap.push_back(node);
+            push_heap(heap.begin(), heap.end(), moreFrequent);
+        }
+        else if (moreFrequent(node, heap.front()))
+        {
+            pop_heap(heap.begin(), heap.end(), moreFrequent);
+            heap.back() = node;
+            push_heap(heap.begin(), heap.end(), moreFrequent);
+        }
+    };
+
+    // top k of every bucket in parallel, then the top k of those
+    vector<vector<Node> > bucketTop(m_trees);
+    ForEachBucket([&](int i) {
+        vector<Node>& heap = bucketTop[i];
+        if (m_isFrozen)
+        {
+            // only words that can make the cut are turned back into Nodes
+            const FrozenBucket& bucket = m_frozen[i];
+            for (size_t rank = 0; rank < bucket.Size(); ++rank)
+            {
+                if ((int)heap.size() < k || bucket.GetFrequency(rank) >= heap.front().GetFrequency())
+                {
+                    offer(heap, Node(bucket.GetWord(rank), bucket.GetFrequency(rank)));
+                }
+            }
+        }
+        else
+        {
+            table[i].inOrder([&](const Node& node) { offer(heap, node); });
+        }
+    });
+    for (int i = 0; i < m_trees; ++i)
+    {
+        for (size_t n = 0; n < bucketTop[i].size(); ++n)
+        {
+            offer(outNodes, bucketTop[i][n]);
+        }
+    }
+    sort_heap(outNodes.begin(), outNodes.end(), moreFrequent);
+}
+
+// Freeze
+void HashedSplays::Freeze()
+{
+    m_frozen.resize(m_trees);
+    ForEachBucket([&](int i) {
+        m_frozen[i].Build(table[i]);
+    });
+    m_isFrozen = true;
+}
+
+// Thaw
+void HashedSplays::Thaw()
+{
+    m_frozen.clear();
+    m_isFrozen = false;
+    for (size_t i = 0; i < m_tuners.size(); ++i)
+    {
+        ThawBucket(i);
+    }
+}
+
+// Set Adaptive
+void HashedSplays::SetAdaptive(bool adaptive)
+{
+    m_tuners.clear();
+    if (adaptive)
+    {
+        m_tuners.resize(m_trees);
+    }
+    // every bucket starts, or ends up, splaying
+    SetSplayPolicy(SPLAY_ALWAYS);
+}
+
+// Retune
+void HashedSplays::Retune(int index)
+{
+    BucketMode mode = m_tuners[index].Decide();
+    if (mode != m_tuners[index].GetMode())
+    {
+        ApplyMode(index, mode);
+    }
+}
+
+// Apply Mode
+void HashedSplays::ApplyMode(int index, BucketMode mode)
+{
+    BucketTuner& tuner = m_tuners[index];
+    if (mode == BUCKET_FROZEN)
+    {
+        tuner.GetFrozen().Build(table[index]);
+    }
+    else
+    {
+        table[index].setSplayPolicy(mode == BUCKET_SPLAY ? SPLAY_ALWAYS : SPLAY_NEVER);
+    }
+    tuner.SetMode(mode);
+}
+
+// Print Tuning
+void HashedSplays::PrintTuning() const
+{
+    if (m_tuners.empty())
+    {
+        return;
+    }
+    cout << "***************PRINT TUNING********************" << endl;
+    int modes[3] = { 0, 0, 0 };
+    for (int i = 0; i < m_trees; ++i)
+    {
+        m_tuners[i].Print(cout, i);
+        modes[m_tuners[i].GetMode()]++;
+    }
+    cout << modes[BUCKET_SPLAY] << " splaying, " << modes[BUCKET_STATIC] << " static, "
+         << modes[BUCKET_FROZEN] << " frozen" << endl << endl;
+}
+
+// Set Executor
+void HashedSplays::SetExecutor(BucketExecutor* executor)
+{
+    m_executor = executor;
+}
+
+// For Each Bucket
+void HashedSplays::ForEachBucket(const function<void(int)>& task) const
+{
+    if (m_executor != NULL && m_trace != NULL)
+    {
+        // workers run parts of a call that may already be recorded
+        m_executor->ParallelFor(m_trees, [&](int i) {
+            TraceMute mute;
+            task(i);
+        });
+    }
+    else if (m_executor != NULL)
+    {
+        m_executor->ParallelFor(m_trees, task);
+    }
+    else
+    {
+        for (int i = 0; i < m_trees; ++i)
+        {
+            task(i);
+        }
+    }
+}
+
+// Get Frozen Bucket
+const FrozenBucket& HashedSplays::GetFrozenBucket(int index) const
+{
+    if (!m_isFrozen || index < 0 || index >= m_trees)
+    {
+        throw ArrayIndexOutOfBoundsException();
+    }
+    return m_frozen[index];
+}
+
+// Get Bucket
+const SplayTree<Node>& HashedSplays::GetBucket(int index) const
+{
+    if (index < 0 || index >= m_trees)
+    {
+        throw ArrayIndexOutOfBoundsException();
+    }
+    return table[index];
+}
+
 // GetIndex
-int HashedSplays::GetIndex(string inLetter)
+int HashedSplays::GetIndex(string inLetter) const
 {
     // inLetter must be a single letter, not a substring
     if (inLetter.length() > 1)
@@ -280,11 +2189,8 @@ int HashedSplays::GetIndex(string inLetter)
     }
     else
     {
-        // convert string to lowercase, index = ascii value of letter - 97, 97 = ascii value of 'a'
-        string lowerLetter = Util::Lower(inLetter);
-        char tableLetter = lowerLetter.at(0);
-        int index = int(tableLetter);
-        return index - 97;
+        // 'a' or 'A' is 0, -1 for anything without a bucket
+        return TableBuckets::Index(inLetter.at(0));
     }
 }
 
@@ -0,0 +1,465 @@
+/*
+ * File:    IngestPipeline.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Pipelined ingestion: read, tokenize and insert stages on their own threads
+ *
+ * reader    --> fills large buffers with read()
+ * tokenizer --> splits buffers into tokens, strips and filters them, and
+ *               sorts the words into batches by the insert stage that owns
+ *               their bucket
+ * inserters --> each owns a contiguous range of buckets and is the only
+ *               thread that ever touches those trees, so no tree is locked
+ *
+ * Stages are connected by SpscRings. Every buffer and batch is returned to
+ * its producer through a second ring and reused, so the steady state does
+ * no allocation for buffers or batches. Per stage metrics show how much
+ * time each stage spent working and waiting, and how full its output ring
+ * ran.
+ */
+
+#ifndef PROJ3_INGESTPIPELINE_H
+#define PROJ3_INGESTPIPELINE_H
+
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cstdio>
+#include <cctype>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include "HashedSplays.h"
+#include "SpscRing.h"
+#include "dsexceptions.h"
+
+// buffers in flight between reader and tokenizer
+#define PIPELINE_BUFFERS 8
+
+// batches in flight between the tokenizer and each inserter
+#define PIPELINE_BATCHES 8
+
+class IngestPipeline {
+
+public:
+    /**********************************************************************
+     * Name: IngestPipeline (Constructor)
+     * PreCondition: Table to count into, number of insert stages, read
+     *               buffer size in bytes and words per batch
+     *
+     * PostCondition: Pipeline ready, buffers and batches allocated
+     *********************************************************************/
+    IngestPipeline(HashedSplays& inTable, int inserters, size_t bufferSize = 1 << 20,
+                   size_t batchWords = 4096);
+
+    /**********************************************************************
+     * Name: ~IngestPipeline
+     * PreCondition: No FileReader running
+     *
+     * PostCondition: Buffers and batches freed
+     *********************************************************************/
+    ~IngestPipeline();
+
+    /**********************************************************************
+     * Name: FileReader
+     * PreCondition: Passed value inFileName = input file
+     *
+     * PostCondition: Same counts as HashedSplays::FileReader, once every
+     *                stage has finished. Throws ReadFailedException on a
+     *                failed read, after the stages have stopped
+     *********************************************************************/
+    void FileReader(string inFileName);
+
+    /**********************************************************************
+     * Name: PrintMetrics
+     * PreCondition: FileReader has run
+     *
+     * PostCondition: Throughput, busy/wait time and output queue depth
+     *                of every stage to cout
+     *********************************************************************/
+    void PrintMetrics() const;
+
+private:
+    struct Buffer
+    {
+        vector<char> data;
+        size_t length;
+    };
+
+    struct WordBatch
+    {
+        vector<string> words;   // strings are reused, assignment keeps capacity
+        vector<int> buckets;
+        size_t count;
+    };
+
+    struct StageMetrics
+    {
+        string name;
+        unsigned long long items;   // bytes for the reader, words otherwise
+        double seconds;             // wall time of the stage
+        double waitSeconds;         // blocked on an empty input or full output
+        unsigned long long waits;
+        size_t maxDepth;            // of the output ring, sampled per push
+        double depthTotal;
+        unsigned long long depthSamples;
+    };
+
+    HashedSplays& m_table;
+    int m_inserters;
+    size_t m_bufferSize;
+    size_t m_batchWords;
+
+    SpscRing<Buffer*> m_filledBuffers;
+    SpscRing<Buffer*> m_freeBuffers;
+    vector<SpscRing<WordBatch*>*> m_filledBatches;
+    vector<SpscRing<WordBatch*>*> m_freeBatches;
+    vector<Buffer*> m_allBuffers;
+    vector<WordBatch*> m_allBatches;
+    vector<StageMetrics> m_metrics;     // reader, tokenizer, then inserters
+    bool m_readFailed;                  // set by the reader, seen after join
+
+    void ReaderStage(int fd);
+    void TokenizerStage();
+    void InsertStage(int stage);
+
+    int OwnerOf(int bucket) const { return bucket * m_inserters / m_table.m_trees; }
+
+    static void ResetMetrics(StageMetrics& metrics, string name);
+    static void SampleDepth(StageMetrics& metrics, size_t depth);
+};
+
+typedef chrono::steady_clock PipelineClock;
+
+// Constructor
+IngestPipeline::IngestPipeline(HashedSplays& inTable, int inserters, size_t bufferSize, size_t batchWords)
+    : m_table(inTable), m_inserters(inserters), m_bufferSize(bufferSize), m_batchWords(batchWords),
+      m_filledBuffers(PIPELINE_BUFFERS), m_freeBuffers(PIPELINE_BUFFERS), m_readFailed(false)
+{
+    if (inserters < 1 || inserters > inTable.m_trees || bufferSize == 0 || batchWords == 0)
+    {
+        throw IllegalArgumentException();
+    }
+
+    for (int b = 0; b < PIPELINE_BUFFERS; ++b)
+    {
+        Buffer* buffer = new Buffer;
+        buffer->data.resize(m_bufferSize);
+        buffer->length = 0;
+        m_allBuffers.push_back(buffer);
+    }
+
+    for (int i = 0; i < m_inserters; ++i)
+    {
+        m_filledBatches.push_back(SpscRing<WordBatch*>::create(PIPELINE_BATCHES * 2));
+        m_freeBatches.push_back(SpscRing<WordBatch*>::create(PIPELINE_BATCHES * 2));
+        for (int b = 0; b < PIPELINE_BATCHES; ++b)
+        {
+            WordBatch* batch = new WordBatch;
+            batch->words.resize(m_batchWords);
+            batch->buckets.resize(m_batchWords);
+            batch->count = 0;
+            m_allBatches.push_back(batch);
+        }
+    }
+}
+
+// Destructor
+IngestPipeline::~IngestPipeline()
+{
+    for (size_t b = 0; b < m_allBuffers.size(); ++b)
+    {
+        delete m_allBuffers[b];
+    }
+    for (size_t b = 0; b < m_allBatches.size(); ++b)
+    {
+        delete m_allBatches[b];
+    }
+    for (int i = 0; i < m_inserters; ++i)
+    {
+        SpscRing<WordBatch*>::destroy(m_filledBatches[i]);
+        SpscRing<WordBatch*>::destroy(m_freeBatches[i]);
+    }
+}
+
+// File Reader
+void IngestPipeline::FileReader(string inFileName)
+{
+    int fd = open(inFileName.c_str(), O_RDONLY);
+    if (fd < 0)
+    {
+        throw IllegalArgumentException();
+    }
+
+    // inserters call InsertPrepared concurrently, which must not thaw
+    m_table.Thaw();
+
+    // every buffer and batch starts out free, before any stage runs
+    for (size_t b = 0; b < m_allBuffers.size(); ++b)
+    {
+        m_freeBuffers.push(m_allBuffers[b]);
+    }
+    for (int i = 0; i < m_inserters; ++i)
+    {
+        for (int b = 0; b < PIPELINE_BATCHES; ++b)
+        {
+            m_freeBatches[i]->push(m_allBatches[i * PIPELINE_BATCHES + b]);
+        }
+    }
+
+    m_readFailed = false;
+    m_metrics.assign(2 + m_inserters, StageMetrics());
+    ResetMetrics(m_metrics[0], "reader");
+    ResetMetrics(m_metrics[1], "tokenizer");
+    for (int i = 0; i < m_inserters; ++i)
+    {
+        char name[32];
+        snprintf(name, sizeof(name), "insert %c-%c", 'a' + (i * m_table.m_trees + m_inserters - 1) / m_inserters,
+                 'a' + ((i + 1) * m_table.m_trees + m_inserters - 1) / m_inserters - 1);
+        ResetMetrics(m_metrics[2 + i], name);
+    }
+
+    vector<thread> stages;
+    stages.push_back(thread(&IngestPipeline::ReaderStage, this, fd));
+    stages.push_back(thread(&IngestPipeline::TokenizerStage, this));
+    for (int i = 0; i < m_inserters; ++i)
+    {
+        stages.push_back(thread(&IngestPipeline::InsertStage, this, i));
+    }
+    for (size_t s = 0; s < stages.size(); ++s)
+    {
+        stages[s].join();
+    }
+    close(fd);
+
+    // leave the rings empty for the next file
+    Buffer* buffer;
+    while (m_freeBuffers.tryPop(buffer)) {}
+    for (int i = 0; i < m_inserters; ++i)
+    {
+        WordBatch* batch;
+        while (m_freeBatches[i]->tryPop(batch)) {}
+    }
+    if (m_readFailed)
+    {
+        throw ReadFailedException();
+    }
+}
+
+// Reader Stage
+void IngestPipeline::ReaderStage(int fd)
+{
+    StageMetrics& metrics = m_metrics[0];
+    PipelineClock::time_point start = PipelineClock::now();
+
+    for (;;)
+    {
+        Buffer* buffer;
+        PipelineClock::time_point waitStart = PipelineClock::now();
+        metrics.waits += m_freeBuffers.pop(buffer);
+        metrics.waitSeconds += chrono::duration<double>(PipelineClock::now() - waitStart).count();
+
+        // fill the whole buffer, read may return less than asked
+        buffer->length = 0;
+        ssize_t got;
+        while (buffer->length < m_bufferSize
+               && (got = read(fd, &buffer->data[buffer->length], m_bufferSize - buffer->length)) != 0)
+        {
+            if (got < 0)
+            {
+                if (errno == EINTR)
+                {
+                    continue;
+                }
+                // the stages after it still need the end of the stream
+                m_readFailed = true;
+                break;
+            }
+            buffer->length += got;
+        }
+        if (buffer->length == 0 || m_readFailed)
+        {
+            // not pushed back, the tokenizer is the free ring's only
+            // producer; m_allBuffers still owns it
+            break;
+        }
+        metrics.items += buffer->length;
+
+        waitStart = PipelineClock::now();
+        metrics.waits += m_filledBuffers.push(buffer);
+        metrics.waitSeconds += chrono::duration<double>(PipelineClock::now() - waitStart).count();
+        SampleDepth(metrics, m_filledBuffers.size());
+    }
+
+    // NULL marks the end of the file
+    m_filledBuffers.push(NULL);
+    metrics.seconds = chrono::duration<double>(PipelineClock::now() - start).count();
+}
+
+// Tokenizer Stage
+void IngestPipeline::TokenizerStage()
+{
+    StageMetrics& metrics = m_metrics[1];
+    PipelineClock::time_point start = PipelineClock::now();
+
+    vector<WordBatch*> current(m_inserters);
+    for (int i = 0; i < m_inserters; ++i)
+    {
+        m_freeBatches[i]->pop(current[i]);
+        current[i]->count = 0;
+    }
+
+    // hand a full batch to its inserter and take a free one back
+    auto ship = [&](int owner) {
+        PipelineClock::time_point waitStart = PipelineClock::now();
+        metrics.waits += m_filledBatches[owner]->push(current[owner]);
+        SampleDepth(metrics, m_filledBatches[owner]->size());
+        metrics.waits += m_freeBatches[owner]->pop(current[owner]);
+        metrics.waitSeconds += chrono::duration<double>(PipelineClock::now() - waitStart).count();
+        current[owner]->count = 0;
+    };
+
+    string raw;
+    string strippedWord;
+    int index;
+    auto emit = [&]() {
+        TokenStatus status = m_table.PrepareWord(raw, strippedWord, index);
+        if (status == TOKEN_MALFORMED)
+        {
+            // only this thread rejects, inserters never touch the bucket
+            m_table.Reject(raw);
+        }
+        else if (status == TOKEN_COUNTED)
+        {
+            int owner = OwnerOf(index);
+            WordBatch* batch = current[owner];
+            batch->words[batch->count] = strippedWord;
+            batch->buckets[batch->count] = index;
+            if (++batch->count == m_batchWords)
+            {
+                ship(owner);
+            }
+            metrics.items++;
+        }
+        raw.clear();
+    };
+
+    for (;;)
+    {
+        Buffer* buffer;
+        PipelineClock::time_point waitStart = PipelineClock::now();
+        metrics.waits += m_filledBuffers.pop(buffer);
+        metrics.waitSeconds += chrono::duration<double>(PipelineClock::now() - waitStart).count();
+        if (buffer == NULL)
+        {
+            break;
+        }
+
+        // same token boundaries as ifs >> word, tokens may span buffers
+        const char* data = buffer->data.data();
+        for (size_t i = 0; i < buffer->length; ++i)
+        {
+            if (isspace((unsigned char)data[i]))
+            {
+                if (raw.length() > 0)
+                {
+                    emit();
+                }
+            }
+            else
+            {
+                raw += data[i];
+            }
+        }
+        m_freeBuffers.push(buffer);
+    }
+    if (raw.length() > 0)
+    {
+        emit();
+    }
+
+    // partial batches, then NULL to tell every inserter it is done. The
+    // batch in hand is not pushed back, inserter i is its free ring's only
+    // producer; m_allBatches still owns it
+    for (int i = 0; i < m_inserters; ++i)
+    {
+        if (current[i]->count > 0)
+        {
+            ship(i);
+        }
+        m_filledBatches[i]->push(NULL);
+    }
+    metrics.seconds = chrono::duration<double>(PipelineClock::now() - start).count();
+}
+
+// Insert Stage
+void IngestPipeline::InsertStage(int stage)
+{
+    StageMetrics& metrics = m_metrics[2 + stage];
+    PipelineClock::time_point start = PipelineClock::now();
+
+    for (;;)
+    {
+        WordBatch* batch;
+        PipelineClock::time_point waitStart = PipelineClock::now();
+        metrics.waits += m_filledBatches[stage]->pop(batch);
+        metrics.waitSeconds += chrono::duration<double>(PipelineClock::now() - waitStart).count();
+        if (batch == NULL)
+        {
+            break;
+        }
+
+        // every bucket in the batch belongs to this stage alone
+        for (size_t i = 0; i < batch->count; ++i)
+        {
+            m_table.InsertPrepared(batch->buckets[i], batch->words[i]);
+        }
+        metrics.items += batch->count;
+        m_freeBatches[stage]->push(batch);
+    }
+    metrics.seconds = chrono::duration<double>(PipelineClock::now() - start).count();
+}
+
+// Print Metrics
+void IngestPipeline::PrintMetrics() const
+{
+    cout << "***************PIPELINE METRICS********************" << endl;
+    printf("%-12s %14s %12s %10s %10s %10s %10s\n", "stage", "items", "items/s", "busy %",
+           "waits", "max depth", "avg depth");
+    for (size_t s = 0; s < m_metrics.size(); ++s)
+    {
+        const StageMetrics& metrics = m_metrics[s];
+        double busy = metrics.seconds > 0 ? 100.0 * (metrics.seconds - metrics.waitSeconds) / metrics.seconds : 0.0;
+        printf("%-12s %14llu %12.0f %10.1f %10llu %10zu %10.2f\n", metrics.name.c_str(), metrics.items,
+               metrics.seconds > 0 ? metrics.items / metrics.seconds : 0.0, busy, metrics.waits,
+               metrics.maxDepth, metrics.depthSamples ? metrics.depthTotal / metrics.depthSamples : 0.0);
+    }
+    cout << endl << endl;
+}
+
+// Reset Metrics
+void IngestPipeline::ResetMetrics(StageMetrics& metrics, string name)
+{
+    metrics.name = name;
+    metrics.items = 0;
+    metrics.seconds = 0;
+    metrics.waitSeconds = 0;
+    metrics.waits = 0;
+    metrics.maxDepth = 0;
+    metrics.depthTotal = 0;
+    metrics.depthSamples = 0;
+}
+
+// Sample Depth
+void IngestPipeline::SampleDepth(StageMetrics& metrics, size_t depth)
+{
+    metrics.maxDepth = max(metrics.maxDepth, depth);
+    metrics.depthTotal += depth;
+    metrics.depthSamples++;
+}
+
+#endif //PROJ3_INGESTPIPELINE_H
@@ -0,0 +1,477 @@
+/*
+ * File:    InvertedIndex.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Inverted index built while counting
+ *
+ * Every token counted into the HashedSplays table is also posted, as a
+ * (document, position) pair, to the word's entry in a splay tree of the
+ * same bucket. A document is an input file (positions are line numbers) or
+ * a line (positions are token offsets in the line).
+ *
+ * Posting lists are compressed as they grow: a posting is a varint of the
+ * document gap (0 for the same document as the last posting) followed by a
+ * varint of the position, absolute in a new document and a gap otherwise.
+ * Document frequencies and totals are kept beside the bytes, so DF and IDF
+ * need no decoding; postings and TF are decoded on demand.
+ */
+
+#ifndef PROJ3_INVERTEDINDEX_H
+#define PROJ3_INVERTEDINDEX_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <cmath>
+#include <cstdio>
+#include <stdint.h>
+#include "HashedSplays.h"
+#include "SplayTree.h"
+#include "dsexceptions.h"
+
+// What a document is to the index
+// DOC_FILE --> every input file, postings hold line numbers
+// DOC_LINE --> every line of the input, postings hold token offsets
+enum DocumentUnit { DOC_FILE, DOC_LINE };
+
+// One occurrence of a word
+struct Posting
+{
+    uint32_t doc;
+    uint32_t pos;
+};
+
+/*
+ * Delta and varint coded postings of one word, appended in document then
+ * position order
+ */
+class PostingList {
+
+public:
+    PostingList() : m_lastDoc(0), m_lastPos(0), m_docs(0), m_postings(0) {}
+
+    /**********************************************************************
+     * Name: Append
+     * PreCondition: Document not before the last one, position not before
+     *               the last one in the same document
+     *
+     * PostCondition: Posting encoded at the end of the list
+     *********************************************************************/
+    void Append(uint32_t doc, uint32_t pos);
+
+    /**********************************************************************
+     * Name: Decode
+     * PreCondition: None
+     *
+     * PostCondition: outPostings holds every posting in order
+     *********************************************************************/
+    void Decode(vector<Posting>& outPostings) const;
+
+    // Documents the word is in, its DF
+    uint32_t GetDocumentCount() const { return m_docs; }
+    uint64_t GetPostingCount() const { return m_postings; }
+    size_t GetByteCount() const { return m_bytes.size(); }
+
+private:
+    vector<uint8_t> m_bytes;
+    uint32_t m_lastDoc;
+    uint32_t m_lastPos;
+    uint32_t m_docs;
+    uint64_t m_postings;
+
+    void PutVarint(uint32_t value);
+    static uint32_t GetVarint(const vector<uint8_t>& bytes, size_t& at);
+};
+
+/*
+ * A word and its postings, what the index's splay trees hold. Ordered by
+ * word like Node
+ */
+class IndexEntry {
+
+public:
+    IndexEntry() {}
+    explicit IndexEntry(string inWord) : m_word(move(inWord)) {}
+
+    const string& GetWord() const { return m_word; }
+    PostingList& GetPostings() { return m_postings; }
+    const PostingList& GetPostings() const { return m_postings; }
+
+    bool operator<(const IndexEntry& RHS) const { return m_word < RHS.m_word; }
+
+private:
+    string m_word;
+    PostingList m_postings;
+};
+
+class InvertedIndex {
+
+public:
+    /**********************************************************************
+     * Name: InvertedIndex (Constructor)
+     * PreCondition: Table the words are counted into, which decides how
+     *               tokens are stripped and filtered, and what a document is
+     *
+     * PostCondition: Empty index, one tree per bucket of the table
+     *********************************************************************/
+    InvertedIndex(HashedSplays& table, DocumentUnit unit);
+
+    /**********************************************************************
+     * Name: FileReader
+     * PreCondition: Passed value inFileName = input file, may be called
+     *               for several files
+     *
+     * PostCondition: File counted into the table and posted to the index,
+     *                as one document or a document per line
+     *********************************************************************/
+    void FileReader(string inFileName);
+
+    /**********************************************************************
+     * Name: IndexToken
+     * PreCondition: One raw token, its document and position, in document
+     *               then position order
+     *
+     * PostCondition: Token counted into the table and posted like
+     *                HashedSplays::InsertWord would count it
+     *********************************************************************/
+    void IndexToken(const string& word, uint32_t doc, uint32_t pos);
+
+    /**********************************************************************
+     * Name: GetPostings
+     * PreCondition: Word as typed, stripped like counted tokens
+     *
+     * PostCondition: outPostings holds the word's postings, empty if it
+     *                was never seen
+     *********************************************************************/
+    void GetPostings(const string& inWord, vector<Posting>& outPostings) const;
+
+    /**********************************************************************
+     * Name: GetDocuments
+     * PreCondition: Word as typed
+     *
+     * PostCondition: outDocs holds the documents containing the word,
+     *                ascending
+     *********************************************************************/
+    void GetDocuments(const string& inWord, vector<uint32_t>& outDocs) const;
+
+    /**********************************************************************
+     * Name: GetDocumentFrequency
+     * PreCondition: Word as typed
+     *
+     * PostCondition: Number of documents containing the word
+     *********************************************************************/
+    uint32_t GetDocumentFrequency(const string& inWord) const;
+
+    /**********************************************************************
+     * Name: GetIdf
+     * PreCondition: Word as typed
+     *
+     * PostCondition: log(documents / DF), 0 for a word in no document
+     *********************************************************************/
+    double GetIdf(const string& inWord) const;
+
+    /**********************************************************************
+     * Name: RankDocuments
+     * PreCondition: Word as typed and the number of documents wanted
+     *
+     * PostCondition: outRanked holds up to k (document, TF-IDF) pairs,
+     *                highest first, ties by document
+     *********************************************************************/
+    void RankDocuments(const string& inWord, int k, vector<pair<uint32_t, double> >& outRanked) const;
+
+    /**********************************************************************
+     * Name: PrintPostings
+     * PreCondition: Word as typed and the most documents to list
+     *
+     * PostCondition: DF, IDF and the top documents by TF-IDF to cout
+     *********************************************************************/
+    void PrintPostings(const string& inWord, int k) const;
+
+    uint32_t GetDocumentCount() const { return m_documents; }
+    uint64_t GetPostingCount() const { return m_postingCount; }
+    uint64_t GetPostingBytes() const;
+
+private:
+    HashedSplays& m_table;
+    DocumentUnit m_unit;
+    vector<SplayTree<IndexEntry> > m_trees;
+    uint32_t m_documents;       // documents started so far
+    uint64_t m_postingCount;
+
+    const PostingList* Find(const string& inWord) const;
+};
+
+// Posting List Append
+void PostingList::Append(uint32_t doc, uint32_t pos)
+{
+    if (m_postings > 0 && (doc < m_lastDoc || (doc == m_lastDoc && pos < m_lastPos)))
+    {
+        throw IllegalArgumentException();
+    }
+
+    // the first document is coded as a gap from -1, so 0 always means the same one
+    if (m_postings == 0 || doc != m_lastDoc)
+    {
+        PutVarint(m_postings == 0 ? doc + 1 : doc - m_lastDoc);
+        PutVarint(pos);
+        m_docs++;
+    }
+    else
+    {
+        PutVarint(0);
+        PutVarint(pos - m_lastPos);
+    }
+    m_lastDoc = doc;
+    m_lastPos = pos;
+    m_postings++;
+}
+
+// Posting List Decode
+void PostingList::Decode(vector<Posting>& outPostings) const
+{
+    outPostings.clear();
+    outPostings.reserve(m_postings);
+    size_t at = 0;
+    Posting posting = { 0, 0 };
+    bool first = true;
+    while (at < m_bytes.size())
+    {
+        uint32_t gap = GetVarint(m_bytes, at);
+        uint32_t pos = GetVarint(m_bytes, at);
+        if (gap != 0)
+        {
+            posting.doc = first ? gap - 1 : posting.doc + gap;
+            posting.pos = pos;
+        }
+        else
+        {
+            posting.pos += pos;
+        }
+        first = false;
+        outPostings.push_back(posting);
+    }
+}
+
+// Put Varint, 7 bits a byte, low bits first, high bit set on all but the last
+void PostingList::PutVarint(uint32_t value)
+{
+    while (value >= 0x80)
+    {
+        m_bytes.push_back((uint8_t)(value | 0x80));
+        value >>= 7;
+    }
+    m_bytes.push_back((uint8_t)value);
+}
+
+// Get Varint
+uint32_t PostingList::GetVarint(const vector<uint8_t>& bytes, size_t& at)
+{
+    uint32_t value = 0;
+    for (int shift = 0; at < bytes.size(); shift += 7)
+    {
+        uint8_t byte = bytes[at++];
+        value |= (uint32_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            break;
+        }
+    }
+    return value;
+}
+
+// Constructor
+InvertedIndex::InvertedIndex(HashedSplays& table, DocumentUnit unit)
+    : m_table(table), m_unit(unit), m_documents(0), m_postingCount(0)
+{
+    m_trees.resize(table.m_trees);
+}
+
+// File Reader
+void InvertedIndex::FileReader(string inFileName)
+{
+    ifstream ifs(inFileName.c_str());
+    if (!ifs)
+    {
+        // invalid file, file does not exist, terminate
+        throw IllegalArgumentException();
+    }
+
+    // a file is one document, or every line is one
+    uint32_t doc = m_documents;
+    uint32_t line = 0;
+    string text;
+    string word;
+    while (getline(ifs, text))
+    {
+        if (m_unit == DOC_LINE)
+        {
+            doc = m_documents;
+            m_documents++;
+        }
+        istringstream tokens(text);
+        uint32_t offset = 0;
+        while (tokens >> word)
+        {
+            IndexToken(word, doc, m_unit == DOC_LINE ? offset : line);
+            offset++;
+        }
+        line++;
+    }
+    if (m_unit == DOC_FILE)
+    {
+        m_documents++;
+    }
+    ifs.close();
+}
+
+// Index Token
+void InvertedIndex::IndexToken(const string& word, uint32_t doc, uint32_t pos)
+{
+    string strippedWord;
+    int index;
+    TokenStatus status = m_table.PrepareWord(word, strippedWord, index);
+    if (status == TOKEN_MALFORMED)
+    {
+        m_table.Reject(word);
+        return;
+    }
+    if (status != TOKEN_COUNTED)
+    {
+        return;
+    }
+
+    // emplace hands back the entry already in the tree for a known word,
+    // keyed the way the table keys it so postings and counts agree
+    IndexEntry* entry = m_trees[index].emplace(m_table.KeyOf(strippedWord));
+    entry->GetPostings().Append(doc, pos);
+    m_postingCount++;
+    m_table.InsertPrepared(index, move(strippedWord));
+}
+
+// Find, the posting list of a word as typed, NULL if never seen
+const PostingList* InvertedIndex::Find(const string& inWord) const
+{
+    string strippedWord;
+    int index;
+    if (m_table.PrepareWord(inWord, strippedWord, index) != TOKEN_COUNTED)
+    {
+        return NULL;
+    }
+    const IndexEntry* entry = m_trees[index].find(IndexEntry(m_table.KeyOf(strippedWord)));
+    return entry == NULL ? NULL : &entry->GetPostings();
+}
+
+// Get Postings
+void InvertedIndex::GetPostings(const string& inWord, vector<Posting>& outPostings) const
+{
+    outPostings.clear();
+    const PostingList* postings = Find(inWord);
+    if (postings != NULL)
+    {
+        postings->Decode(outPostings);
+    }
+}
+
+// Get Documents
+void InvertedIndex::GetDocuments(const string& inWord, vector<uint32_t>& outDocs) const
+{
+    outDocs.clear();
+    vector<Posting> postings;
+    GetPostings(inWord, postings);
+    for (size_t i = 0; i < postings.size(); ++i)
+    {
+        if (outDocs.empty() || outDocs.back() != postings[i].doc)
+        {
+            outDocs.push_back(postings[i].doc);
+        }
+    }
+}
+
+// Get Document Frequency
+uint32_t InvertedIndex::GetDocumentFrequency(const string& inWord) const
+{
+    const PostingList* postings = Find(inWord);
+    return postings == NULL ? 0 : postings->GetDocumentCount();
+}
+
+// Get Idf
+double InvertedIndex::GetIdf(const string& inWord) const
+{
+    uint32_t df = GetDocumentFrequency(inWord);
+    return df == 0 ? 0.0 : log((double)m_documents / df);
+}
+
+// Rank Documents
+void InvertedIndex::RankDocuments(const string& inWord, int k, vector<pair<uint32_t, double> >& outRanked) const
+{
+    outRanked.clear();
+    vector<Posting> postings;
+    GetPostings(inWord, postings);
+    double idf = GetIdf(inWord);
+
+    // postings are grouped by document, TF is the length of each run
+    for (size_t i = 0; i < postings.size(); )
+    {
+        size_t run = i;
+        while (run < postings.size() && postings[run].doc == postings[i].doc)
+        {
+            run++;
+        }
+        outRanked.push_back(make_pair(postings[i].doc, (run - i) * idf));
+        i = run;
+    }
+
+    auto higher = [](const pair<uint32_t, double>& lhs, const pair<uint32_t, double>& rhs) {
+        if (lhs.second != rhs.second)
+        {
+            return lhs.second > rhs.second;
+        }
+        return lhs.first < rhs.first;
+    };
+    if (k >= 0 && outRanked.size() > (size_t)k)
+    {
+        partial_sort(outRanked.begin(), outRanked.begin() + k, outRanked.end(), higher);
+        outRanked.resize(k);
+    }
+    else
+    {
+        sort(outRanked.begin(), outRanked.end(), higher);
+    }
+}
+
+// Print Postings
+void InvertedIndex::PrintPostings(const string& inWord, int k) const
+{
+    vector<pair<uint32_t, double> > ranked;
+    RankDocuments(inWord, k, ranked);
+    const PostingList* postings = Find(inWord);
+
+    cout << inWord << ": in " << GetDocumentFrequency(inWord) << " of " << m_documents
+         << (m_unit == DOC_LINE ? " lines" : " files") << ", "
+         << (postings == NULL ? 0 : postings->GetPostingCount()) << " postings in "
+         << (postings == NULL ? 0 : postings->GetByteCount()) << " bytes, idf " << GetIdf(inWord) << endl;
+    for (size_t i = 0; i < ranked.size(); ++i)
+    {
+        cout << "  " << (m_unit == DOC_LINE ? "line " : "file ") << ranked[i].first
+             << " tf-idf " << ranked[i].second << endl;
+    }
+}
+
+// Get Posting Bytes, the compressed size of every list
+uint64_t InvertedIndex::GetPostingBytes() const
+{
+    uint64_t bytes = 0;
+    for (size_t t = 0; t < m_trees.size(); ++t)
+    {
+        m_trees[t].inOrder([&](const IndexEntry& entry) {
+            bytes += entry.GetPostings().GetByteCount();
+        });
+    }
+    return bytes;
+}
+
+#endif //PROJ3_INVERTEDINDEX_H
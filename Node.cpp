@@ -11,38 +11,57 @@
 #include "Node.h"
 
 #include <iostream>
+#include <utility>
 
 using namespace std;
 
 //No parameter constructor for containers
-Node::Node(){}
+template <typename CountT>
+BasicNode<CountT>::BasicNode() : m_frequency(0) {}
 
 
 //Full constructor
-Node::Node(string inWord, int frequency) : m_word(inWord),
+template <typename CountT>
+BasicNode<CountT>::BasicNode(string inWord, CountT frequency) : m_word(move(inWord)),
     m_frequency(frequency){}
 
+
+//Copy constructor
+template <typename CountT>
+BasicNode<CountT>::BasicNode(const BasicNode& RHS) : m_word(RHS.m_word),
+    m_frequency(RHS.m_frequency){}
+
+
+//Move constructor, takes the word's buffer
+template <typename CountT>
+BasicNode<CountT>::BasicNode(BasicNode&& RHS) noexcept : m_word(move(RHS.m_word)),
+    m_frequency(RHS.m_frequency){}
+
     
 //Destructor
-Node::~Node(){}
+template <typename CountT>
+BasicNode<CountT>::~BasicNode(){}
 
 
 //Compares this to RHS and returns true if the word is less than
-bool Node::operator<(const Node& RHS) const
+template <typename CountT>
+bool BasicNode<CountT>::operator<(const BasicNode& RHS) const
 {
     return (this->m_word < RHS.m_word);
 }
 
 
 //Compares this to RHS and returns true if the words are identical
-bool Node::operator==(const Node& RHS)
+template <typename CountT>
+bool BasicNode<CountT>::operator==(const BasicNode& RHS)
 {
     return (this->m_word == RHS.m_word);
 }
 
 
 //Deep copy
-Node Node::operator=(const Node& RHS)
+template <typename CountT>
+BasicNode<CountT>& BasicNode<CountT>::operator=(const BasicNode& RHS)
 {
     //Be sure we aren't copying over the node
     if( this != &RHS )
@@ -54,21 +73,33 @@ Node Node::operator=(const Node& RHS)
 }
 
 
+//Move assignment, takes the word's buffer
+template <typename CountT>
+BasicNode<CountT>& BasicNode<CountT>::operator=(BasicNode&& RHS) noexcept
+{
+    if( this != &RHS )
+    {
+        this->m_word = move(RHS.m_word);
+        this->m_frequency = RHS.m_frequency;
+    }
+    return *this;
+}
+
+
 //Check to see if we have a substring
-bool Node::operator%(const Node& RHS) const
+template <typename CountT>
+bool BasicNode<CountT>::operator%(const BasicNode& RHS) const
 {
-    //We want to ignore case on this check
-    string text = this->GetWord();
-    text = Util::Lower(text);
-    
-    string compared = RHS.GetWord();
-    compared = Util::Lower(compared);
+    //We want to ignore case on this check, character by character so no
+    //lowered copies are made on every comparison
+    const string& text = this->GetWord();
+    const string& compared = RHS.GetWord();
     
     // If the substring is longer it really isn't a substring
     if (text.length() > compared.length()) {return false;}
     //Check each character of the substring against the compared string
     for (unsigned int i = 0; i < text.length(); i++){
-        if (text[i] != compared[i]){
+        if (tolower(text[i]) != tolower(compared[i])){
             //One miss is all it takes to not have a match
             return false;
         }
@@ -78,14 +109,24 @@ bool Node::operator%(const Node& RHS) const
 
 
 //Increment the frequency
-void Node::IncrementFrequency()
+template <typename CountT>
+void BasicNode<CountT>::IncrementFrequency()
 {
-    m_frequency++;
+    m_frequency = CheckedAdd<CountT>(m_frequency, 1);
+}
+
+
+//Add a count to the frequency
+template <typename CountT>
+void BasicNode<CountT>::AddFrequency(CountT count)
+{
+    m_frequency = CheckedAdd<CountT>(m_frequency, count);
 }
 
 
 //Formatted output
-std::ostream& operator<<(std::ostream& out, const Node &inNode)
+template <typename CountT>
+std::ostream& operator<<(std::ostream& out, const BasicNode<CountT> &inNode)
 {
     out << "Node [word=" << inNode.GetWord() << ", frequency=";
     out << inNode.GetFrequency() << "]" ;
@@ -93,15 +134,11 @@ std::ostream& operator<<(std::ostream& out, const Node &inNode)
 }
 
 
-//Return the int for frequency
-int Node::GetFrequency() const
-{
-    return m_frequency;
-}
 
 
-//Return the string for the word
-string Node::GetWord() const
-{
-    return m_word;
-}
\ No newline at end of file
+
+//Both counter widths are built, so either can be picked per program
+template class BasicNode<uint32_t>;
+template class BasicNode<uint64_t>;
+template std::ostream& operator<<(std::ostream& out, const BasicNode<uint32_t> &inNode);
+template std::ostream& operator<<(std::ostream& out, const BasicNode<uint64_t> &inNode);
@@ -12,10 +12,16 @@
 #define NODE_H
 
 #include "Util.h" // For some string functions
+#include "Frequency.h"
+#include "BucketTraits.h"
 
 using namespace std;
 
-class Node{
+// Word and its count, CountT is the counter type (uint32_t or uint64_t).
+// Members are defined in Node.cpp and instantiated there for both, but
+// for the accessors the trees call in their loops, inline below.
+template <typename CountT>
+class BasicNode{
 
 public:
     /**********************************************************************
@@ -25,16 +31,28 @@ public:
      * 
      * PostCondition:  Empty node object.
      *********************************************************************/
-    Node();
+    BasicNode();
     
     
     /**********************************************************************
      * Name: Node (Constructor)
-     * PreCondition: Word (string) and frequency for bulding a node
+     * PreCondition: Word (string) and frequency for bulding a node.
+     * Pass the word with move() when the caller no longer needs it
      * 
-     * PostCondition:  Node with word and frequency
+     * PostCondition:  Node with word and frequency, the word is moved in
      *********************************************************************/
-    Node(string inWord, int frequency);
+    BasicNode(string inWord, CountT frequency);
+
+
+    /**********************************************************************
+     * Name: Node (Copy and Move Constructors)
+     * PreCondition: Valid node to copy or move from
+     * 
+     * PostCondition:  Copy of the node. A moved from node keeps its
+     * frequency and an empty word
+     *********************************************************************/
+    BasicNode(const BasicNode &RHS);
+    BasicNode(BasicNode &&RHS) noexcept;
     
     
     /**********************************************************************
@@ -43,35 +61,46 @@ public:
      * 
      * PostCondition:  None
      *********************************************************************/
-    ~Node();
+    ~BasicNode();
     
     
     /**********************************************************************
      * Name: GetWord
      * PreCondition: None
      * 
-     * PostCondition:  String value of the word
+     * PostCondition:  String value of the word, valid as long as the node
      *********************************************************************/
-    string GetWord() const;
+    const string& GetWord() const;
     
     
     /**********************************************************************
      * Name: GetFrequency()
      * PreCondition: None
      * 
-     * PostCondition:  Int value of the frequency
+     * PostCondition:  Count value of the frequency
      *********************************************************************/
-    int GetFrequency() const;
+    CountT GetFrequency() const;
     
     
     /**********************************************************************
      * Name: IncrementFrequency
      * PreCondition: None
      * 
-     * PostCondition:  Increments the word's frequency by 1
+     * PostCondition:  Increments the word's frequency by 1, throws
+     *                 OverflowException in debug builds if it would wrap
      *********************************************************************/
     void IncrementFrequency();
 
+
+    /**********************************************************************
+     * Name: AddFrequency
+     * PreCondition: Count to add, from another table or a snapshot
+     * 
+     * PostCondition:  Increments the word's frequency by count, checked
+     *                 like IncrementFrequency
+     *********************************************************************/
+    void AddFrequency(CountT count);
+
     
     /**********************************************************************
      * Name: Overload operator <
@@ -79,7 +108,7 @@ public:
      * 
      * PostCondition:  Bool.  True if the word value is less.
      *********************************************************************/
-    bool operator<(const Node &RHS) const;
+    bool operator<(const BasicNode &RHS) const;
     
     
     /**********************************************************************
@@ -88,16 +117,25 @@ public:
      * 
      * PostCondition:  Bool.  True if the word values are equal.
      *********************************************************************/
-    bool operator==(const Node &RHS);
+    bool operator==(const BasicNode &RHS);
     
     
     /**********************************************************************
      * Name: Overload operator =
      * PreCondition: Valid node objects to compare
      * 
-     * PostCondition:  New node via a deep copy.
+     * PostCondition:  This node via a deep copy.
      *********************************************************************/
-    Node operator=(const Node &RHS);
+    BasicNode& operator=(const BasicNode &RHS);
+
+
+    /**********************************************************************
+     * Name: Overload operator = (Move)
+     * PreCondition: Valid node to move from
+     * 
+     * PostCondition:  This node takes over the word, no copy is made
+     *********************************************************************/
+    BasicNode& operator=(BasicNode &&RHS) noexcept;
     
     
     /**********************************************************************
@@ -107,20 +145,49 @@ public:
      * PostCondition:  Bool.  True if the word in this object is a 
      * leading SUBSTRING of the compared node.
      *********************************************************************/
-    bool operator%(const Node& RHS) const;
+    bool operator%(const BasicNode& RHS) const;
 
-    
-    /**********************************************************************
-     * Name: Overload operator << (Friend)
-     * PreCondition: Valid node to output
-     * 
-     * PostCondition:  Formated output of the word and frequency.
-     *********************************************************************/
-    friend std::ostream& operator<<(std::ostream& out, const Node &inNode);
-    
 private:
     std::string m_word; // The word
-    int m_frequency;    // How often the word has appeared.
+    CountT m_frequency; // How often the word has appeared.
 };
 
+
+/**********************************************************************
+ * Name: Overload operator <<
+ * PreCondition: Valid node to output
+ * 
+ * PostCondition:  Formated output of the word and frequency.
+ *********************************************************************/
+template <typename CountT>
+std::ostream& operator<<(std::ostream& out, const BasicNode<CountT> &inNode);
+
+//Return the word
+template <typename CountT>
+inline const string& BasicNode<CountT>::GetWord() const
+{
+    return m_word;
+}
+
+//Return the count for frequency
+template <typename CountT>
+inline CountT BasicNode<CountT>::GetFrequency() const
+{
+    return m_frequency;
+}
+
+// Trees order nodes by their words, compared inline rather than through
+// operator< in Node.cpp
+template <typename CountT>
+struct KeyOrder<BasicNode<CountT> >
+{
+    static bool Less(const BasicNode<CountT>& a, const BasicNode<CountT>& b)
+    {
+        return ByteOrder::Less(a.GetWord(), b.GetWord());
+    }
+};
+
+// The node every structure stores, counter width picked by WF_COUNT_BITS
+typedef BasicNode<Frequency> Node;
+
 #endif
@@ -0,0 +1,264 @@
+/*
+ * File:    NodeArena.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Tree node memory in 2 MB chunks, on huge pages and the local NUMA node
+ *
+ * A bucket's nodes come from its own arena instead of operator new, packed
+ * into ARENA_CHUNK sized chunks mapped with mmap. A chunk is one 2 MB huge
+ * page under PAGES_HUGE (MAP_HUGETLB, from the pages reserved in
+ * vm.nr_hugepages) or PAGES_TRANSPARENT (a 2 MB aligned mapping with
+ * MADV_HUGEPAGE, which the kernel backs with a huge page when it has one),
+ * so a whole chunk of nodes costs one TLB entry instead of 512. PAGES_HUGE
+ * falls back to PAGES_TRANSPARENT when no huge page is reserved.
+ * PAGES_SMALL asks for 4 KB pages, for comparison.
+ *
+ * Each chunk is bound, before it is touched, to the NUMA node of the
+ * thread that maps it, with the raw mbind system call and MPOL_PREFERRED,
+ * so a full node spills over rather than failing. Placement follows the
+ * first thread to need a chunk, not the bucket: the plain reader maps
+ * every chunk from the main thread, and the executor hands buckets to
+ * whichever worker is free, so a bucket's chunks can land on different
+ * nodes. Only --pipeline gives a bucket one inserter for the whole run,
+ * and so keeps its nodes next to that thread. No libnuma is needed; where
+ * the kernel has no NUMA support mbind is tried once and the pages stay
+ * wherever first touch puts them, which is the same node.
+ *
+ * Words up to the short string length live inside their node, longer ones
+ * are still allocated by std::string. An arena belongs to one bucket and
+ * is used by one thread at a time, like the bucket.
+ */
+
+#ifndef PROJ3_NODEARENA_H
+#define PROJ3_NODEARENA_H
+
+#include <vector>
+#include <atomic>
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include "dsexceptions.h"
+
+using namespace std;
+
+#define ARENA_CHUNK (2u << 20)      // one huge page
+#define ARENA_MAX_NODES 64          // NUMA nodes told apart in the stats
+
+#ifndef MPOL_PREFERRED
+#define MPOL_PREFERRED 1
+#endif
+
+// Page size of the chunks
+// PAGES_SMALL       --> 4 KB pages, MADV_NOHUGEPAGE
+// PAGES_TRANSPARENT --> transparent huge pages, MADV_HUGEPAGE
+// PAGES_HUGE        --> reserved huge pages, transparent if none are left
+enum PageMode { PAGES_SMALL, PAGES_TRANSPARENT, PAGES_HUGE };
+
+class NodeArena {
+
+public:
+    /**********************************************************************
+     * Name: NodeArena (Constructor)
+     * PreCondition: Page mode
+     *
+     * PostCondition: Empty arena, nothing mapped yet
+     *********************************************************************/
+    NodeArena(PageMode mode);
+
+    /**********************************************************************
+     * Name: ~NodeArena
+     * PreCondition: Every slot released, or its object destroyed
+     *
+     * PostCondition: Every chunk unmapped
+     *********************************************************************/
+    ~NodeArena();
+
+    /**********************************************************************
+     * Name: Allocate
+     * PreCondition: Size of the object, at most ARENA_CHUNK
+     *
+     * PostCondition: Pointer to size bytes, 8 byte aligned, a released slot
+     *                of the same size if there is one. Throws
+     *                OutOfMemoryException if no chunk can be mapped
+     *********************************************************************/
+    void* Allocate(size_t size);
+
+    /**********************************************************************
+     * Name: Release
+     * PreCondition: Slot from Allocate with the same size, its object
+     *               destroyed
+     *
+     * PostCondition: Slot kept for the next Allocate
+     *********************************************************************/
+    void Release(void* slot, size_t size);
+
+    size_t GetChunkCount() const { return m_chunks.size(); }
+    size_t GetHugeChunkCount() const { return m_hugeChunks; }
+    size_t GetPlacedChunkCount() const { return m_placedChunks; }
+    size_t GetSlotsInUse() const { return m_inUse; }
+    PageMode GetMode() const { return m_mode; }
+
+    // chunks mapped by threads on each NUMA node
+    const vector<size_t>& GetNodeChunks() const { return m_nodeChunks; }
+
+    // NUMA node of the calling thread, 0 if the kernel will not say
+    static int CurrentNode();
+
+private:
+    PageMode m_mode;
+    vector<char*> m_chunks;
+    char* m_next;                   // bump pointer in the last chunk
+    char* m_end;
+    void* m_free;                   // released slots, linked through themselves
+    size_t m_slot;                  // the one slot size that is recycled
+    size_t m_hugeChunks;            // mapped with MAP_HUGETLB
+    size_t m_placedChunks;          // bound with mbind
+    size_t m_inUse;
+    vector<size_t> m_nodeChunks;
+
+    // mbind failed once, the kernel has no NUMA policy support
+    static atomic<bool>& NumaDisabled()
+    {
+        static atomic<bool> disabled(false);
+        return disabled;
+    }
+
+    char* MapChunk();
+    void PlaceChunk(char* chunk);
+
+    NodeArena(const NodeArena&);
+    NodeArena& operator=(const NodeArena&);
+};
+
+// Constructor
+NodeArena::NodeArena(PageMode mode)
+    : m_mode(mode), m_next(NULL), m_end(NULL), m_free(NULL), m_slot(0), m_hugeChunks(0), m_placedChunks(0),
+      m_inUse(0), m_nodeChunks(ARENA_MAX_NODES, 0)
+{
+}
+
+// Destructor
+NodeArena::~NodeArena()
+{
+    for (size_t c = 0; c < m_chunks.size(); ++c)
+    {
+        munmap(m_chunks[c], ARENA_CHUNK);
+    }
+}
+
+// Allocate
+void* NodeArena::Allocate(size_t size)
+{
+    size = (size + 7) & ~(size_t)7;
+    if (m_slot == 0)
+    {
+        m_slot = size;
+    }
+    m_inUse++;
+    if (size == m_slot && m_free != NULL)
+    {
+        void* slot = m_free;
+        memcpy(&m_free, slot, sizeof(void*));
+        return slot;
+    }
+    if ((size_t)(m_end - m_next) < size)
+    {
+        // the tail of the last chunk is given up, it is under one slot
+        m_next = MapChunk();
+        m_end = m_next + ARENA_CHUNK;
+    }
+    void* slot = m_next;
+    m_next += size;
+    return slot;
+}
+
+// Release
+void NodeArena::Release(void* slot, size_t size)
+{
+    m_inUse--;
+    size = (size + 7) & ~(size_t)7;
+    if (size == m_slot)
+    {
+        memcpy(slot, &m_free, sizeof(void*));
+        m_free = slot;
+    }
+}
+
+// Map Chunk
+char* NodeArena::MapChunk()
+{
+    void* chunk = MAP_FAILED;
+    if (m_mode == PAGES_HUGE)
+    {
+        chunk = mmap(NULL, ARENA_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+        if (chunk != MAP_FAILED)
+        {
+            m_hugeChunks++;
+        }
+    }
+    if (chunk == MAP_FAILED)
+    {
+        // twice the size so a 2 MB aligned chunk fits, the rest unmapped
+        char* region = (char*)mmap(NULL, 2 * ARENA_CHUNK, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS,
+                                   -1, 0);
+        if (region == MAP_FAILED)
+        {
+            throw OutOfMemoryException();
+        }
+        char* aligned = (char*)(((uintptr_t)region + ARENA_CHUNK - 1) & ~(uintptr_t)(ARENA_CHUNK - 1));
+        if (aligned > region)
+        {
+            munmap(region, aligned - region);
+        }
+        munmap(aligned + ARENA_CHUNK, region + ARENA_CHUNK - aligned);
+        madvise(aligned, ARENA_CHUNK, m_mode == PAGES_SMALL ? MADV_NOHUGEPAGE : MADV_HUGEPAGE);
+        chunk = aligned;
+    }
+    PlaceChunk((char*)chunk);
+    m_chunks.push_back((char*)chunk);
+    return (char*)chunk;
+}
+
+// Place Chunk
+void NodeArena::PlaceChunk(char* chunk)
+{
+    int node = CurrentNode();
+    if (node >= ARENA_MAX_NODES)
+    {
+        return;
+    }
+    m_nodeChunks[node]++;
+    if (NumaDisabled().load(memory_order_relaxed))
+    {
+        return;
+    }
+    unsigned long mask = 1ul << node;
+    if (syscall(SYS_mbind, chunk, (unsigned long)ARENA_CHUNK, MPOL_PREFERRED, &mask,
+                (unsigned long)(sizeof(mask) * 8), 0u) == 0)
+    {
+        m_placedChunks++;
+    }
+    else
+    {
+        NumaDisabled().store(true, memory_order_relaxed);
+    }
+}
+
+// Current Node
+int NodeArena::CurrentNode()
+{
+    unsigned cpu = 0;
+    unsigned node = 0;
+    if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0)
+    {
+        return 0;
+    }
+    return (int)node;
+}
+
+#endif //PROJ3_NODEARENA_H
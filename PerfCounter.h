@@ -0,0 +1,107 @@
+/*
+ * File:    PerfCounter.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * One hardware event of this thread, counted with perf_event_open
+ *
+ * Counts user space events only (retired instructions by default) between
+ * Start and Stop. Virtual machines and containers often have no hardware
+ * counters or forbid them (perf_event_paranoid); IsAvailable is false then
+ * and Stop returns 0, callers print their timings alone.
+ */
+
+#ifndef PROJ3_PERFCOUNTER_H
+#define PROJ3_PERFCOUNTER_H
+
+#include <cstring>
+#include <stdint.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+
+class PerfCounter {
+
+public:
+    /**********************************************************************
+     * Name: PerfCounter (Constructor)
+     * PreCondition: perf event type and config
+     *
+     * PostCondition: Counter opened and stopped, unavailable if the
+     *                kernel refused it
+     *********************************************************************/
+    PerfCounter(uint32_t type = PERF_TYPE_HARDWARE, uint64_t config = PERF_COUNT_HW_INSTRUCTIONS);
+
+    ~PerfCounter();
+
+    bool IsAvailable() const { return m_fd >= 0; }
+
+    /**********************************************************************
+     * Name: Start / Stop
+     * PreCondition: None
+     *
+     * PostCondition: Start zeroes and enables the counter, Stop disables
+     *                it and returns the events counted since Start
+     *********************************************************************/
+    void Start();
+    uint64_t Stop();
+
+private:
+    int m_fd;
+
+    PerfCounter(const PerfCounter&);
+    PerfCounter& operator=(const PerfCounter&);
+};
+
+// Constructor
+PerfCounter::PerfCounter(uint32_t type, uint64_t config)
+{
+    perf_event_attr attributes;
+    memset(&attributes, 0, sizeof(attributes));
+    attributes.type = type;
+    attributes.size = sizeof(attributes);
+    attributes.config = config;
+    attributes.disabled = 1;
+    attributes.exclude_kernel = 1;
+    attributes.exclude_hv = 1;
+    m_fd = (int)syscall(__NR_perf_event_open, &attributes, 0, -1, -1, 0);
+}
+
+// Destructor
+PerfCounter::~PerfCounter()
+{
+    if (m_fd >= 0)
+    {
+        close(m_fd);
+    }
+}
+
+// Start
+void PerfCounter::Start()
+{
+    if (m_fd >= 0)
+    {
+        ioctl(m_fd, PERF_EVENT_IOC_RESET, 0);
+        ioctl(m_fd, PERF_EVENT_IOC_ENABLE, 0);
+    }
+}
+
+// Stop
+uint64_t PerfCounter::Stop()
+{
+    uint64_t count = 0;
+    if (m_fd >= 0)
+    {
+        ioctl(m_fd, PERF_EVENT_IOC_DISABLE, 0);
+        if (read(m_fd, &count, sizeof(count)) != sizeof(count))
+        {
+            count = 0;
+        }
+    }
+    return count;
+}
+
+#endif //PROJ3_PERFCOUNTER_H
@@ -0,0 +1,550 @@
+/*
+ * File:    QueryServer.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Long running query server over a resident HashedSplays table
+ *
+ * The table is built once and then answered from memory over a Unix domain
+ * socket or a localhost TCP port. Every worker thread runs its own epoll
+ * loop, reads whatever requests a client has pipelined, answers all complete
+ * lines and sends the answers back in a single write. A client that
+ * half-closes its end still gets every answer: the connection stays open,
+ * waiting only for writability, until the last byte is sent.
+ *
+ * Workers only use the read only HashedSplays queries (SplayTree::find and
+ * SplayTree::inOrder), so they share the table without any locking.
+ *
+ * ******************PROTOCOL******************************
+ * One request per line, one response line per request, in order.
+ * FREQ word       --> OK count
+ * PREFIX part     --> OK n word1 count1 ... wordn countn
+ * TOPK k          --> OK n word1 count1 ... wordn countn
+ * BUCKET i|letter --> OK index nodes splays rootWord rootCount
+ * PING            --> OK PONG
+ * SHUTDOWN        --> OK BYE, then every worker exits
+ * Anything else   --> ERR message
+ */
+
+#ifndef PROJ3_QUERYSERVER_H
+#define PROJ3_QUERYSERVER_H
+
+#include <string>
+#include <vector>
+#include <map>
+#include <thread>
+#include <sstream>
+#include <cstring>
+#include <cstdlib>
+#include <cerrno>
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include "HashedSplays.h"
+#include "dsexceptions.h"
+
+// largest request line accepted before the connection is dropped
+#define MAX_REQUEST_LENGTH 65536
+
+// unsent answer bytes past which a client's requests are not read
+#define MAX_PENDING_OUTPUT (1 << 20)
+
+// most events handled per epoll_wait call
+#define MAX_EPOLL_EVENTS 64
+
+class QueryServer {
+
+public:
+    /**********************************************************************
+     * Name: QueryServer (Constructor)
+     * PreCondition: Built table, endpoint "unix:/path", "tcp:port" or a
+     *               bare socket path, number of worker threads
+     *
+     * PostCondition: Listening socket bound, no workers started yet.
+     *                Throws IllegalArgumentException for an unusable
+     *                endpoint, SocketFailedException if the socket or the
+     *                stop event cannot be made
+     *********************************************************************/
+    QueryServer(const HashedSplays& inTable, string inEndpoint, int inThreads);
+
+    /**********************************************************************
+     * Name: ~QueryServer
+     * PreCondition: Constructed server
+     *
+     * PostCondition: Sockets closed, unix socket file removed
+     *********************************************************************/
+    ~QueryServer();
+
+    /**********************************************************************
+     * Name: Run
+     * PreCondition: Constructed server
+     *
+     * PostCondition: Serves requests until a client sends SHUTDOWN.
+     *                Throws SocketFailedException if the workers' epoll
+     *                sets cannot be made
+     *********************************************************************/
+    void Run();
+
+    /**********************************************************************
+     * Name: HandleRequest
+     * PreCondition: One request line without the newline
+     *
+     * PostCondition: Response line (with newline) appended to out. True
+     *                if the request was SHUTDOWN, the caller stops the server
+     *********************************************************************/
+    bool HandleRequest(const string& line, string& out) const;
+
+private:
+    struct Connection
+    {
+        string in;        // bytes read but not yet answered
+        string out;       // answers not yet written
+        size_t sent;      // bytes of out already written
+        bool readDone;    // client half-closed or was cut off, only answers left
+    };
+
+    const HashedSplays& m_table;
+    string m_endpoint;
+    string m_unixPath;
+    int m_threads;
+    int m_listenFd;
+    int m_stopFd;
+
+    void WorkerLoop(int epollFd);     // closes epollFd when done
+    bool ReadRequests(int fd, Connection& conn) const;
+    void AnswerLines(Connection& conn) const;
+    bool FlushResponses(int fd, Connection& conn) const;
+    static void AppendNodes(const vector<Node>& nodes, string& out);
+    static void SetNonBlocking(int fd);
+};
+
+// Constructor
+QueryServer::QueryServer(const HashedSplays& inTable, string inEndpoint, int inThreads)
+    : m_table(inTable), m_endpoint(inEndpoint), m_threads(inThreads),
+      m_listenFd(-1), m_stopFd(-1)
+{
+    if (m_threads < 1)
+    {
+        throw IllegalArgumentException();
+    }
+
+    if (inEndpoint.compare(0, 4, "tcp:") == 0)
+    {
+        // localhost only, the table is not meant to be reachable from outside
+        int port = atoi(inEndpoint.substr(4).c_str());
+        if (port <= 0 || port > 65535)
+        {
+            throw IllegalArgumentException();
+        }
+        m_listenFd = socket(AF_INET, SOCK_STREAM, 0);
+        if (m_listenFd < 0)
+        {
+            throw SocketFailedException();
+        }
+        int one = 1;
+        setsockopt(m_listenFd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one));
+
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(port);
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (bind(m_listenFd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(m_listenFd);
+            throw IllegalArgumentException();
+        }
+    }
+    else
+    {
+        m_unixPath = inEndpoint.compare(0, 5, "unix:") == 0 ? inEndpoint.substr(5) : inEndpoint;
+        sockaddr_un addr;
+        if (m_unixPath.length() == 0 || m_unixPath.length() >= sizeof(addr.sun_path))
+        {
+            throw IllegalArgumentException();
+        }
+        m_listenFd = socket(AF_UNIX, SOCK_STREAM, 0);
+        if (m_listenFd < 0)
+        {
+            throw SocketFailedException();
+        }
+
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strcpy(addr.sun_path, m_unixPath.c_str());
+        unlink(m_unixPath.c_str());
+        if (bind(m_listenFd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(m_listenFd);
+            throw IllegalArgumentException();
+        }
+    }
+
+    if (listen(m_listenFd, SOMAXCONN) != 0)
+    {
+        close(m_listenFd);
+        throw IllegalArgumentException();
+    }
+    SetNonBlocking(m_listenFd);
+
+    // never read, so once written it stays readable and wakes every worker
+    m_stopFd = eventfd(0, EFD_NONBLOCK);
+    if (m_stopFd < 0)
+    {
+        close(m_listenFd);
+        throw SocketFailedException();
+    }
+}
+
+// Destructor
+QueryServer::~QueryServer()
+{
+    if (m_listenFd >= 0)
+    {
+        close(m_listenFd);
+    }
+    if (m_stopFd >= 0)
+    {
+        close(m_stopFd);
+    }
+    if (m_unixPath.length() > 0)
+    {
+        unlink(m_unixPath.c_str());
+    }
+}
+
+// Run
+void QueryServer::Run()
+{
+    // every worker's epoll set made here, so a failure throws before any starts
+    vector<int> epollFds;
+    for (int i = 0; i < m_threads; ++i)
+    {
+        int epollFd = epoll_create1(0);
+        if (epollFd < 0)
+        {
+            for (size_t e = 0; e < epollFds.size(); ++e)
+            {
+                close(epollFds[e]);
+            }
+            throw SocketFailedException();
+        }
+        epollFds.push_back(epollFd);
+    }
+
+    vector<thread> workers;
+    for (int i = 1; i < m_threads; ++i)
+    {
+        workers.push_back(thread(&QueryServer::WorkerLoop, this, epollFds[i]));
+    }
+
+    // calling thread is worker 0
+    WorkerLoop(epollFds[0]);
+
+    for (size_t i = 0; i < workers.size(); ++i)
+    {
+        workers[i].join();
+    }
+}
+
+// Worker Loop
+void QueryServer::WorkerLoop(int epollFd)
+{
+    map<int, Connection> connections;
+
+    // exclusive wakeups so one connection attempt does not wake every worker
+    epoll_event event;
+    memset(&event, 0, sizeof(event));
+    event.events = EPOLLIN | EPOLLEXCLUSIVE;
+    event.data.fd = m_listenFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, m_listenFd, &event);
+
+    event.events = EPOLLIN;
+    event.data.fd = m_stopFd;
+    epoll_ctl(epollFd, EPOLL_CTL_ADD, m_stopFd, &event);
+
+    epoll_event events[MAX_EPOLL_EVENTS];
+    bool running = true;
+    while (running)
+    {
+        int ready = epoll_wait(epollFd, events, MAX_EPOLL_EVENTS, -1);
+        if (ready < 0 && errno == EINTR)
+        {
+            continue;
+        }
+
+        for (int i = 0; i < ready; ++i)
+        {
+            int fd = events[i].data.fd;
+            if (fd == m_stopFd)
+            {
+                running = false;
+            }
+            else if (fd == m_listenFd)
+            {
+                // accept everything pending, another worker may win some of them
+                int client;
+                while ((client = accept(m_listenFd, NULL, NULL)) >= 0)
+                {
+                    SetNonBlocking(client);
+                    int one = 1;
+                    setsockopt(client, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+
+                    epoll_event clientEvent;
+                    memset(&clientEvent, 0, sizeof(clientEvent));
+                    clientEvent.events = EPOLLIN | EPOLLRDHUP;
+                    clientEvent.data.fd = client;
+                    epoll_ctl(epollFd, EPOLL_CTL_ADD, client, &clientEvent);
+                    connections[client].sent = 0;
+                    connections[client].readDone = false;
+                }
+            }
+            else
+            {
+                Connection& conn = connections[fd];
+                bool open = true;
+
+                if (!conn.readDone && (events[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR)))
+                {
+                    open = ReadRequests(fd, conn);
+                }
+
+                // every answer from this read burst goes out in one write
+                if (open)
+                {
+                    open = FlushResponses(fd, conn);
+                }
+
+                // a half-closed client is done once its answers are all out
+                if (!open || (conn.readDone && conn.sent == conn.out.length()))
+                {
+                    epoll_ctl(epollFd, EPOLL_CTL_DEL, fd, NULL);
+                    close(fd);
+                    connections.erase(fd);
+                    continue;
+                }
+
+                // only ask for writability while a backlog is waiting, and
+                // stop reading while the backlog is large or once nothing
+                // more will be read
+                epoll_event clientEvent;
+                memset(&clientEvent, 0, sizeof(clientEvent));
+                bool reading = !conn.readDone && conn.out.length() - conn.sent <= MAX_PENDING_OUTPUT;
+                clientEvent.events = reading ? EPOLLIN | EPOLLRDHUP : 0;
+                if (conn.out.length() > conn.sent)
+                {
+                    clientEvent.events |= EPOLLOUT;
+                }
+                clientEvent.data.fd = fd;
+                epoll_ctl(epollFd, EPOLL_CTL_MOD, fd, &clientEvent);
+            }
+        }
+    }
+
+    for (map<int, Connection>::iterator it = connections.begin(); it != connections.end(); ++it)
+    {
+        close(it->first);
+    }
+    close(epollFd);
+}
+
+// Read Requests
+bool QueryServer::ReadRequests(int fd, Connection& conn) const
+{
+    char buffer[16384];
+    bool open = true;
+
+    // drain the socket, a pipelining client may have sent many requests.
+    // Lines are answered per read so only a partial one is held, and the
+    // rest is left in the socket while the client is not reading answers
+    while (conn.out.length() - conn.sent <= MAX_PENDING_OUTPUT)
+    {
+        ssize_t got = read(fd, buffer, sizeof(buffer));
+        if (got > 0)
+        {
+            conn.in.append(buffer, got);
+            AnswerLines(conn);
+            if (conn.in.length() > MAX_REQUEST_LENGTH)
+            {
+                conn.out += "ERR request too long\n";
+                conn.in.clear();
+                conn.readDone = true;
+                break;
+            }
+        }
+        else if (got == 0)
+        {
+            // half-closed, the requests already read are still answered
+            conn.readDone = true;
+            break;
+        }
+        else
+        {
+            if (errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)
+            {
+                open = false;
+            }
+            if (errno != EINTR)
+            {
+                break;
+            }
+        }
+    }
+
+    return open;
+}
+
+// Answer Lines
+void QueryServer::AnswerLines(Connection& conn) const
+{
+    // answer every complete line, keep a partial one for the next read
+    size_t start = 0;
+    size_t newline;
+    while ((newline = conn.in.find('\n', start)) != string::npos)
+    {
+        string line = conn.in.substr(start, newline - start);
+        if (line.length() > 0 && line[line.length() - 1] == '\r')
+        {
+            line.erase(line.length() - 1);
+        }
+        start = newline + 1;
+
+        // the answer and the stop come from the same decision
+        if (HandleRequest(line, conn.out))
+        {
+            uint64_t one = 1;
+            ssize_t ignored = write(m_stopFd, &one, sizeof(one));
+            (void)ignored;
+        }
+    }
+    conn.in.erase(0, start);
+}
+
+// Flush Responses
+bool QueryServer::FlushResponses(int fd, Connection& conn) const
+{
+    while (conn.sent < conn.out.length())
+    {
+        ssize_t wrote = send(fd, conn.out.data() + conn.sent, conn.out.length() - conn.sent, MSG_NOSIGNAL);
+        if (wrote > 0)
+        {
+            conn.sent += wrote;
+        }
+        else if (wrote < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (wrote < 0 && (errno == EAGAIN || errno == EWOULDBLOCK))
+        {
+            return true;
+        }
+        else
+        {
+            return false;
+        }
+    }
+    conn.out.clear();
+    conn.sent = 0;
+    return true;
+}
+
+// Handle Request
+bool QueryServer::HandleRequest(const string& line, string& out) const
+{
+    bool stop = false;
+    istringstream request(line);
+    string command;
+    string argument;
+    request >> command >> argument;
+    command = Util::Lower(command);
+
+    ostringstream response;
+    try
+    {
+        if (command == "freq" && argument.length() > 0)
+        {
+            response << "OK " << m_table.GetFrequency(argument);
+        }
+        else if (command == "prefix" && argument.length() > 0)
+        {
+            vector<Node> nodes;
+            m_table.CollectPrefix(argument, nodes);
+            response << "OK " << nodes.size();
+            string words;
+            AppendNodes(nodes, words);
+            response << words;
+        }
+        else if (command == "topk" && argument.length() > 0)
+        {
+            vector<Node> nodes;
+            m_table.CollectTopK(atoi(argument.c_str()), nodes);
+            response << "OK " << nodes.size();
+            string words;
+            AppendNodes(nodes, words);
+            response << words;
+        }
+        else if (command == "bucket" && argument.length() > 0)
+        {
+            // accept either the index or the letter of the bucket
+            int index = isalpha((unsigned char)argument[0]) ? Util::Lower(argument).at(0) - 'a' : atoi(argument.c_str());
+            const SplayTree<Node>& tree = m_table.GetBucket(index);
+            response << "OK " << index << " " << tree.GetNodeCounter() << " " << tree.GetSplayCounter();
+            if (tree.isEmpty())
+            {
+                response << " - 0";
+            }
+            else
+            {
+                response << " " << tree.getRootElement().GetWord() << " " << tree.getRootElement().GetFrequency();
+            }
+        }
+        else if (command == "ping")
+        {
+            response << "OK PONG";
+        }
+        else if (command == "shutdown")
+        {
+            response << "OK BYE";
+            stop = true;
+        }
+        else
+        {
+            response << "ERR unknown command";
+        }
+    }
+    catch (Exceptions &cException)
+    {
+        response.str("");
+        response << "ERR " << cException.GetMessage();
+    }
+    response << "\n";
+    out += response.str();
+    return stop;
+}
+
+// Append Nodes
+void QueryServer::AppendNodes(const vector<Node>& nodes, string& out)
+{
+    ostringstream words;
+    for (size_t i = 0; i < nodes.size(); ++i)
+    {
+        words << " " << nodes[i].GetWord() << " " << nodes[i].GetFrequency();
+    }
+    out += words.str();
+}
+
+// Set Non Blocking
+void QueryServer::SetNonBlocking(int fd)
+{
+    fcntl(fd, F_SETFL, fcntl(fd, F_GETFL, 0) | O_NONBLOCK);
+}
+
+#endif //PROJ3_QUERYSERVER_H
@@ -0,0 +1,235 @@
+/*
+ * File:    ReportSink.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Structured output for reports
+ *
+ * A report is a list of named sections holding named values and series of
+ * (x, y) points. Reports write to a sink instead of cout, so the same
+ * report comes out as aligned text for people or as one JSON object for
+ * scripts.
+ */
+
+#ifndef PROJ3_REPORTSINK_H
+#define PROJ3_REPORTSINK_H
+
+#include <string>
+#include <vector>
+#include <iostream>
+#include <cstdio>
+#include <cmath>
+#include <stdint.h>
+
+using namespace std;
+
+class ReportSink {
+
+public:
+    virtual ~ReportSink() {}
+
+    /**********************************************************************
+     * Name: BeginSection / EndSection
+     * PreCondition: Section name, sections do not nest
+     *
+     * PostCondition: Values until EndSection belong to the section
+     *********************************************************************/
+    virtual void BeginSection(const string& name) = 0;
+    virtual void EndSection() = 0;
+
+    /**********************************************************************
+     * Name: Integer / Real
+     * PreCondition: Open section, key and value
+     *
+     * PostCondition: Value written under the key
+     *********************************************************************/
+    virtual void Integer(const string& key, uint64_t value) = 0;
+    virtual void Real(const string& key, double value) = 0;
+
+    /**********************************************************************
+     * Name: Text
+     * PreCondition: Open section, key and value, which may be user input
+     *
+     * PostCondition: Value written under the key
+     *********************************************************************/
+    virtual void Text(const string& key, const string& value) = 0;
+
+    /**********************************************************************
+     * Name: Series
+     * PreCondition: Open section, key and the (x, y) points
+     *
+     * PostCondition: Points written under the key, in order
+     *********************************************************************/
+    virtual void Series(const string& key, const vector<pair<double, double> >& points) = 0;
+
+    /**********************************************************************
+     * Name: Finish
+     * PreCondition: Every section ended
+     *
+     * PostCondition: Report complete and flushed
+     *********************************************************************/
+    virtual void Finish() = 0;
+};
+
+/*
+ * Text sink, one "key: value" line per value, series one point per line
+ */
+class TextReportSink : public ReportSink {
+
+public:
+    TextReportSink(ostream& out) : m_out(out) {}
+
+    void BeginSection(const string& name)
+    {
+        m_out << "***************" << name << "********************" << endl;
+    }
+
+    void EndSection()
+    {
+        m_out << endl;
+    }
+
+    void Integer(const string& key, uint64_t value)
+    {
+        m_out << key << ": " << value << endl;
+    }
+
+    void Real(const string& key, double value)
+    {
+        char text[64];
+        snprintf(text, sizeof(text), "%.6g", value);
+        m_out << key << ": " << text << endl;
+    }
+
+    void Text(const string& key, const string& value)
+    {
+        m_out << key << ": " << value << endl;
+    }
+
+    void Series(const string& key, const vector<pair<double, double> >& points)
+    {
+        m_out << key << ":" << endl;
+        char text[96];
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            snprintf(text, sizeof(text), "  %14.6g %14.6g", points[i].first, points[i].second);
+            m_out << text << endl;
+        }
+    }
+
+    void Finish()
+    {
+        m_out.flush();
+    }
+
+private:
+    ostream& m_out;
+};
+
+/*
+ * JSON sink, the report is one object with an object per section. Keys
+ * are written as given, they are never user input
+ */
+class JsonReportSink : public ReportSink {
+
+public:
+    JsonReportSink(ostream& out) : m_out(out), m_sections(0), m_fields(0)
+    {
+        m_out << "{";
+    }
+
+    void BeginSection(const string& name)
+    {
+        m_out << (m_sections++ > 0 ? ",\n" : "\n") << "  \"" << name << "\": {";
+        m_fields = 0;
+    }
+
+    void EndSection()
+    {
+        m_out << "\n  }";
+    }
+
+    void Integer(const string& key, uint64_t value)
+    {
+        Key(key);
+        m_out << value;
+    }
+
+    void Real(const string& key, double value)
+    {
+        Key(key);
+        Number(value);
+    }
+
+    void Text(const string& key, const string& value)
+    {
+        Key(key);
+        m_out << "\"";
+        for (size_t i = 0; i < value.length(); ++i)
+        {
+            unsigned char c = value[i];
+            if (c == '"' || c == '\\')
+            {
+                m_out << '\\' << c;
+            }
+            else if (c < 0x20)
+            {
+                char escaped[8];
+                snprintf(escaped, sizeof(escaped), "\\u%04x", c);
+                m_out << escaped;
+            }
+            else
+            {
+                m_out << c;
+            }
+        }
+        m_out << "\"";
+    }
+
+    void Series(const string& key, const vector<pair<double, double> >& points)
+    {
+        Key(key);
+        m_out << "[";
+        for (size_t i = 0; i < points.size(); ++i)
+        {
+            m_out << (i > 0 ? ", [" : "[");
+            Number(points[i].first);
+            m_out << ", ";
+            Number(points[i].second);
+            m_out << "]";
+        }
+        m_out << "]";
+    }
+
+    void Finish()
+    {
+        m_out << "\n}" << endl;
+    }
+
+private:
+    ostream& m_out;
+    int m_sections;
+    int m_fields;
+
+    void Key(const string& key)
+    {
+        m_out << (m_fields++ > 0 ? ",\n" : "\n") << "    \"" << key << "\": ";
+    }
+
+    // JSON has no NaN or infinity
+    void Number(double value)
+    {
+        if (!std::isfinite(value))
+        {
+            m_out << "null";
+            return;
+        }
+        char text[64];
+        snprintf(text, sizeof(text), "%.10g", value);
+        m_out << text;
+    }
+};
+
+#endif //PROJ3_REPORTSINK_H
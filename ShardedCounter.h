@@ -0,0 +1,626 @@
+/*
+ * File:    ShardedCounter.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Multi process counting into a shared memory segment
+ *
+ * The input is cut into byte ranges at whitespace and a forked worker
+ * counts each range. Every worker owns one region of a single shm_open
+ * segment and builds its trees there with a bump allocator: nodes and words
+ * live in the region and link to each other by offsets from the region's
+ * start, so the trees are valid wherever the segment is mapped. The parent
+ * reads the trees in place once the workers exit and merges them into the
+ * HashedSplays table, nothing is serialized.
+ *
+ * A worker that crashes (a bad input, or running out of shared memory)
+ * only loses its own process, the parent reports it with
+ * WorkerFailedException and the table is left untouched.
+ */
+
+#ifndef PROJ3_SHARDEDCOUNTER_H
+#define PROJ3_SHARDEDCOUNTER_H
+
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cctype>
+#include <cstring>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include "HashedSplays.h"
+#include "Frequency.h"
+#include "dsexceptions.h"
+
+// bytes read from the input per pread in a worker
+#define SHARD_READ_SIZE (1 << 20)
+
+/*
+ * View of one region of the segment. Offset 0 is the region's header, so
+ * it doubles as the null offset.
+ */
+class ShmArena {
+
+public:
+    ShmArena(char* base, uint64_t capacity, uint64_t used) : m_base(base), m_capacity(capacity), m_used(used) {}
+
+    // offset of bytes of fresh memory, 0 if the region is full
+    uint64_t Allocate(uint64_t bytes, uint64_t align)
+    {
+        uint64_t offset = (m_used + align - 1) & ~(align - 1);
+        if (offset + bytes > m_capacity)
+        {
+            return 0;
+        }
+        m_used = offset + bytes;
+        return offset;
+    }
+
+    template <typename T>
+    T* At(uint64_t offset) const { return reinterpret_cast<T*>(m_base + offset); }
+
+    uint64_t GetUsed() const { return m_used; }
+
+private:
+    char* m_base;
+    uint64_t m_capacity;
+    uint64_t m_used;
+};
+
+/*
+ * Splay tree node in a region, links are offsets, 0 for none
+ */
+struct ShmNode
+{
+    uint64_t left;
+    uint64_t right;
+    uint64_t word;          // offset of the word's bytes
+    Frequency frequency;
+    uint32_t length;
+};
+
+/*
+ * Top down splay tree whose nodes live in a ShmArena. Same order as
+ * Node::operator<, so an in order walk yields words the way the
+ * HashedSplays trees sort them.
+ */
+class OffsetSplayTree {
+
+public:
+    /**********************************************************************
+     * Name: OffsetSplayTree (Constructor)
+     * PreCondition: Arena holding the tree and the root offset, kept in
+     *               the arena too so the tree outlives this object
+     *
+     * PostCondition: Tree over that root, 0 is empty
+     *********************************************************************/
+    OffsetSplayTree(ShmArena& arena, uint64_t& root) : m_arena(arena), m_root(root) {}
+
+    /**********************************************************************
+     * Name: Increment
+     * PreCondition: Word and its length
+     *
+     * PostCondition: Word counted once more. False if the arena had no
+     *                room for a new word
+     *********************************************************************/
+    bool Increment(const char* word, size_t length);
+
+    /**********************************************************************
+     * Name: InOrder
+     * PreCondition: visit(word, length, frequency)
+     *
+     * PostCondition: visit called on every word in sorted order
+     *********************************************************************/
+    template <typename Visitor>
+    void InOrder(Visitor visit) const;
+
+private:
+    ShmArena& m_arena;
+    uint64_t& m_root;
+
+    ShmNode* At(uint64_t offset) const { return m_arena.At<ShmNode>(offset); }
+    int Compare(const char* word, size_t length, uint64_t node) const;
+    void Splay(const char* word, size_t length);
+};
+
+// Increment
+bool OffsetSplayTree::Increment(const char* word, size_t length)
+{
+    Splay(word, length);
+    int compared = m_root == 0 ? 0 : Compare(word, length, m_root);
+    if (m_root != 0 && compared == 0)
+    {
+        At(m_root)->frequency = CheckedAdd<Frequency>(At(m_root)->frequency, 1);
+        return true;
+    }
+
+    uint64_t node = m_arena.Allocate(sizeof(ShmNode), alignof(ShmNode));
+    uint64_t bytes = node == 0 ? 0 : m_arena.Allocate(length, 1);
+    if (bytes == 0)
+    {
+        return false;
+    }
+    memcpy(m_arena.At<char>(bytes), word, length);
+
+    ShmNode* created = At(node);
+    created->word = bytes;
+    created->length = length;
+    created->frequency = 1;
+    created->left = created->right = 0;
+    if (m_root != 0)
+    {
+        // the root is the neighbour of the new word, split it off
+        ShmNode* root = At(m_root);
+        if (compared < 0)
+        {
+            created->left = root->left;
+            created->right = m_root;
+            root->left = 0;
+        }
+        else
+        {
+            created->right = root->right;
+            created->left = m_root;
+            root->right = 0;
+        }
+    }
+    m_root = node;
+    return true;
+}
+
+// Compare, same order as std::string
+int OffsetSplayTree::Compare(const char* word, size_t length, uint64_t node) const
+{
+    const ShmNode* other = At(node);
+    int compared = memcmp(word, m_arena.At<char>(other->word), min(length, (size_t)other->length));
+    if (compared != 0)
+    {
+        return compared;
+    }
+    return length < other->length ? -1 : (length > other->length ? 1 : 0);
+}
+
+// Splay, top down like SplayTree::splay but without a sentinel node
+void OffsetSplayTree::Splay(const char* word, size_t length)
+{
+    uint64_t t = m_root;
+    if (t == 0)
+    {
+        return;
+    }
+
+    // the header of the left and right trees is not in the arena, offset 0
+    // stands for it while assembling
+    uint64_t headerLeft = 0;
+    uint64_t headerRight = 0;
+    uint64_t leftTreeMax = 0;
+    uint64_t rightTreeMin = 0;
+
+    for (;;)
+    {
+        int compared = Compare(word, length, t);
+        if (compared < 0)
+        {
+            uint64_t child = At(t)->left;
+            if (child == 0)
+                break;
+            if (Compare(word, length, child) < 0)
+            {
+                // rotate with left child
+                At(t)->left = At(child)->right;
+                At(child)->right = t;
+                t = child;
+                if (At(t)->left == 0)
+                    break;
+            }
+            // link right
+            if (rightTreeMin == 0)
+                headerLeft = t;
+            else
+                At(rightTreeMin)->left = t;
+            rightTreeMin = t;
+            t = At(t)->left;
+        }
+        else if (compared > 0)
+        {
+            uint64_t child = At(t)->right;
+            if (child == 0)
+                break;
+            if (Compare(word, length, child) > 0)
+            {
+                // rotate with right child
+                At(t)->right = At(child)->left;
+                At(child)->left = t;
+                t = child;
+                if (At(t)->right == 0)
+                    break;
+            }
+            // link left
+            if (leftTreeMax == 0)
+                headerRight = t;
+            else
+                At(leftTreeMax)->right = t;
+            leftTreeMax = t;
+            t = At(t)->right;
+        }
+        else
+            break;
+    }
+
+    // reassemble
+    if (leftTreeMax == 0)
+        headerRight = At(t)->left;
+    else
+        At(leftTreeMax)->right = At(t)->left;
+    if (rightTreeMin == 0)
+        headerLeft = At(t)->right;
+    else
+        At(rightTreeMin)->left = At(t)->right;
+    At(t)->left = headerRight;
+    At(t)->right = headerLeft;
+    m_root = t;
+}
+
+// In Order, explicit stack
+template <typename Visitor>
+void OffsetSplayTree::InOrder(Visitor visit) const
+{
+    vector<uint64_t> stack;
+    uint64_t t = m_root;
+    while (t != 0 || !stack.empty())
+    {
+        while (t != 0)
+        {
+            stack.push_back(t);
+            t = At(t)->left;
+        }
+        t = stack.back();
+        stack.pop_back();
+        const ShmNode* node = At(t);
+        visit(m_arena.At<char>(node->word), (size_t)node->length, node->frequency);
+        t = node->right;
+    }
+}
+
+class ShardedCounter {
+
+public:
+    /**********************************************************************
+     * Name: ShardedCounter (Constructor)
+     * PreCondition: Table to count into (its filter is used by the
+     *               workers) and the number of worker processes
+     *
+     * PostCondition: Counter ready, nothing forked yet
+     *********************************************************************/
+    ShardedCounter(HashedSplays& inTable, int workers);
+
+    /**********************************************************************
+     * Name: FileReader
+     * PreCondition: Passed value inFileName = input file
+     *
+     * PostCondition: Same counts as HashedSplays::FileReader. Throws
+     *                WorkerFailedException, table untouched, if any worker
+     *                did not finish
+     *********************************************************************/
+    void FileReader(string inFileName);
+
+    /**********************************************************************
+     * Name: PrintShardStats
+     * PreCondition: FileReader has run
+     *
+     * PostCondition: Bytes, tokens, distinct words and shared memory used
+     *                per worker to cout
+     *********************************************************************/
+    void PrintShardStats() const;
+
+private:
+    /*
+     * Start of every region, written by its worker, read by the parent
+     */
+    struct ShardHeader
+    {
+        uint64_t capacity;
+        uint64_t used;
+        uint64_t roots[ALPHABET_SIZE];
+        uint64_t tokens;
+        uint64_t nodes;
+        uint64_t rejected;          // malformed tokens, the parent adds them up
+        int32_t status;             // SHARD_RUNNING until the worker is done
+    };
+
+    enum ShardStatus { SHARD_RUNNING, SHARD_DONE, SHARD_FULL, SHARD_FAILED };
+
+    struct ShardStats
+    {
+        long long first;
+        long long last;
+        uint64_t tokens;
+        uint64_t nodes;
+        uint64_t used;
+    };
+
+    HashedSplays& m_table;
+    int m_workers;
+    vector<ShardStats> m_stats;
+    double m_countSeconds;
+    double m_mergeSeconds;
+
+    vector<long long> Boundaries(int fd, long long size) const;
+    int CountShard(int fd, long long first, long long last, char* region) const;
+    static uint64_t RegionSize(long long bytes);
+};
+
+// Constructor
+ShardedCounter::ShardedCounter(HashedSplays& inTable, int workers)
+    : m_table(inTable), m_workers(workers), m_countSeconds(0), m_mergeSeconds(0)
+{
+    if (workers < 1 || inTable.m_trees != ALPHABET_SIZE)
+    {
+        throw IllegalArgumentException();
+    }
+}
+
+// File Reader
+void ShardedCounter::FileReader(string inFileName)
+{
+    int fd = open(inFileName.c_str(), O_RDONLY);
+    struct stat info;
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+        throw IllegalArgumentException();
+    }
+    vector<long long> bounds = Boundaries(fd, info.st_size);
+
+    // one segment, one region per worker, each sized so that even a shard
+    // of nothing but distinct one letter words fits
+    vector<uint64_t> offsets(m_workers + 1, 0);
+    for (int w = 0; w < m_workers; ++w)
+    {
+        offsets[w + 1] = offsets[w] + RegionSize(bounds[w + 1] - bounds[w]);
+    }
+    char name[64];
+    snprintf(name, sizeof(name), "/wordfreq-%d-%p", (int)getpid(), (void*)this);
+    int shm = shm_open(name, O_CREAT | O_EXCL | O_RDWR, 0600);
+    if (shm < 0)
+    {
+        close(fd);
+        throw WorkerFailedException();
+    }
+    // only the mapping is needed from here on, nothing is left behind
+    shm_unlink(name);
+    char* segment = NULL;
+    if (ftruncate(shm, offsets[m_workers]) == 0)
+    {
+        void* mapped = mmap(NULL, offsets[m_workers], PROT_READ | PROT_WRITE, MAP_SHARED, shm, 0);
+        segment = mapped == MAP_FAILED ? NULL : (char*)mapped;
+    }
+    close(shm);
+    if (segment == NULL)
+    {
+        close(fd);
+        throw WorkerFailedException();
+    }
+
+    chrono::steady_clock::time_point start = chrono::steady_clock::now();
+    cout.flush();
+    vector<pid_t> children;
+    for (int w = 0; w < m_workers; ++w)
+    {
+        ShardHeader* header = reinterpret_cast<ShardHeader*>(segment + offsets[w]);
+        header->status = SHARD_RUNNING;
+        pid_t child = fork();
+        if (child == 0)
+        {
+            // worker, leaves without running the parent's destructors
+            int status = SHARD_FAILED;
+            try
+            {
+                status = CountShard(fd, bounds[w], bounds[w + 1], segment + offsets[w]);
+            }
+            catch (...)
+            {
+            }
+            header->status = status;
+            _exit(status == SHARD_DONE ? 0 : 1);
+        }
+        if (child > 0)
+        {
+            children.push_back(child);
+        }
+        else
+        {
+            header->status = SHARD_FAILED;
+        }
+    }
+
+    bool failed = (int)children.size() != m_workers;
+    for (size_t c = 0; c < children.size(); ++c)
+    {
+        int status = 0;
+        if (waitpid(children[c], &status, 0) < 0 || !WIFEXITED(status) || WEXITSTATUS(status) != 0)
+        {
+            failed = true;
+        }
+    }
+    close(fd);
+    m_countSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+
+    m_stats.assign(m_workers, ShardStats());
+    for (int w = 0; w < m_workers; ++w)
+    {
+        const ShardHeader* header = reinterpret_cast<const ShardHeader*>(segment + offsets[w]);
+        failed = failed || header->status != SHARD_DONE;
+        m_stats[w].first = bounds[w];
+        m_stats[w].last = bounds[w + 1];
+        m_stats[w].tokens = header->tokens;
+        m_stats[w].nodes = header->nodes;
+        m_stats[w].used = header->used;
+    }
+    if (failed)
+    {
+        munmap(segment, offsets[m_workers]);
+        throw WorkerFailedException();
+    }
+
+    // read every worker's trees in place, bucket by bucket
+    start = chrono::steady_clock::now();
+    vector<vector<Node> > buckets(ALPHABET_SIZE);
+    for (int w = 0; w < m_workers; ++w)
+    {
+        ShardHeader* header = reinterpret_cast<ShardHeader*>(segment + offsets[w]);
+        ShmArena arena(segment + offsets[w], header->capacity, header->used);
+        for (int b = 0; b < ALPHABET_SIZE; ++b)
+        {
+            OffsetSplayTree tree(arena, header->roots[b]);
+            tree.InOrder([&](const char* word, size_t length, Frequency frequency) {
+                buckets[b].push_back(Node(string(word, length), frequency));
+            });
+        }
+    }
+    uint64_t rejected = 0;
+    for (int w = 0; w < m_workers; ++w)
+    {
+        rejected += reinterpret_cast<const ShardHeader*>(segment + offsets[w])->rejected;
+    }
+    munmap(segment, offsets[m_workers]);
+    m_table.MergeCounts(buckets);
+    m_table.AddRejects(rejected);
+    m_mergeSeconds = chrono::duration<double>(chrono::steady_clock::now() - start).count();
+}
+
+// Boundaries, shard i is [bounds[i], bounds[i + 1]), every cut on whitespace
+vector<long long> ShardedCounter::Boundaries(int fd, long long size) const
+{
+    vector<long long> bounds(m_workers + 1, size);
+    bounds[0] = 0;
+    char buffer[4096];
+    for (int w = 1; w < m_workers; ++w)
+    {
+        long long cut = max(bounds[w - 1], size * w / m_workers);
+        // move forward to the next whitespace so no token is split
+        while (cut < size)
+        {
+            ssize_t got = pread(fd, buffer, sizeof(buffer), cut);
+            if (got <= 0)
+            {
+                cut = size;
+                break;
+            }
+            ssize_t i = 0;
+            while (i < got && !isspace((unsigned char)buffer[i]))
+            {
+                i++;
+            }
+            cut += i;
+            if (i < got)
+            {
+                break;
+            }
+        }
+        bounds[w] = cut;
+    }
+    return bounds;
+}
+
+// Count Shard, runs in the worker
+int ShardedCounter::CountShard(int fd, long long first, long long last, char* region) const
+{
+    ShardHeader* header = reinterpret_cast<ShardHeader*>(region);
+    header->capacity = RegionSize(last - first);
+    header->tokens = 0;
+    header->rejected = 0;
+    header->nodes = 0;
+    for (int b = 0; b < ALPHABET_SIZE; ++b)
+    {
+        header->roots[b] = 0;
+    }
+    ShmArena arena(region, header->capacity, sizeof(ShardHeader));
+
+    vector<char> buffer(SHARD_READ_SIZE);
+    string raw;
+    string strippedWord;
+    int index;
+    bool full = false;
+    auto emit = [&]() {
+        TokenStatus status = m_table.PrepareWord(raw, strippedWord, index);
+        header->rejected += status == TOKEN_MALFORMED;
+        if (status == TOKEN_COUNTED)
+        {
+            OffsetSplayTree tree(arena, header->roots[index]);
+            uint64_t before = arena.GetUsed();
+            full = full || !tree.Increment(strippedWord.data(), strippedWord.length());
+            header->nodes += arena.GetUsed() != before;
+            header->tokens++;
+        }
+        raw.clear();
+    };
+
+    // same token boundaries as ifs >> word
+    for (long long offset = first; offset < last && !full; )
+    {
+        ssize_t got = pread(fd, buffer.data(), min((long long)buffer.size(), last - offset), offset);
+        if (got <= 0)
+        {
+            return SHARD_FAILED;
+        }
+        for (ssize_t i = 0; i < got; ++i)
+        {
+            if (isspace((unsigned char)buffer[i]))
+            {
+                if (raw.length() > 0)
+                {
+                    emit();
+                }
+            }
+            else
+            {
+                raw += buffer[i];
+            }
+        }
+        offset += got;
+    }
+    if (raw.length() > 0)
+    {
+        emit();
+    }
+    header->used = arena.GetUsed();
+    return full ? SHARD_FULL : SHARD_DONE;
+}
+
+// Region Size, room for a shard that is nothing but distinct words
+uint64_t ShardedCounter::RegionSize(long long bytes)
+{
+    // a token takes at least one byte plus a separator
+    uint64_t tokens = bytes / 2 + 1;
+    uint64_t size = sizeof(ShardHeader) + tokens * (sizeof(ShmNode) + alignof(ShmNode)) + bytes;
+    // regions start page aligned
+    return (size + 4095) & ~(uint64_t)4095;
+}
+
+// Print Shard Stats
+void ShardedCounter::PrintShardStats() const
+{
+    cout << "***************SHARD STATS********************" << endl;
+    printf("%-7s %14s %12s %12s %14s\n", "worker", "bytes", "tokens", "distinct", "shm bytes");
+    for (size_t w = 0; w < m_stats.size(); ++w)
+    {
+        const ShardStats& stats = m_stats[w];
+        printf("%-7zu %14lld %12llu %12llu %14llu\n", w, stats.last - stats.first,
+               (unsigned long long)stats.tokens, (unsigned long long)stats.nodes, (unsigned long long)stats.used);
+    }
+    printf("counting %.3f s, merge %.3f s\n", m_countSeconds, m_mergeSeconds);
+    cout << endl << endl;
+}
+
+#endif //PROJ3_SHARDEDCOUNTER_H
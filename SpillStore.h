@@ -0,0 +1,238 @@
+/*
+ * File:    SpillStore.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Sorted runs of spilled buckets and their k-way merge
+ *
+ * When a table goes over its memory budget a bucket's tree is written out
+ * in order as a run, one "word frequency" line per node like a snapshot,
+ * and the tree is emptied. A word can then be in several runs of its
+ * bucket and in the tree. Merge streams a bucket's words in order with
+ * their frequencies summed, holding one line per run in memory; a bucket
+ * with more than SPILL_FANIN runs is first merged down in passes, so the
+ * number of open files stays bounded too.
+ *
+ * Runs live in a private directory made with mkdtemp, removed with the
+ * store.
+ */
+
+#ifndef PROJ3_SPILLSTORE_H
+#define PROJ3_SPILLSTORE_H
+
+#include <string>
+#include <vector>
+#include <queue>
+#include <fstream>
+#include <functional>
+#include <cstdio>
+#include <cstdlib>
+#include <stdint.h>
+#include <unistd.h>
+#include "SplayTree.h"
+#include "Node.h"
+#include "dsexceptions.h"
+
+#define SPILL_FANIN 64          // runs merged at once
+
+using namespace std;
+
+class SpillStore {
+
+public:
+    /**********************************************************************
+     * Name: SpillStore (Constructor)
+     * PreCondition: Existing directory to make the run directory in, and
+     *               the number of buckets
+     *
+     * PostCondition: Empty store. Throws IllegalArgumentException if the
+     *                run directory cannot be made
+     *********************************************************************/
+    SpillStore(const string& directory, int buckets);
+
+    /**********************************************************************
+     * Name: ~SpillStore
+     * PreCondition: None
+     *
+     * PostCondition: Every run and the run directory removed
+     *********************************************************************/
+    ~SpillStore();
+
+    /**********************************************************************
+     * Name: WriteRun
+     * PreCondition: Bucket index and its tree
+     *
+     * PostCondition: The tree's nodes in order as a new run of the bucket,
+     *                the tree itself unchanged. Throws WriteFailedException
+     *                if the run cannot be written
+     *********************************************************************/
+    void WriteRun(int bucket, const SplayTree<Node>& tree);
+
+    /**********************************************************************
+     * Name: Merge
+     * PreCondition: Bucket index, the part of it still in memory, and a
+     *               visitor
+     *
+     * PostCondition: visit called once per word of the bucket in order,
+     *                with its frequency summed over the runs and the tree
+     *********************************************************************/
+    void Merge(int bucket, const SplayTree<Node>& tree, const function<void(const Node&)>& visit);
+
+    int GetRunCount() const { return m_runCount; }
+    int GetRunCount(int bucket) const { return (int)m_runs[bucket].size(); }
+    uint64_t GetBytesWritten() const { return m_bytes; }
+    const string& GetDirectory() const { return m_directory; }
+
+private:
+    string m_directory;
+    vector<vector<string> > m_runs;     // run files of each bucket
+    int m_nextRun;
+    int m_runCount;                     // runs written by spills
+    uint64_t m_bytes;                   // written to runs, merge passes included
+
+    string NewRunPath();
+
+    // write whatever the source visits, in order, as a run at path
+    void WriteRun(const string& path, const function<void(const function<void(const Node&)>&)>& source);
+
+    // k-way merge of the runs, equal words summed
+    void MergeRuns(const vector<string>& paths, const function<void(const Node&)>& visit);
+};
+
+// Constructor
+SpillStore::SpillStore(const string& directory, int buckets)
+    : m_runs(buckets), m_nextRun(0), m_runCount(0), m_bytes(0)
+{
+    string pattern = directory + "/wfspill.XXXXXX";
+    vector<char> path(pattern.begin(), pattern.end());
+    path.push_back('\0');
+    if (mkdtemp(path.data()) == NULL)
+    {
+        throw IllegalArgumentException();
+    }
+    m_directory = path.data();
+}
+
+// Destructor
+SpillStore::~SpillStore()
+{
+    for (size_t b = 0; b < m_runs.size(); ++b)
+    {
+        for (size_t r = 0; r < m_runs[b].size(); ++r)
+        {
+            remove(m_runs[b][r].c_str());
+        }
+    }
+    rmdir(m_directory.c_str());
+}
+
+// New Run Path
+string SpillStore::NewRunPath()
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/run%06d", m_nextRun++);
+    return m_directory + name;
+}
+
+// Write Run (tree)
+void SpillStore::WriteRun(int bucket, const SplayTree<Node>& tree)
+{
+    string path = NewRunPath();
+    WriteRun(path, [&](const function<void(const Node&)>& visit) { tree.inOrder(visit); });
+    m_runs[bucket].push_back(path);
+    m_runCount++;
+}
+
+// Write Run (source)
+void SpillStore::WriteRun(const string& path, const function<void(const function<void(const Node&)>&)>& source)
+{
+    ofstream ofs(path.c_str());
+    if (!ofs)
+    {
+        throw WriteFailedException();
+    }
+    source([&](const Node& node) {
+        ofs << node.GetWord() << " " << node.GetFrequency() << "\n";
+    });
+    m_bytes += ofs.tellp();
+    if (!ofs.flush())
+    {
+        throw WriteFailedException();
+    }
+}
+
+// Merge
+void SpillStore::Merge(int bucket, const SplayTree<Node>& tree, const function<void(const Node&)>& visit)
+{
+    // merge passes until one final merge can take every run at once
+    vector<string>& runs = m_runs[bucket];
+    while (runs.size() > SPILL_FANIN)
+    {
+        vector<string> group(runs.begin(), runs.begin() + SPILL_FANIN);
+        string path = NewRunPath();
+        WriteRun(path, [&](const function<void(const Node&)>& write) { MergeRuns(group, write); });
+        for (size_t r = 0; r < group.size(); ++r)
+        {
+            remove(group[r].c_str());
+        }
+        runs.erase(runs.begin(), runs.begin() + SPILL_FANIN);
+        runs.push_back(path);
+    }
+
+    // the tree joins as one more run, removed again after the merge
+    vector<string> sources = runs;
+    string treeRun;
+    if (tree.GetNodeCounter() > 0)
+    {
+        treeRun = NewRunPath();
+        WriteRun(treeRun, [&](const function<void(const Node&)>& write) { tree.inOrder(write); });
+        sources.push_back(treeRun);
+    }
+    MergeRuns(sources, visit);
+    if (treeRun.length() > 0)
+    {
+        remove(treeRun.c_str());
+    }
+}
+
+// Merge Runs
+void SpillStore::MergeRuns(const vector<string>& paths, const function<void(const Node&)>& visit)
+{
+    vector<ifstream> readers(paths.size());
+    for (size_t r = 0; r < paths.size(); ++r)
+    {
+        readers[r].open(paths[r].c_str());
+    }
+
+    // smallest word on top, ties by run
+    typedef pair<string, size_t> Head;
+    priority_queue<Head, vector<Head>, greater<Head> > heads;
+    vector<Frequency> frequencies(readers.size(), 0);
+    string word;
+    for (size_t r = 0; r < readers.size(); ++r)
+    {
+        if (readers[r] >> word >> frequencies[r])
+        {
+            heads.push(make_pair(word, r));
+        }
+    }
+    while (!heads.empty())
+    {
+        Node merged(heads.top().first, 0);
+        while (!heads.empty() && heads.top().first == merged.GetWord())
+        {
+            size_t r = heads.top().second;
+            heads.pop();
+            merged.AddFrequency(frequencies[r]);
+            if (readers[r] >> word >> frequencies[r])
+            {
+                heads.push(make_pair(word, r));
+            }
+        }
+        visit(merged);
+    }
+}
+
+#endif //PROJ3_SPILLSTORE_H
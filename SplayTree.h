@@ -18,24 +18,53 @@
  *              GetNodeCounter
  *              GetSplayCounter
  *              PrintSubstringNodes (Bootstrap and Worker)
+ *              find, findBatch, inOrder, inOrderFrom (read only, no splaying)
+ *              setSplayPolicy, access (splay always, never, or a random fraction)
+ *         static newNode in insert and static header in splay made per tree
+ *              (spareNode, header) so different trees can be used from different threads
+ *         Items compared through Order::Less, KeyOrder (a < b) unless given,
+ *              see BucketTraits.h
+ *         Nodes made and freed through allocNode and freeNode, from a
+ *              NodeArena once setArena is called, see NodeArena.h
  */
 
 #ifndef SPLAY_TREE_H
 #define SPLAY_TREE_H
 
 #include "dsexceptions.h"
+#include "BucketTraits.h"
+#include "NodeArena.h"
 #include <iostream>        // For NULL
+#include <new>
+#include <vector>
+#include <utility>
+#include <stdint.h>
 
 using namespace std;
 
+// Splay policy, decides whether an access moves the item to the root
+// SPLAY_ALWAYS    --> classic splay tree, every access splays
+// SPLAY_NEVER     --> plain binary search tree, nothing is rotated
+// SPLAY_SOMETIMES --> randomized splaying, a given fraction of accesses splay
+enum SplayPolicy { SPLAY_ALWAYS, SPLAY_NEVER, SPLAY_SOMETIMES };
+
 // SplayTree class
 //
-// CONSTRUCTION: with no parameters
+// CONSTRUCTION: with no parameters. Order::Less( a, b ) orders the items
 //
 // ******************PUBLIC OPERATIONS*********************
-// void insert( x )       --> Insert x
+// void insert( x )       --> Insert x (copied, or moved from an rvalue)
+// Comparable *emplace( args ) --> Build an item from args in place and insert it
+// void insertSorted( v, m ) --> Insert or merge a sorted batch of items
 // void remove( x )       --> Remove x
 // bool contains( x )     --> Return true if x is present
+// Comparable *access( x )--> Return pointer to x or NULL, splays per policy
+// void setSplayPolicy( p, f ) --> Choose when accesses splay
+// void setArena( a )     --> Take nodes from arena a, NULL for new
+// Comparable *find( x )  --> Return pointer to x or NULL, never splays
+// void findBatch( v, n, r ) --> find for n items, searches interleaved
+// void inOrder( f )      --> Call f on every item in sorted order, never splays
+// void inOrderFrom( x, f ) --> Call f on items from x on until it returns false
 // Comparable findMin( )  --> Return smallest item
 // Comparable findMax( )  --> Return largest item
 // bool isEmpty( )        --> Return true if empty; else false
@@ -44,7 +73,7 @@ using namespace std;
 // ******************ERRORS********************************
 // Throws UnderflowException as warranted
 
-template <typename Comparable>
+template <typename Comparable, typename Order = KeyOrder<Comparable> >
 class SplayTree
 {
 
@@ -58,6 +87,11 @@ class SplayTree
         root = nullNode;
         splayCounter = 0;
         nodeCounter = 0;
+        splayPolicy = SPLAY_ALWAYS;
+        splayThreshold = UINT32_MAX;
+        splaySeed = 2463534242u;
+        spareNode = NULL;
+        arena = NULL;
     }
 
     SplayTree( const SplayTree & rhs )
@@ -67,6 +101,11 @@ class SplayTree
         root = nullNode;
         splayCounter = 0;
         nodeCounter = 0;
+        splayPolicy = SPLAY_ALWAYS;
+        splayThreshold = UINT32_MAX;
+        splaySeed = 2463534242u;
+        spareNode = NULL;
+        arena = NULL;
         *this = rhs;
     }
 
@@ -74,6 +113,7 @@ class SplayTree
     {
         makeEmpty( );
         delete nullNode;
+        freeNode( spareNode );
     }
 
     /**
@@ -94,8 +134,11 @@ class SplayTree
         while( ptr->left != nullNode )
             ptr = ptr->left;
 
-        splay( ptr->element, root );
-        splayCounter++;
+        if( shouldSplay( ) )
+        {
+            splay( ptr->element, root );
+            splayCounter++;
+        }
         return ptr->element;
     }
 
@@ -117,19 +160,196 @@ class SplayTree
         while( ptr->right != nullNode )
             ptr = ptr->right;
 
-        splay( ptr->element, root );
-        splayCounter++;
+        if( shouldSplay( ) )
+        {
+            splay( ptr->element, root );
+            splayCounter++;
+        }
         return ptr->element;
     }
 
 
     bool contains( const Comparable & x )
+    {
+        return access( x ) != NULL;
+    }
+
+    /**
+     * Find x and return a pointer to it so it can be updated in place,
+     * or NULL if not found. Whether the item is splayed to the root is
+     * decided by the splay policy.
+     */
+    Comparable * access( const Comparable & x )
     {
         if( isEmpty( ) )
-            return false;
+            return NULL;
+        if( !shouldSplay( ) )
+            return const_cast<Comparable *>( find( x ) );
         splay( x, root );
         splayCounter++;
-        return root->element == x;
+        if( isLess( x, root->element ) || isLess( root->element, x ) )
+            return NULL;
+        return &root->element;
+    }
+
+    /**
+     * Choose when accesses splay. fraction is only used by SPLAY_SOMETIMES
+     * and is the share of accesses (0.0 to 1.0) that splay.
+     */
+    void setSplayPolicy( SplayPolicy policy, double fraction = 1.0 )
+    {
+        if( fraction < 0.0 || fraction > 1.0 )
+            throw IllegalArgumentException( );
+        splayPolicy = policy;
+        splayThreshold = fraction >= 1.0 ? UINT32_MAX : (uint32_t)( fraction * 4294967296.0 );
+    }
+
+    /**
+     * Take new nodes from a, or from new again if a is NULL. Only while
+     * the tree is empty, a must outlive the tree.
+     */
+    void setArena( NodeArena *a )
+    {
+        if( !isEmpty( ) )
+            throw IllegalArgumentException( );
+        freeNode( spareNode );
+        spareNode = NULL;
+        arena = a;
+    }
+
+    SplayPolicy getSplayPolicy( ) const
+    {
+        return splayPolicy;
+    }
+
+    /**
+     * Find x without splaying. Does not modify the tree, so any number
+     * of threads may call it concurrently as long as nobody is writing.
+     * Return a pointer to the matching item, or NULL if not found.
+     */
+    const Comparable * find( const Comparable & x ) const
+    {
+        BinaryNode *t = root;
+
+        while( t != nullNode )
+        {
+            if( isLess( x, t->element ) )
+                t = t->left;
+            else if( isLess( t->element, x ) )
+                t = t->right;
+            else
+                return &t->element;
+        }
+        return NULL;
+    }
+
+    /**
+     * Find count items without splaying, found[ i ] is the match for
+     * items[ i ] or NULL. Up to eight searches run interleaved: every round
+     * moves each one level down and prefetches the node it goes to, so
+     * their cache misses overlap instead of following one another. Read
+     * only like find.
+     */
+    void findBatch( const Comparable * items, size_t count, const Comparable ** found ) const
+    {
+        const size_t lanes = 8;
+        BinaryNode *at[ lanes ];
+        size_t which[ lanes ];
+        size_t active = 0;
+        size_t next = 0;
+
+        while( active < lanes && next < count )
+        {
+            at[ active ] = root;
+            which[ active++ ] = next++;
+        }
+        while( active > 0 )
+        {
+            for( size_t l = 0; l < active; )
+            {
+                BinaryNode *t = at[ l ];
+                const Comparable & x = items[ which[ l ] ];
+                if( t != nullNode && isLess( x, t->element ) )
+                    t = t->left;
+                else if( t != nullNode && isLess( t->element, x ) )
+                    t = t->right;
+                else
+                {
+                    // done, the lane takes the next search or the last lane
+                    found[ which[ l ] ] = t == nullNode ? NULL : &t->element;
+                    if( next < count )
+                    {
+                        at[ l ] = root;
+                        which[ l++ ] = next++;
+                    }
+                    else
+                    {
+                        at[ l ] = at[ --active ];
+                        which[ l ] = which[ active ];
+                    }
+                    continue;
+                }
+                __builtin_prefetch( t );
+                at[ l++ ] = t;
+            }
+        }
+    }
+
+    /**
+     * Visit every item in sorted order without splaying.
+     * Uses an explicit stack, so degenerate trees are safe.
+     */
+    template <typename Visitor>
+    void inOrder( Visitor visit ) const
+    {
+        vector<BinaryNode *> stack;
+        BinaryNode *t = root;
+
+        while( t != nullNode || !stack.empty( ) )
+        {
+            while( t != nullNode )
+            {
+                stack.push_back( t );
+                t = t->left;
+            }
+            t = stack.back( );
+            stack.pop_back( );
+            visit( t->element );
+            t = t->right;
+        }
+    }
+
+    /**
+     * Visit the items not less than low in sorted order without splaying,
+     * until visit returns false. A range search costs the depth of low
+     * plus the items visited.
+     */
+    template <typename Visitor>
+    void inOrderFrom( const Comparable & low, Visitor visit ) const
+    {
+        vector<BinaryNode *> stack;
+        BinaryNode *t = root;
+
+        // the path to low, keeping the nodes the range starts at
+        while( t != nullNode )
+        {
+            if( isLess( t->element, low ) )
+                t = t->right;
+            else
+            {
+                stack.push_back( t );
+                t = t->left;
+            }
+        }
+        while( !stack.empty( ) )
+        {
+            t = stack.back( );
+            stack.pop_back( );
+            if( !visit( t->element ) )
+                return;
+            for( t = t->right; t != nullNode; t = t->left )
+                stack.push_back( t );
+        }
     }
 
     bool isEmpty( ) const
@@ -154,60 +374,142 @@ class SplayTree
         reclaimMemory( root );
         root = nullNode;
      *******************************/
-        while( !isEmpty( ) )
+        // explicit stack instead of splaying the max out one at a time,
+        // so the splay policy does not matter and it stays linear
+        vector<BinaryNode *> stack;
+        if( !isEmpty( ) )
+            stack.push_back( root );
+        while( !stack.empty( ) )
         {
-            findMax( );        // Splay max item to root
-            remove( root->element );
+            BinaryNode *t = stack.back( );
+            stack.pop_back( );
+            if( t->left != nullNode )
+                stack.push_back( t->left );
+            if( t->right != nullNode )
+                stack.push_back( t->right );
+            freeNode( t );
         }
+        root = nullNode;
+        nodeCounter = 0;
     }
 
     void insert( const Comparable & x )
     {
-        static BinaryNode *newNode = NULL;
+        spare( )->element = x;
+        linkSpare( );
+    }
 
-        if( newNode == NULL )
-            newNode = new BinaryNode;
-        newNode->element = x;
+    /**
+     * Insert x, taking over its contents instead of copying them.
+     */
+    void insert( Comparable && x )
+    {
+        spare( )->element = std::move( x );
+        linkSpare( );
+    }
 
-        if( root == nullNode )
+    /**
+     * Construct the item from args in the node that will hold it and
+     * insert it, no temporary is made. Return a pointer to the item in the
+     * tree, which is the one already there if it was a duplicate.
+     */
+    template <typename... Args>
+    Comparable * emplace( Args &&... args )
+    {
+        if( spareNode == NULL )
+            spareNode = allocNode( InPlace( ), std::forward<Args>( args )... );
+        else
         {
-            newNode->left = newNode->right = nullNode;
-            root = newNode;
-            nodeCounter++;
+            // node kept from a duplicate, its item is rebuilt where it is
+            spareNode->element.~Comparable( );
+            try
+            {
+                new ( &spareNode->element ) Comparable( std::forward<Args>( args )... );
+            }
+            catch( ... )
+            {
+                new ( &spareNode->element ) Comparable( );
+                throw;
+            }
         }
-        else
+        return linkSpare( );
+    }
+
+    /**
+     * Insert items, sorted and without duplicates. merge( existing, item )
+     * is called instead for items already in the tree. New items are
+     * moved out of the vector, not copied.
+     * A batch that is small next to the tree is inserted item by item in
+     * sorted order, so each splay starts near where the last one ended.
+     * A larger one is merged with the tree in one in-order pass and the
+     * nodes are relinked into a balanced tree, nothing is splayed.
+     */
+    template <typename Merge>
+    void insertSorted( vector<Comparable> & items, Merge merge )
+    {
+        // m log n searches against an n + m merge
+        size_t logSize = 1;
+        while( ( (uint64_t)1 << logSize ) <= nodeCounter )
+            logSize++;
+        if( items.size( ) * logSize < nodeCounter )
         {
-            splay( x, root );
-            splayCounter++;
-            if( x < root->element )
+            for( size_t i = 0; i < items.size( ); ++i )
             {
-                newNode->left = root->left;
-                newNode->right = root;
-                root->left = nullNode;
-                root = newNode;
-                nodeCounter++;
+                Comparable *found = access( items[ i ] );
+                if( found != NULL )
+                    merge( *found, items[ i ] );
+                else
+                    insert( std::move( items[ i ] ) );
             }
-            else
-            if( root->element < x )
+            return;
+        }
+
+        vector<BinaryNode *> merged;
+        merged.reserve( nodeCounter + items.size( ) );
+        vector<BinaryNode *> stack;
+        BinaryNode *t = root;
+        size_t i = 0;
+
+        while( t != nullNode || !stack.empty( ) )
+        {
+            while( t != nullNode )
             {
-                newNode->right = root->right;
-                newNode->left = root;
-                root->right = nullNode;
-                root = newNode;
+                stack.push_back( t );
+                t = t->left;
+            }
+            t = stack.back( );
+            stack.pop_back( );
+            for( ; i < items.size( ) && isLess( items[ i ], t->element ); ++i )
+            {
+                merged.push_back( allocNode( std::move( items[ i ] ), nullNode, nullNode ) );
                 nodeCounter++;
             }
-            else
-                return;
+            if( i < items.size( ) && !isLess( t->element, items[ i ] ) )
+                merge( t->element, items[ i++ ] );
+            merged.push_back( t );
+            t = t->right;
+        }
+        for( ; i < items.size( ); ++i )
+        {
+            merged.push_back( allocNode( std::move( items[ i ] ), nullNode, nullNode ) );
+            nodeCounter++;
         }
-        newNode = NULL;   // So next insert will call new
+
+        root = buildBalanced( merged, 0, merged.size( ) );
     }
 
     void remove( const Comparable & x )
     {
         BinaryNode *newTree;
 
+        if( isEmpty( ) )
+            return;
+
             // If x is found, it will be at the root
-        if( !contains( x ) )
+            // Always splays, whatever the policy, removal depends on it
+        splay( x, root );
+        splayCounter++;
+        if( isLess( x, root->element ) || isLess( root->element, x ) )
             return;   // Item not found; do nothing
 
         if( root->left == nullNode )
@@ -225,7 +527,7 @@ class SplayTree
             nodeCounter--;
             newTree->right = root->right;
         }
-        delete root;
+        freeNode( root );
         root = newTree;
     }
 
@@ -235,6 +537,9 @@ class SplayTree
         {
             makeEmpty( );
             root = clone( rhs.root );
+            nodeCounter = rhs.nodeCounter;
+            splayPolicy = rhs.splayPolicy;
+            splayThreshold = rhs.splayThreshold;
         }
 
         return *this;
@@ -252,7 +557,7 @@ class SplayTree
     /*
      * Implemented helper getNodeCounter
      */
-    int GetNodeCounter()
+    uint64_t GetNodeCounter() const
     {
         // get number of nodes, data member incremented in insert, decremented in remove
         return nodeCounter;
@@ -260,7 +565,7 @@ class SplayTree
     /*
      * Implemented helper getSplayCounter
      */
-    int GetSplayCounter()
+    uint64_t GetSplayCounter() const
     {
         // get number of splays that occurred, data member incremented after each call to splay function
         return splayCounter;
@@ -275,6 +580,11 @@ class SplayTree
         return root->element;
     }
 
+    const Comparable& getRootElement() const
+    {
+        return root->element;
+    }
+
     /*
      * Print Substring Nodes, print tree function that only prints nodes containing a partition of the word
      */
@@ -294,6 +604,13 @@ class SplayTree
 
 
 private:
+    static bool isLess( const Comparable & a, const Comparable & b )
+    {
+        return Order::Less( a, b );
+    }
+
+    struct InPlace { };         // selects the node constructor taking item arguments
+
     struct BinaryNode
     {
         Comparable  element;
@@ -303,12 +620,137 @@ private:
         BinaryNode( ) : left( NULL ), right( NULL ) { }
         BinaryNode( const Comparable & theElement, BinaryNode *lt, BinaryNode *rt )
             : element( theElement ), left( lt ), right( rt ) { }
+        BinaryNode( Comparable && theElement, BinaryNode *lt, BinaryNode *rt )
+            : element( std::move( theElement ) ), left( lt ), right( rt ) { }
+        template <typename... Args>
+        BinaryNode( InPlace, Args &&... args )
+            : element( std::forward<Args>( args )... ), left( NULL ), right( NULL ) { }
     };
 
     BinaryNode *root;
     BinaryNode *nullNode;
-    int splayCounter;
-    int nodeCounter;
+    uint64_t splayCounter;
+    uint64_t nodeCounter;
+    SplayPolicy splayPolicy;
+    uint32_t splayThreshold;    // SPLAY_SOMETIMES splays when a draw is below this
+    uint32_t splaySeed;         // xorshift state, per tree so trees do not share
+    BinaryNode *spareNode;      // preallocated node for the next insert
+    BinaryNode header;          // scratch for splay, per tree so trees do not share
+    NodeArena *arena;           // where nodes come from, NULL for new
+
+    /**
+     * Internal method to make a node, in the arena if there is one.
+     */
+    template <typename... Args>
+    BinaryNode * allocNode( Args &&... args ) const
+    {
+        if( arena == NULL )
+            return new BinaryNode( std::forward<Args>( args )... );
+        return new ( arena->Allocate( sizeof( BinaryNode ) ) ) BinaryNode( std::forward<Args>( args )... );
+    }
+
+    /**
+     * Internal method to free a node made by allocNode, NULL is ignored.
+     */
+    void freeNode( BinaryNode *t )
+    {
+        if( t == NULL )
+            return;
+        if( arena == NULL )
+            delete t;
+        else
+        {
+            t->~BinaryNode( );
+            arena->Release( t, sizeof( BinaryNode ) );
+        }
+    }
+
+    /**
+     * Internal method to get the node the next insert will use. A node
+     * left over from an insert that found a duplicate is reused.
+     */
+    BinaryNode * spare( )
+    {
+        if( spareNode == NULL )
+            spareNode = allocNode( );
+        return spareNode;
+    }
+
+    /**
+     * Internal method to link the spare node, holding the new item, into
+     * the tree. Return the item in the tree, the existing one for a
+     * duplicate, in which case the spare node is kept for next time.
+     */
+    Comparable * linkSpare( )
+    {
+        BinaryNode *newNode = spareNode;
+        const Comparable & x = newNode->element;
+
+        if( root == nullNode )
+        {
+            newNode->left = newNode->right = nullNode;
+            root = newNode;
+            nodeCounter++;
+        }
+        else if( !shouldSplay( ) )
+        {
+            // plain leaf insertion, nothing on the path is rotated
+            BinaryNode **link = &root;
+            while( *link != nullNode )
+            {
+                if( isLess( x, (*link)->element ) )
+                    link = &(*link)->left;
+                else if( isLess( (*link)->element, x ) )
+                    link = &(*link)->right;
+                else
+                    return &(*link)->element;
+            }
+            newNode->left = newNode->right = nullNode;
+            *link = newNode;
+            nodeCounter++;
+        }
+        else
+        {
+            splay( x, root );
+            splayCounter++;
+            if( isLess( x, root->element ) )
+            {
+                newNode->left = root->left;
+                newNode->right = root;
+                root->left = nullNode;
+                root = newNode;
+                nodeCounter++;
+            }
+            else
+            if( isLess( root->element, x ) )
+            {
+                newNode->right = root->right;
+                newNode->left = root;
+                root->right = nullNode;
+                root = newNode;
+                nodeCounter++;
+            }
+            else
+                return &root->element;
+        }
+        spareNode = NULL;   // So next insert will call new
+        return &newNode->element;
+    }
+
+    /**
+     * Internal method to decide if this access splays, per the policy.
+     */
+    bool shouldSplay( )
+    {
+        if( splayPolicy == SPLAY_ALWAYS )
+            return true;
+        if( splayPolicy == SPLAY_NEVER )
+            return false;
+        splaySeed ^= splaySeed << 13;
+        splaySeed ^= splaySeed >> 17;
+        splaySeed ^= splaySeed << 5;
+        return splaySeed < splayThreshold;
+    }
 
     /**
      * Internal method to reclaim internal nodes in subtree t.
@@ -320,7 +762,7 @@ private:
         {
             reclaimMemory( t->left );
             reclaimMemory( t->right );
-            delete t;
+            freeNode( t );
         }
     }
     
@@ -347,7 +789,22 @@ private:
         if( t == t->left )  // Cannot test against nullNode!!!
             return nullNode;
         else
-            return new BinaryNode( t->element, clone( t->left ), clone( t->right ) );
+            return allocNode( t->element, clone( t->left ), clone( t->right ) );
+    }
+
+    /**
+     * Internal method to link nodes[ first, last ), in sorted order,
+     * into a balanced subtree. Recursion depth is only log n.
+     */
+    BinaryNode * buildBalanced( vector<BinaryNode *> & nodes, size_t first, size_t last )
+    {
+        if( first == last )
+            return nullNode;
+        size_t middle = first + ( last - first ) / 2;
+        BinaryNode *t = nodes[ middle ];
+        t->left = buildBalanced( nodes, first, middle );
+        t->right = buildBalanced( nodes, middle + 1, last );
+        return t;
     }
 
         // Tree manipulations
@@ -379,7 +836,6 @@ private:
     void splay( const Comparable & x, BinaryNode * & t )
     {
         BinaryNode *leftTreeMax, *rightTreeMin;
-        static BinaryNode header;
 
         header.left = header.right = nullNode;
         leftTreeMax = rightTreeMin = &header;
@@ -387,9 +843,9 @@ private:
         nullNode->element = x;   // Guarantee a match
 
         for( ; ; )
-            if( x < t->element )
+            if( isLess( x, t->element ) )
             {
-                if( x < t->left->element )
+                if( isLess( x, t->left->element ) )
                     rotateWithLeftChild( t );
                 if( t->left == nullNode )
                     break;
@@ -398,9 +854,9 @@ private:
                 rightTreeMin = t;
                 t = t->left;
             }
-            else if( t->element < x )
+            else if( isLess( t->element, x ) )
             {
-                if( t->right->element < x )
+                if( isLess( t->right->element, x ) )
                     rotateWithRightChild( t );
                 if( t->right == nullNode )
                     break;
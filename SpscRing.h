@@ -0,0 +1,165 @@
+/*
+ * File:    SpscRing.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Lock free single producer / single consumer ring buffer
+ *
+ * Exactly one thread may push and exactly one other thread may pop. The
+ * producer owns the tail and the consumer owns the head; each only reads
+ * the other's index, with acquire/release ordering, and keeps a cached
+ * copy of it so most operations touch no shared cache line at all.
+ */
+
+#ifndef PROJ3_SPSCRING_H
+#define PROJ3_SPSCRING_H
+
+#include <vector>
+#include <atomic>
+#include <thread>
+#include <new>
+#include <cstdlib>
+#include <stddef.h>
+#include "dsexceptions.h"
+
+// keeps the producer and consumer indices on separate cache lines
+#define CACHE_LINE_SIZE 64
+
+template <typename T>
+class SpscRing
+{
+  public:
+    /**
+     * Construct a ring holding up to capacity items, a power of two.
+     */
+    explicit SpscRing( size_t capacity )
+      : slots( capacity ), mask( capacity - 1 ), head( 0 ), tail( 0 ),
+        cachedHead( 0 ), cachedTail( 0 )
+    {
+        if( capacity < 2 || ( capacity & ( capacity - 1 ) ) != 0 )
+            throw IllegalArgumentException( );
+    }
+
+    /**
+     * Allocate a ring on the heap. Plain new only aligns to the largest
+     * fundamental alignment before C++17, not to the cache line the
+     * indices are laid out on. Release it with destroy.
+     */
+    static SpscRing * create( size_t capacity )
+    {
+        void *memory;
+        if( posix_memalign( &memory, alignof( SpscRing ), sizeof( SpscRing ) ) != 0 )
+            throw OutOfMemoryException( );
+        try
+        {
+            return new ( memory ) SpscRing( capacity );
+        }
+        catch( ... )
+        {
+            free( memory );
+            throw;
+        }
+    }
+
+    /**
+     * Free a ring from create, NULL is ignored.
+     */
+    static void destroy( SpscRing *ring )
+    {
+        if( ring != NULL )
+        {
+            ring->~SpscRing( );
+            free( ring );
+        }
+    }
+
+    /**
+     * Producer only. Return false if the ring is full.
+     */
+    bool tryPush( const T & x )
+    {
+        size_t t = tail.load( memory_order_relaxed );
+        if( t - cachedHead == slots.size( ) )
+        {
+            cachedHead = head.load( memory_order_acquire );
+            if( t - cachedHead == slots.size( ) )
+                return false;
+        }
+        slots[ t & mask ] = x;
+        tail.store( t + 1, memory_order_release );
+        return true;
+    }
+
+    /**
+     * Consumer only. Return false if the ring is empty.
+     */
+    bool tryPop( T & x )
+    {
+        size_t h = head.load( memory_order_relaxed );
+        if( h == cachedTail )
+        {
+            cachedTail = tail.load( memory_order_acquire );
+            if( h == cachedTail )
+                return false;
+        }
+        x = slots[ h & mask ];
+        head.store( h + 1, memory_order_release );
+        return true;
+    }
+
+    /**
+     * Producer only. Spin (yielding) until there is room.
+     * Return the number of times the ring was found full.
+     */
+    size_t push( const T & x )
+    {
+        size_t waits = 0;
+        while( !tryPush( x ) )
+        {
+            waits++;
+            this_thread::yield( );
+        }
+        return waits;
+    }
+
+    /**
+     * Consumer only. Spin (yielding) until there is an item.
+     * Return the number of times the ring was found empty.
+     */
+    size_t pop( T & x )
+    {
+        size_t waits = 0;
+        while( !tryPop( x ) )
+        {
+            waits++;
+            this_thread::yield( );
+        }
+        return waits;
+    }
+
+    /**
+     * Items in the ring, exact only when neither side is running.
+     */
+    size_t size( ) const
+    {
+        return tail.load( memory_order_acquire ) - head.load( memory_order_acquire );
+    }
+
+    size_t capacity( ) const
+    {
+        return slots.size( );
+    }
+
+  private:
+    vector<T> slots;
+    size_t mask;
+
+    alignas( CACHE_LINE_SIZE ) atomic<size_t> head;   // next slot to pop
+    alignas( CACHE_LINE_SIZE ) atomic<size_t> tail;   // next slot to push
+    alignas( CACHE_LINE_SIZE ) size_t cachedHead;     // producer's view of head
+    alignas( CACHE_LINE_SIZE ) size_t cachedTail;     // consumer's view of tail
+};
+
+#endif //PROJ3_SPSCRING_H
@@ -0,0 +1,393 @@
+/*
+ * File:    TokenFilter.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Pre-insert token filter: stopwords, length limits and light stemming
+ *
+ * Runs after Util::Strip/Lower and before the table insert, so dropped
+ * tokens never touch a SplayTree. The stopword set is compiled into a
+ * minimal perfect hash (hash and displace): one hash of the word picks a
+ * bucket, the bucket's displacement picks the only slot the word can be in,
+ * and a single compare against that slot decides membership.
+ */
+
+#ifndef PROJ3_TOKENFILTER_H
+#define PROJ3_TOKENFILTER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
+#include <stdint.h>
+#include "Util.h"
+#include "dsexceptions.h"
+
+// most displacements tried for a bucket before giving up on the key set
+#define MAX_DISPLACEMENT 1000000
+
+// built in English stopword list, lowercase
+static const char* const BUILTIN_STOPWORDS[] = {
+    "a", "about", "above", "after", "again", "against", "all", "am", "an", "and",
+    "any", "are", "as", "at", "be", "because", "been", "before", "being", "below",
+    "between", "both", "but", "by", "can", "could", "did", "do", "does", "doing",
+    "down", "during", "each", "few", "for", "from", "further", "had", "has", "have",
+    "having", "he", "her", "here", "hers", "herself", "him", "himself", "his", "how",
+    "i", "if", "in", "into", "is", "it", "it's", "its", "itself", "me", "more", "most",
+    "my", "myself", "no", "nor", "not", "of", "off", "on", "once", "only", "or",
+    "other", "our", "ours", "ourselves", "out", "over", "own", "same", "she", "should",
+    "so", "some", "such", "than", "that", "the", "their", "theirs", "them",
+    "themselves", "then", "there", "these", "they", "this", "those", "through", "to",
+    "too", "under", "until", "up", "very", "was", "we", "were", "what", "when",
+    "where", "which", "while", "who", "whom", "why", "will", "with", "would", "you",
+    "your", "yours", "yourself", "yourselves"
+};
+
+class PerfectHashSet {
+
+public:
+    /**********************************************************************
+     * Name: PerfectHashSet (Constructor)
+     * PreCondition: None
+     *
+     * PostCondition: Empty set
+     *********************************************************************/
+    PerfectHashSet() : m_maxLength(0) {}
+
+    /**********************************************************************
+     * Name: Build
+     * PreCondition: Keys of the set, duplicates allowed
+     *
+     * PostCondition: Minimal perfect hash over the distinct keys
+     *********************************************************************/
+    void Build(vector<string> keys);
+
+    /**********************************************************************
+     * Name: Contains
+     * PreCondition: Word and its length
+     *
+     * PostCondition: True if the word is one of the keys
+     *********************************************************************/
+    bool Contains(const char* word, size_t length) const;
+
+    size_t Size() const { return m_offsets.size(); }
+
+    // FNV-1a
+    static uint64_t Hash(const char* word, size_t length);
+
+private:
+    vector<uint32_t> m_displacements;   // one per bucket
+    vector<uint32_t> m_offsets;         // key start in m_pool, per slot
+    vector<uint8_t> m_lengths;          // key length, per slot
+    string m_pool;                      // every key back to back
+    size_t m_maxLength;                 // longer words are rejected before hashing
+
+    static uint64_t Mix(uint64_t hash, uint32_t displacement);
+};
+
+class TokenFilter {
+
+public:
+    /**********************************************************************
+     * Name: TokenFilter (Constructor)
+     * PreCondition: None
+     *
+     * PostCondition: Filter that lets every token through
+     *********************************************************************/
+    TokenFilter() : m_minLength(0), m_maxLength(0), m_stem(false) {}
+
+    /**********************************************************************
+     * Name: UseBuiltinStopwords
+     * PreCondition: None
+     *
+     * PostCondition: Built in English stopwords added to the stopword set
+     *********************************************************************/
+    void UseBuiltinStopwords();
+
+    /**********************************************************************
+     * Name: LoadStopwords
+     * PreCondition: File of whitespace separated stopwords
+     *
+     * PostCondition: Words of the file added to the stopword set
+     *********************************************************************/
+    void LoadStopwords(string inFileName);
+
+    /**********************************************************************
+     * Name: SetLengthLimits
+     * PreCondition: Minimum and maximum word length, 0 for no limit
+     *
+     * PostCondition: Shorter or longer words are dropped
+     *********************************************************************/
+    void SetLengthLimits(size_t minLength, size_t maxLength);
+
+    /**********************************************************************
+     * Name: SetStemming
+     * PreCondition: None
+     *
+     * PostCondition: Plural endings are removed when enabled
+     *********************************************************************/
+    void SetStemming(bool stem);
+
+    /**********************************************************************
+     * Name: Apply
+     * PreCondition: Stripped word and its lowercase form
+     *
+     * PostCondition: False if the token is to be dropped. Otherwise both
+     *                forms are stemmed in place when stemming is enabled
+     *********************************************************************/
+    bool Apply(string& strippedWord, string& lowerWord) const;
+
+    /**********************************************************************
+     * Name: Signature
+     * PreCondition: None
+     *
+     * PostCondition: Hash of the stopwords, length limits and stemming,
+     *                equal for two filters that drop and stem alike
+     *********************************************************************/
+    uint64_t Signature() const;
+
+private:
+    vector<string> m_stopwordList;
+    PerfectHashSet m_stopwords;
+    size_t m_minLength;
+    size_t m_maxLength;
+    bool m_stem;
+
+    static bool EndsWith(const string& word, const char* suffix, size_t length);
+};
+
+// Build
+void PerfectHashSet::Build(vector<string> keys)
+{
+    sort(keys.begin(), keys.end());
+    keys.erase(unique(keys.begin(), keys.end()), keys.end());
+
+    size_t count = keys.size();
+    size_t bucketCount = count / 4 + 1;
+    m_displacements.assign(bucketCount, 0);
+    m_offsets.assign(count, 0);
+    m_lengths.assign(count, 0);
+    m_pool.clear();
+    m_maxLength = 0;
+    if (count == 0)
+    {
+        return;
+    }
+
+    vector<uint64_t> hashes(count);
+    vector<vector<size_t> > buckets(bucketCount);
+    for (size_t k = 0; k < count; ++k)
+    {
+        if (keys[k].length() > 255)
+        {
+            throw IllegalArgumentException();
+        }
+        hashes[k] = Hash(keys[k].data(), keys[k].length());
+        buckets[hashes[k] % bucketCount].push_back(k);
+        m_maxLength = max(m_maxLength, keys[k].length());
+    }
+
+    // place the biggest buckets first while most slots are still free
+    vector<size_t> order(bucketCount);
+    for (size_t b = 0; b < bucketCount; ++b)
+    {
+        order[b] = b;
+    }
+    sort(order.begin(), order.end(), [&](size_t lhs, size_t rhs) {
+        return buckets[lhs].size() > buckets[rhs].size();
+    });
+
+    vector<bool> taken(count, false);
+    vector<size_t> slots;
+    for (size_t i = 0; i < bucketCount && !buckets[order[i]].empty(); ++i)
+    {
+        const vector<size_t>& bucket = buckets[order[i]];
+        uint32_t displacement = 0;
+        for (;; ++displacement)
+        {
+            if (displacement > MAX_DISPLACEMENT)
+            {
+                throw IllegalArgumentException();
+            }
+            // every key of the bucket needs its own free slot
+            slots.clear();
+            bool fits = true;
+            for (size_t k = 0; k < bucket.size() && fits; ++k)
+            {
+                size_t slot = Mix(hashes[bucket[k]], displacement) % count;
+                fits = !taken[slot] && find(slots.begin(), slots.end(), slot) == slots.end();
+                slots.push_back(slot);
+            }
+            if (fits)
+            {
+                break;
+            }
+        }
+
+        m_displacements[order[i]] = displacement;
+        for (size_t k = 0; k < bucket.size(); ++k)
+        {
+            taken[slots[k]] = true;
+            m_offsets[slots[k]] = m_pool.length();
+            m_lengths[slots[k]] = keys[bucket[k]].length();
+            m_pool += keys[bucket[k]];
+        }
+    }
+}
+
+// Contains
+bool PerfectHashSet::Contains(const char* word, size_t length) const
+{
+    if (length > m_maxLength || m_offsets.empty())
+    {
+        return false;
+    }
+    uint64_t hash = Hash(word, length);
+    size_t slot = Mix(hash, m_displacements[hash % m_displacements.size()]) % m_offsets.size();
+    return m_lengths[slot] == length && m_pool.compare(m_offsets[slot], length, word, length) == 0;
+}
+
+// Hash, FNV-1a
+uint64_t PerfectHashSet::Hash(const char* word, size_t length)
+{
+    uint64_t hash = 14695981039346656037ull;
+    for (size_t i = 0; i < length; ++i)
+    {
+        hash ^= (unsigned char)word[i];
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+// Mix, rehashes with a displacement (murmur3 finalizer)
+uint64_t PerfectHashSet::Mix(uint64_t hash, uint32_t displacement)
+{
+    hash ^= (displacement + 1) * 0x9E3779B97F4A7C15ull;
+    hash ^= hash >> 33;
+    hash *= 0xff51afd7ed558ccdull;
+    hash ^= hash >> 33;
+    hash *= 0xc4ceb9fe1a85ec53ull;
+    hash ^= hash >> 33;
+    return hash;
+}
+
+// Use Builtin Stopwords
+void TokenFilter::UseBuiltinStopwords()
+{
+    size_t count = sizeof(BUILTIN_STOPWORDS) / sizeof(BUILTIN_STOPWORDS[0]);
+    m_stopwordList.insert(m_stopwordList.end(), BUILTIN_STOPWORDS, BUILTIN_STOPWORDS + count);
+    m_stopwords.Build(m_stopwordList);
+}
+
+// Load Stopwords
+void TokenFilter::LoadStopwords(string inFileName)
+{
+    ifstream ifs(inFileName.c_str());
+    if (!ifs)
+    {
+        throw IllegalArgumentException();
+    }
+    string word;
+    while (ifs >> word)
+    {
+        // matched against the lowercase form of each token
+        m_stopwordList.push_back(Util::Lower(word));
+    }
+    m_stopwords.Build(m_stopwordList);
+}
+
+// Set Length Limits
+void TokenFilter::SetLengthLimits(size_t minLength, size_t maxLength)
+{
+    if (maxLength != 0 && maxLength < minLength)
+    {
+        throw IllegalArgumentException();
+    }
+    m_minLength = minLength;
+    m_maxLength = maxLength;
+}
+
+// Set Stemming
+void TokenFilter::SetStemming(bool stem)
+{
+    m_stem = stem;
+}
+
+// Apply
+bool TokenFilter::Apply(string& strippedWord, string& lowerWord) const
+{
+    // stopwords are checked before stemming, "is" and "has" are not plurals
+    if (m_stopwords.Contains(lowerWord.data(), lowerWord.length()))
+    {
+        return false;
+    }
+
+    if (m_stem)
+    {
+        // S-stemmer: possessive, then -ies, -es and -s plurals
+        size_t cut = 0;
+        bool toY = false;
+        size_t length = lowerWord.length();
+        if (EndsWith(lowerWord, "'s", 2) && length > 2)
+            cut = 2;
+        else if (EndsWith(lowerWord, "ies", 3) && length > 4
+                 && !EndsWith(lowerWord, "eies", 4) && !EndsWith(lowerWord, "aies", 4))
+        {
+            cut = 3;
+            toY = true;
+        }
+        else if (EndsWith(lowerWord, "es", 2) && length > 3 && !EndsWith(lowerWord, "aes", 3)
+                 && !EndsWith(lowerWord, "ees", 3) && !EndsWith(lowerWord, "oes", 3))
+            cut = 1;
+        else if (EndsWith(lowerWord, "s", 1) && length > 3
+                 && !EndsWith(lowerWord, "us", 2) && !EndsWith(lowerWord, "ss", 2))
+            cut = 1;
+
+        if (cut > 0)
+        {
+            // case of the rest of the stripped form is kept
+            lowerWord.erase(length - cut);
+            strippedWord.erase(length - cut);
+            if (toY)
+            {
+                lowerWord += 'y';
+                strippedWord += 'y';
+            }
+        }
+    }
+
+    if (lowerWord.length() < m_minLength || (m_maxLength != 0 && lowerWord.length() > m_maxLength))
+    {
+        return false;
+    }
+    return true;
+}
+
+// Signature
+uint64_t TokenFilter::Signature() const
+{
+    // sorted and deduplicated, so the order the stopwords came in is ignored
+    vector<string> stopwords(m_stopwordList);
+    sort(stopwords.begin(), stopwords.end());
+    stopwords.erase(unique(stopwords.begin(), stopwords.end()), stopwords.end());
+
+    ostringstream settings;
+    settings << m_minLength << " " << m_maxLength << " " << m_stem;
+    for (size_t i = 0; i < stopwords.size(); ++i)
+    {
+        settings << " " << stopwords[i];
+    }
+    string text = settings.str();
+    return PerfectHashSet::Hash(text.data(), text.length());
+}
+
+// Ends With
+bool TokenFilter::EndsWith(const string& word, const char* suffix, size_t length)
+{
+    return word.length() >= length && word.compare(word.length() - length, length, suffix) == 0;
+}
+
+#endif //PROJ3_TOKENFILTER_H
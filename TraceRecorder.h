@@ -0,0 +1,418 @@
+/*
+ * File:    TraceRecorder.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Binary trace of the operations run against a table
+ *
+ * A HashedSplays with a recorder set writes one record per public call:
+ * the operation, the microseconds since the previous record, and its
+ * argument. Calls made from inside another recorded call are not recorded,
+ * so a trace holds what a caller asked for, and replaying it (replay.cpp)
+ * runs the same calls against any build or configuration.
+ *
+ * Layout after the "WFTRACE1\n" header, every integer a LEB128 varint:
+ *
+ *   record  := op(1 byte) micros payload
+ *   payload := string | integer | count string... | nothing
+ *   string  := 0 length bytes      a string not worth remembering
+ *            | 1 length bytes      a new string, its id is the next id
+ *            | id + 2              a string seen before
+ *
+ * Words repeat a lot, so after the first TRACE_DICTIONARY distinct
+ * strings a repeated word costs one to three bytes. The trace ends with
+ * TRACE_END.
+ */
+
+#ifndef PROJ3_TRACERECORDER_H
+#define PROJ3_TRACERECORDER_H
+
+#include <string>
+#include <vector>
+#include <fstream>
+#include <mutex>
+#include <chrono>
+#include <unordered_map>
+#include <stdint.h>
+#include "dsexceptions.h"
+
+using namespace std;
+
+#define TRACE_MAGIC "WFTRACE1\n"
+#define TRACE_DICTIONARY (1 << 20)  // distinct strings given an id
+#define TRACE_BUFFER (1 << 16)      // bytes buffered before a write
+
+// Operations, the payload each one carries follows the name
+enum TraceOp
+{
+    TRACE_END = 0,
+    TRACE_INSERT,           // string, the raw token given to InsertWord
+    TRACE_FREQUENCY,        // string, GetFrequency
+    TRACE_LOOKUP,           // string, LookupFrequency
+    TRACE_LOOKUP_BATCH,     // count strings, LookupBatch
+    TRACE_PREFIX,           // string, CollectPrefix
+    TRACE_TOP_K,            // integer, CollectTopK
+    TRACE_FIND_ALL,         // string, FindAll
+    TRACE_FIND_ALL_BATCH,   // count strings, FindAllBatch
+    TRACE_PRINT_TREE,       // integer, PrintTree by index
+    TRACE_PRINT_LETTER,     // string, PrintTree by letter
+    TRACE_PRINT_COUNTS,     // nothing, PrintHashCountResults
+    TRACE_DUMP,             // nothing, DumpTable
+    TRACE_OPS
+};
+
+// One record read back
+struct TraceRecord
+{
+    TraceOp op;
+    uint64_t micros;            // since the previous record
+    uint64_t integer;
+    vector<string> strings;     // one for string payloads
+};
+
+class TraceRecorder {
+
+public:
+    TraceRecorder() : m_open(false), m_nextId(0), m_records(0) {}
+    ~TraceRecorder() { Close(); }
+
+    /**********************************************************************
+     * Name: Open
+     * PreCondition: Path for the trace
+     *
+     * PostCondition: Trace started. Throws IllegalArgumentException if it
+     *                cannot be created
+     *********************************************************************/
+    void Open(const string& path);
+
+    /**********************************************************************
+     * Name: Close
+     * PreCondition: None
+     *
+     * PostCondition: TRACE_END written and the trace flushed, if open
+     *********************************************************************/
+    void Close();
+
+    /**********************************************************************
+     * Name: Record
+     * PreCondition: Operation and its payload, strings only for string
+     *               and count payloads. Safe from any thread
+     *
+     * PostCondition: Record appended
+     *********************************************************************/
+    void Record(TraceOp op, const string* strings, size_t count, uint64_t integer);
+
+    uint64_t GetRecordCount() const { return m_records; }
+
+    // static name of an operation, for reports
+    static const char* OpName(TraceOp op);
+
+private:
+    ofstream m_out;
+    bool m_open;
+    mutex m_lock;
+    string m_buffer;
+    unordered_map<string, uint32_t> m_ids;
+    uint32_t m_nextId;
+    uint64_t m_records;
+    chrono::steady_clock::time_point m_last;
+
+    void PutVarint(uint64_t value);
+    void PutString(const string& value);
+    void Flush();
+};
+
+class TraceReader {
+
+public:
+    /**********************************************************************
+     * Name: TraceReader (Constructor)
+     * PreCondition: Path of a trace
+     *
+     * PostCondition: Positioned at the first record. Throws
+     *                IllegalArgumentException if it is not a trace
+     *********************************************************************/
+    TraceReader(const string& path);
+
+    /**********************************************************************
+     * Name: Next
+     * PreCondition: Record to fill
+     *
+     * PostCondition: False at TRACE_END. Throws ReadFailedException on a
+     *                truncated or damaged trace
+     *********************************************************************/
+    bool Next(TraceRecord& record);
+
+private:
+    ifstream m_in;
+    vector<string> m_strings;   // by id
+
+    uint64_t GetVarint();
+    void GetString(string& value);
+};
+
+// recorded calls open on this thread
+inline int& TraceDepth()
+{
+    static thread_local int depth = 0;
+    return depth;
+}
+
+/*
+ * Records a call on construction unless it is made from inside another
+ * recorded call on the same thread
+ */
+class TraceScope {
+
+public:
+    TraceScope(TraceRecorder* recorder, TraceOp op, const string* strings = NULL, size_t count = 0,
+               uint64_t integer = 0)
+        : m_counted(recorder != NULL)
+    {
+        if (m_counted && TraceDepth()++ == 0)
+        {
+            recorder->Record(op, strings, count, integer);
+        }
+    }
+
+    ~TraceScope()
+    {
+        if (m_counted)
+        {
+            TraceDepth()--;
+        }
+    }
+
+private:
+    bool m_counted;
+};
+
+/*
+ * Nothing is recorded while one is alive on this thread: worker threads
+ * running part of a recorded call hold one
+ */
+class TraceMute {
+
+public:
+    TraceMute() { TraceDepth()++; }
+    ~TraceMute() { TraceDepth()--; }
+};
+
+// Open
+void TraceRecorder::Open(const string& path)
+{
+    Close();
+    m_out.open(path.c_str(), ios::binary | ios::trunc);
+    if (!m_out)
+    {
+        throw IllegalArgumentException();
+    }
+    m_out << TRACE_MAGIC;
+    m_open = true;
+    m_ids.clear();
+    m_nextId = 0;
+    m_records = 0;
+    m_last = chrono::steady_clock::now();
+}
+
+// Close
+void TraceRecorder::Close()
+{
+    lock_guard<mutex> guard(m_lock);
+    if (!m_open)
+    {
+        return;
+    }
+    m_buffer += (char)TRACE_END;
+    Flush();
+    m_out.close();
+    m_open = false;
+}
+
+// Record
+void TraceRecorder::Record(TraceOp op, const string* strings, size_t count, uint64_t integer)
+{
+    lock_guard<mutex> guard(m_lock);
+    if (!m_open)
+    {
+        return;
+    }
+    chrono::steady_clock::time_point now = chrono::steady_clock::now();
+    m_buffer += (char)op;
+    PutVarint(chrono::duration_cast<chrono::microseconds>(now - m_last).count());
+    m_last = now;
+    switch (op)
+    {
+    case TRACE_LOOKUP_BATCH:
+    case TRACE_FIND_ALL_BATCH:
+        PutVarint(count);
+        for (size_t i = 0; i < count; ++i)
+        {
+            PutString(strings[i]);
+        }
+        break;
+    case TRACE_TOP_K:
+    case TRACE_PRINT_TREE:
+        PutVarint(integer);
+        break;
+    case TRACE_PRINT_COUNTS:
+    case TRACE_DUMP:
+        break;
+    default:
+        PutString(strings[0]);
+    }
+    m_records++;
+    if (m_buffer.size() >= TRACE_BUFFER)
+    {
+        Flush();
+    }
+}
+
+// Put Varint
+void TraceRecorder::PutVarint(uint64_t value)
+{
+    while (value >= 0x80)
+    {
+        m_buffer += (char)(value | 0x80);
+        value >>= 7;
+    }
+    m_buffer += (char)value;
+}
+
+// Put String
+void TraceRecorder::PutString(const string& value)
+{
+    unordered_map<string, uint32_t>::const_iterator it = m_ids.find(value);
+    if (it != m_ids.end())
+    {
+        PutVarint((uint64_t)it->second + 2);
+        return;
+    }
+    bool remember = m_nextId < TRACE_DICTIONARY;
+    if (remember)
+    {
+        m_ids[value] = m_nextId++;
+    }
+    PutVarint(remember ? 1 : 0);
+    PutVarint(value.length());
+    m_buffer += value;
+}
+
+// Flush
+void TraceRecorder::Flush()
+{
+    m_out.write(m_buffer.data(), m_buffer.size());
+    m_buffer.clear();
+}
+
+// Op Name
+const char* TraceRecorder::OpName(TraceOp op)
+{
+    static const char* names[TRACE_OPS] = { "end", "insert", "frequency", "lookup", "lookup_batch", "prefix",
+                                            "top_k", "find_all", "find_all_batch", "print_tree",
+                                            "print_letter", "print_counts", "dump" };
+    return op < TRACE_OPS ? names[op] : "unknown";
+}
+
+// Reader Constructor
+TraceReader::TraceReader(const string& path) : m_in(path.c_str(), ios::binary)
+{
+    string magic(sizeof(TRACE_MAGIC) - 1, '\0');
+    if (!m_in || !m_in.read(&magic[0], magic.size()) || magic != TRACE_MAGIC)
+    {
+        throw IllegalArgumentException();
+    }
+}
+
+// Next
+bool TraceReader::Next(TraceRecord& record)
+{
+    int op = m_in.get();
+    if (op == EOF || op >= TRACE_OPS)
+    {
+        throw ReadFailedException();
+    }
+    record.op = (TraceOp)op;
+    if (record.op == TRACE_END)
+    {
+        return false;
+    }
+    record.micros = GetVarint();
+    record.integer = 0;
+    record.strings.clear();
+    switch (record.op)
+    {
+    case TRACE_LOOKUP_BATCH:
+    case TRACE_FIND_ALL_BATCH:
+        record.strings.resize(GetVarint());
+        for (size_t i = 0; i < record.strings.size(); ++i)
+        {
+            GetString(record.strings[i]);
+        }
+        break;
+    case TRACE_TOP_K:
+    case TRACE_PRINT_TREE:
+        record.integer = GetVarint();
+        break;
+    case TRACE_PRINT_COUNTS:
+    case TRACE_DUMP:
+        break;
+    default:
+        record.strings.resize(1);
+        GetString(record.strings[0]);
+    }
+    return true;
+}
+
+// Get Varint
+uint64_t TraceReader::GetVarint()
+{
+    uint64_t value = 0;
+    for (int shift = 0; shift < 64; shift += 7)
+    {
+        int byte = m_in.get();
+        if (byte == EOF)
+        {
+            throw ReadFailedException();
+        }
+        value |= (uint64_t)(byte & 0x7f) << shift;
+        if ((byte & 0x80) == 0)
+        {
+            return value;
+        }
+    }
+    throw ReadFailedException();
+}
+
+// Get String
+void TraceReader::GetString(string& value)
+{
+    uint64_t tag = GetVarint();
+    if (tag >= 2)
+    {
+        if (tag - 2 >= m_strings.size())
+        {
+            throw ReadFailedException();
+        }
+        value = m_strings[tag - 2];
+        return;
+    }
+    uint64_t length = GetVarint();
+    if (length > (1u << 30))
+    {
+        throw ReadFailedException();
+    }
+    value.resize(length);
+    if (length > 0 && !m_in.read(&value[0], length))
+    {
+        throw ReadFailedException();
+    }
+    if (tag == 1)
+    {
+        m_strings.push_back(value);
+    }
+}
+
+#endif //PROJ3_TRACERECORDER_H
@@ -12,7 +12,9 @@
  * 
  * Lower() - Returns a string in lower case.
  * Strip() - Removes all nonalpha characters except ' and -
+ * StripInPlace() - Strip without a copy.
  * FileExisits() - Verifes a file exists.
+ * IsWellFormed() - Checks a token is printable ASCII.
  * 
  *************************************************************/
 #include "Util.h"
@@ -20,6 +22,13 @@
 using namespace std;
 
 
+//ASCII letters only, whatever the locale: bytes of UTF-8 sequences and
+//control bytes are never letters, and are dropped like punctuation
+static inline bool IsAsciiLetter(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z');
+}
+
 //Retuns the string lower cased.
 string Util::Lower(string inString)
 {
@@ -33,42 +42,39 @@ string Util::Lower(string inString)
 //Returns the string with only alpha characters.
 string Util::Strip(string inString)
 {
-    std::string newString;
-    
-    if (inString == "") return inString;
-    
-    else if (!isalpha(inString[0])) {
-        for (unsigned int i = 1; i < inString.length(); i++) {
-            newString += inString[i];
-        }
-        return Strip(newString);
+    StripInPlace(inString);
+    return inString;
+}
+
+
+//Same as Strip in one pass over the string's own buffer: the ends are
+//trimmed to the first and last letter, then the letters and the first '
+//or - are moved down over everything else. No allocation, no recursion.
+//Bytes above 0x7E are skipped, so "café" keeps "caf" and "don’t" "dont".
+void Util::StripInPlace(string& inString)
+{
+    size_t first = 0;
+    size_t last = inString.length();
+    while (first < last && !IsAsciiLetter(inString[first])) {
+        first++;
     }
-    
-    else if (!isalpha(inString[inString.length() - 1])) {
-        for (unsigned int i = 0; i < inString.length() - 1; i++) {
-            newString += inString[i];
-        }
-        return Strip(newString);
+    while (last > first && !IsAsciiLetter(inString[last - 1])) {
+        last--;
     }
     
     bool contraction = false;
-    bool foundalpha = 0;
-    
-    for (unsigned int i = 0; i < inString.length(); i++)
+    size_t kept = 0;
+    for (size_t i = first; i < last; i++)
     {
-        if (isalpha(inString[i])) {
-            newString += inString[i];
-            foundalpha = true;
-        } else if ((int(inString[i]) == 39 || int(inString[i]) == 45) && 
-            !contraction && foundalpha) {
-            newString += inString[i];
+        char c = inString[i];
+        if (IsAsciiLetter(c)) {
+            inString[kept++] = c;
+        } else if ((c == '\'' || c == '-') && !contraction) {
+            inString[kept++] = c;
             contraction = true;
         }
     }
-    
-    
-    return newString;
-    
+    inString.resize(kept);
 }
 
 
@@ -83,4 +89,18 @@ bool Util::FileExists(const char* filename)
         inFile.close();
         return true;
     }
-}
\ No newline at end of file
+}
+
+
+//Non ASCII and control bytes, which Strip drops; a token made only of
+//them is rejected rather than silently skipped
+bool Util::IsWellFormed(const string& inString)
+{
+    for (unsigned int i = 0; i < inString.length(); i++) {
+        unsigned char c = inString[i];
+        if (c < 32 || c > 126) {
+            return false;
+        }
+    }
+    return true;
+}
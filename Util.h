@@ -12,7 +12,9 @@
  * 
  * Lower() - Returns a string in lower case.
  * Strip() - Removes all nonalpha characters except ' and -
+ * StripInPlace() - Strip without a copy.
  * FileExisits() - Verifes a file exists.
+ * IsWellFormed() - Checks a token is printable ASCII.
  * 
  *************************************************************/
 #ifndef UTIL_H
@@ -42,6 +44,16 @@ static std::string Lower(std::string inString);
 static std::string Strip(std::string inString);
 
 
+/**********************************************************************
+ * Name: StripInPlace (Static)
+ * PreCondition: String.
+ * 
+ * PostCondition:  String holds what Strip would return, in one pass
+ * with no allocation.
+ *********************************************************************/
+static void StripInPlace(std::string& inString);
+
+
 /**********************************************************************
  * Name: FileExisits (Static)
  * PreCondition: Name of file to check for.
@@ -49,6 +61,17 @@ static std::string Strip(std::string inString);
  * PostCondition:  Bool True if the file is available.
  *********************************************************************/
 static bool FileExists(const char* filename);
+
+
+/**********************************************************************
+ * Name: IsWellFormed (Static)
+ * PreCondition: Raw token.
+ * 
+ * PostCondition:  Bool True if every byte is printable ASCII. Strip
+ * drops the other bytes, so this only matters for a token with no
+ * letter left.
+ *********************************************************************/
+static bool IsWellFormed(const std::string& inString);
 };
 
 
@@ -0,0 +1,132 @@
+/*
+ * File:    VocabularyGrowth.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Vocabulary size against tokens read, for Heaps' law
+ *
+ * Fed one call per counted token with whether the word was new. The
+ * (tokens, distinct words) curve is kept at geometrically spaced points,
+ * 10% apart, so a billion tokens take a couple of hundred points. Heaps'
+ * law V = K n^beta is fitted by least squares on the log-log curve.
+ */
+
+#ifndef PROJ3_VOCABULARYGROWTH_H
+#define PROJ3_VOCABULARYGROWTH_H
+
+#include <vector>
+#include <cmath>
+#include <stdint.h>
+
+using namespace std;
+
+/*
+ * Least squares line through (log x, log y), returning its slope, the
+ * intercept (natural log) and R squared. Points with x or y not above 0
+ * are skipped
+ */
+inline void FitLogLog(const vector<pair<double, double> >& points, double& slope, double& intercept, double& r2)
+{
+    double n = 0, sx = 0, sy = 0, sxx = 0, sxy = 0, syy = 0;
+    for (size_t i = 0; i < points.size(); ++i)
+    {
+        if (points[i].first <= 0 || points[i].second <= 0)
+        {
+            continue;
+        }
+        double x = log(points[i].first);
+        double y = log(points[i].second);
+        n++;
+        sx += x;
+        sy += y;
+        sxx += x * x;
+        sxy += x * y;
+        syy += y * y;
+    }
+    double vx = n * sxx - sx * sx;
+    double vy = n * syy - sy * sy;
+    if (n < 2 || vx <= 0)
+    {
+        slope = intercept = r2 = 0.0;
+        return;
+    }
+    slope = (n * sxy - sx * sy) / vx;
+    intercept = (sy - slope * sx) / n;
+    r2 = vy <= 0 ? 1.0 : (n * sxy - sx * sy) * (n * sxy - sx * sy) / (vx * vy);
+}
+
+class VocabularyGrowth {
+
+public:
+    VocabularyGrowth() : m_tokens(0), m_distinct(0), m_next(1) {}
+
+    /**********************************************************************
+     * Name: Observe
+     * PreCondition: One token counted, true if it was a new word. Calls
+     *               must come in token order, from one thread
+     *
+     * PostCondition: Counts updated, a curve point kept when due
+     *********************************************************************/
+    void Observe(bool newWord)
+    {
+        m_tokens++;
+        m_distinct += newWord;
+        if (m_tokens >= m_next)
+        {
+            m_curve.push_back(make_pair((double)m_tokens, (double)m_distinct));
+            m_next = max(m_next + 1, (uint64_t)(m_next * 1.1));
+        }
+    }
+
+    /**********************************************************************
+     * Name: GetCurve
+     * PreCondition: None
+     *
+     * PostCondition: (tokens, distinct) points, ending at the current count
+     *********************************************************************/
+    vector<pair<double, double> > GetCurve() const
+    {
+        vector<pair<double, double> > curve = m_curve;
+        if (m_tokens > 0 && (curve.empty() || curve.back().first != m_tokens))
+        {
+            curve.push_back(make_pair((double)m_tokens, (double)m_distinct));
+        }
+        return curve;
+    }
+
+    /**********************************************************************
+     * Name: FitHeaps
+     * PreCondition: None
+     *
+     * PostCondition: K, beta and R squared of V = K n^beta over the curve,
+     *                the first hundred tokens left out as too noisy
+     *********************************************************************/
+    void FitHeaps(double& k, double& beta, double& r2) const
+    {
+        vector<pair<double, double> > curve = GetCurve();
+        vector<pair<double, double> > fitted;
+        for (size_t i = 0; i < curve.size(); ++i)
+        {
+            if (curve[i].first >= 100)
+            {
+                fitted.push_back(curve[i]);
+            }
+        }
+        double intercept;
+        FitLogLog(fitted, beta, intercept, r2);
+        k = exp(intercept);
+    }
+
+    uint64_t GetTokens() const { return m_tokens; }
+    uint64_t GetDistinct() const { return m_distinct; }
+
+private:
+    uint64_t m_tokens;
+    uint64_t m_distinct;
+    uint64_t m_next;            // token count of the next curve point
+    vector<pair<double, double> > m_curve;
+};
+
+#endif //PROJ3_VOCABULARYGROWTH_H
@@ -0,0 +1,391 @@
+/*
+ * File:    WindowedCounter.h
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ * Word frequencies over a sliding window of a stream
+ *
+ * Time is cut into epochs of a fixed length (seconds, or tokens for a
+ * logical clock). Every epoch counts into its own HashedSplays delta table,
+ * and the last n tables sit in a ring. When the clock moves past an epoch
+ * the oldest table is retired in bulk, deleted whole, so memory is bounded
+ * by the number of epochs times the words per epoch, whatever the length
+ * of the stream.
+ *
+ * A window is the current epoch plus the ones before it. A frequency is the
+ * sum over the window's tables. Top-k runs a threshold search: it takes the
+ * top d of every epoch, sums the candidates exactly, and stops once the
+ * k-th best beats the most an unseen word could have (the sum of every
+ * epoch's d-th count); otherwise d doubles. Closed epochs never change, so
+ * their top lists are kept between queries.
+ */
+
+#ifndef PROJ3_WINDOWEDCOUNTER_H
+#define PROJ3_WINDOWEDCOUNTER_H
+
+#include <string>
+#include <vector>
+#include <set>
+#include <algorithm>
+#include <fstream>
+#include "HashedSplays.h"
+#include "dsexceptions.h"
+
+class WindowedCounter {
+
+public:
+    /**********************************************************************
+     * Name: WindowedCounter (Constructor)
+     * PreCondition: Number of epochs kept (the longest window) and the
+     *               length of an epoch, in seconds or tokens
+     *
+     * PostCondition: Empty ring, the clock at epoch 0
+     *********************************************************************/
+    WindowedCounter(int epochs, double epochLength);
+
+    /**********************************************************************
+     * Name: ~WindowedCounter
+     * PreCondition: None
+     *
+     * PostCondition: Every epoch table deleted
+     *********************************************************************/
+    ~WindowedCounter();
+
+    /**********************************************************************
+     * Name: InsertWord
+     * PreCondition: Passed one raw whitespace separated token
+     *
+     * PostCondition: Token counted in the current epoch, same rules as
+     *                HashedSplays::InsertWord
+     *********************************************************************/
+    void InsertWord(const string& word);
+
+    /**********************************************************************
+     * Name: AdvanceTo
+     * PreCondition: Clock reading, seconds or tokens since the stream
+     *               started, never less than the last one
+     *
+     * PostCondition: Epochs the clock moved past are closed, tables that
+     *                fell out of the ring retired
+     *********************************************************************/
+    void AdvanceTo(double now);
+
+    /**********************************************************************
+     * Name: GetFrequency
+     * PreCondition: Word exactly as counted, and the window in epochs
+     *               (1 is the current epoch only, at most the ring size)
+     *
+     * PostCondition: Count of the word over the window
+     *********************************************************************/
+    Frequency GetFrequency(const string& inWord, int epochs) const;
+
+    /**********************************************************************
+     * Name: CollectTopK
+     * PreCondition: Number of nodes wanted and the window in epochs
+     *
+     * PostCondition: outNodes holds the k most frequent words of the
+     *                window with exact counts, most frequent first, ties
+     *                alphabetical
+     *********************************************************************/
+    void CollectTopK(int k, int epochs, vector<Node>& outNodes);
+
+    /**********************************************************************
+     * Name: PrintWindowResults
+     * PreCondition: Number of words per window
+     *
+     * PostCondition: Top k of the current epoch, half the ring and the
+     *                whole ring to cout
+     *********************************************************************/
+    void PrintWindowResults(int k);
+
+    /**********************************************************************
+     * Name: SetFilter
+     * PreCondition: Filter that outlives the counter, NULL for none
+     *
+     * PostCondition: Every epoch, current and future, uses the filter
+     *********************************************************************/
+    void SetFilter(const TokenFilter* filter);
+
+    /**********************************************************************
+     * Name: SetKeyPolicy
+     * PreCondition: Nothing counted yet
+     *
+     * PostCondition: Every epoch, current and future, keys words with the
+     *                policy. Throws IllegalArgumentException once counting
+     *                has started
+     *********************************************************************/
+    void SetKeyPolicy(KeyPolicy policy);
+
+    int GetEpochs() const { return (int)m_ring.size(); }
+    long long GetCurrentEpoch() const { return m_epoch; }
+    uint64_t GetRejectCount() const;
+    uint64_t GetNodeCount() const;
+
+private:
+    struct Epoch
+    {
+        HashedSplays* table;
+        vector<Node> top;       // top list of a closed epoch, kept
+        int topDepth;           // depth top was collected for, 0 for none
+        bool closed;
+    };
+
+    vector<Epoch> m_ring;
+    double m_epochLength;
+    long long m_epoch;          // absolute number of the current epoch
+    const TokenFilter* m_filter;
+    KeyPolicy m_keyPolicy;
+
+    // ring slot of the epoch back epochs ago, 0 for the current one
+    int Slot(int back) const
+    {
+        int size = (int)m_ring.size();
+        return (int)(((m_epoch - back) % size + size) % size);
+    }
+
+    void Retire(Epoch& epoch);
+    void TopOf(Epoch& epoch, int depth, vector<Node>& outNodes);
+};
+
+// Constructor
+WindowedCounter::WindowedCounter(int epochs, double epochLength)
+    : m_epochLength(epochLength), m_epoch(0), m_filter(NULL), m_keyPolicy(KEY_EXACT)
+{
+    if (epochs < 1 || epochLength <= 0.0)
+    {
+        throw IllegalArgumentException();
+    }
+    m_ring.resize(epochs);
+    for (int e = 0; e < epochs; ++e)
+    {
+        m_ring[e].table = new HashedSplays(ALPHABET_SIZE);
+        m_ring[e].topDepth = 0;
+        m_ring[e].closed = false;
+    }
+}
+
+// Destructor
+WindowedCounter::~WindowedCounter()
+{
+    for (size_t e = 0; e < m_ring.size(); ++e)
+    {
+        delete m_ring[e].table;
+    }
+}
+
+// Insert Word
+void WindowedCounter::InsertWord(const string& word)
+{
+    m_ring[Slot(0)].table->InsertWord(word);
+}
+
+// Advance To
+void WindowedCounter::AdvanceTo(double now)
+{
+    long long target = (long long)(now / m_epochLength);
+    if (target <= m_epoch)
+    {
+        return;
+    }
+
+    // a gap longer than the ring retires every table once
+    long long steps = min(target - m_epoch, (long long)m_ring.size());
+    m_ring[Slot(0)].closed = true;
+    m_epoch = target - steps;
+    for (long long s = 0; s < steps; ++s)
+    {
+        m_epoch++;
+        Retire(m_ring[Slot(0)]);
+        if (s + 1 < steps)
+        {
+            m_ring[Slot(0)].closed = true;
+        }
+    }
+}
+
+// Retire, the slot's table is dropped whole and starts the new epoch
+void WindowedCounter::Retire(Epoch& epoch)
+{
+    delete epoch.table;
+    epoch.table = new HashedSplays(ALPHABET_SIZE);
+    epoch.table->SetFilter(m_filter);
+    epoch.table->SetKeyPolicy(m_keyPolicy);
+    epoch.top.clear();
+    epoch.topDepth = 0;
+    epoch.closed = false;
+}
+
+// Get Frequency
+Frequency WindowedCounter::GetFrequency(const string& inWord, int epochs) const
+{
+    if (epochs < 1 || epochs > (int)m_ring.size())
+    {
+        throw IllegalArgumentException();
+    }
+    Frequency total = 0;
+    for (int back = 0; back < epochs; ++back)
+    {
+        total = CheckedAdd(total, m_ring[Slot(back)].table->GetFrequency(inWord));
+    }
+    return total;
+}
+
+// Top Of, the depth most frequent words of an epoch
+void WindowedCounter::TopOf(Epoch& epoch, int depth, vector<Node>& outNodes)
+{
+    if (!epoch.closed)
+    {
+        epoch.table->CollectTopK(depth, outNodes);
+        return;
+    }
+    // a closed epoch is only collected again for a deeper list, and not at
+    // all once a list came back shorter than asked, it holds every word
+    if (epoch.topDepth < depth && (int)epoch.top.size() == epoch.topDepth)
+    {
+        epoch.table->CollectTopK(depth, epoch.top);
+        epoch.topDepth = depth;
+    }
+    outNodes.assign(epoch.top.begin(), epoch.top.begin() + min((int)epoch.top.size(), depth));
+}
+
+// Collect Top K
+void WindowedCounter::CollectTopK(int k, int epochs, vector<Node>& outNodes)
+{
+    if (epochs < 1 || epochs > (int)m_ring.size())
+    {
+        throw IllegalArgumentException();
+    }
+    outNodes.clear();
+    if (k <= 0)
+    {
+        return;
+    }
+
+    auto moreFrequent = [](const Node& lhs, const Node& rhs) {
+        if (lhs.GetFrequency() != rhs.GetFrequency())
+        {
+            return lhs.GetFrequency() > rhs.GetFrequency();
+        }
+        return lhs < rhs;
+    };
+
+    vector<Node> top;
+    for (int depth = k; ; depth *= 2)
+    {
+        // candidates are every epoch's top depth words, a word in none of
+        // those lists has at most threshold over the window
+        set<string> candidates;
+        Frequency threshold = 0;
+        bool exhausted = true;
+        for (int back = 0; back < epochs; ++back)
+        {
+            TopOf(m_ring[Slot(back)], depth, top);
+            for (size_t i = 0; i < top.size(); ++i)
+            {
+                candidates.insert(top[i].GetWord());
+            }
+            if ((int)top.size() == depth)
+            {
+                threshold += top.back().GetFrequency();
+                exhausted = false;
+            }
+        }
+
+        outNodes.clear();
+        for (set<string>::const_iterator it = candidates.begin(); it != candidates.end(); ++it)
+        {
+            outNodes.push_back(Node(*it, GetFrequency(*it, epochs)));
+        }
+        sort(outNodes.begin(), outNodes.end(), moreFrequent);
+        if (outNodes.size() > (size_t)k)
+        {
+            outNodes.resize(k);
+        }
+
+        // strictly above the threshold, so an unseen word cannot even tie
+        if (exhausted || ((int)outNodes.size() == k && outNodes.back().GetFrequency() > threshold))
+        {
+            return;
+        }
+    }
+}
+
+// Print Window Results
+void WindowedCounter::PrintWindowResults(int k)
+{
+    cout << "***************PRINT WINDOW RESULTS********************" << endl;
+    vector<int> windows;
+    windows.push_back(1);
+    if ((int)m_ring.size() > 2)
+    {
+        windows.push_back(((int)m_ring.size() + 1) / 2);
+    }
+    if (m_ring.size() > 1)
+    {
+        windows.push_back((int)m_ring.size());
+    }
+
+    for (size_t w = 0; w < windows.size(); ++w)
+    {
+        cout << "Last " << windows[w] << " of " << m_ring.size() << " epochs (epoch "
+             << m_epoch << " is current)" << endl;
+        vector<Node> top;
+        CollectTopK(k, windows[w], top);
+        for (size_t i = 0; i < top.size(); ++i)
+        {
+            cout << top[i] << endl;
+        }
+        cout << endl;
+    }
+    cout << endl;
+}
+
+// Set Key Policy
+void WindowedCounter::SetKeyPolicy(KeyPolicy policy)
+{
+    for (size_t e = 0; e < m_ring.size(); ++e)
+    {
+        m_ring[e].table->SetKeyPolicy(policy);
+    }
+    m_keyPolicy = policy;
+}
+
+// Set Filter
+void WindowedCounter::SetFilter(const TokenFilter* filter)
+{
+    m_filter = filter;
+    for (size_t e = 0; e < m_ring.size(); ++e)
+    {
+        m_ring[e].table->SetFilter(filter);
+    }
+}
+
+// Get Reject Count
+uint64_t WindowedCounter::GetRejectCount() const
+{
+    // only for the epochs still in the ring
+    uint64_t rejected = 0;
+    for (size_t e = 0; e < m_ring.size(); ++e)
+    {
+        rejected += m_ring[e].table->GetRejectCount();
+    }
+    return rejected;
+}
+
+// Get Node Count, words held over every epoch in the ring
+uint64_t WindowedCounter::GetNodeCount() const
+{
+    uint64_t nodes = 0;
+    for (size_t e = 0; e < m_ring.size(); ++e)
+    {
+        for (int b = 0; b < ALPHABET_SIZE; ++b)
+        {
+            nodes += m_ring[e].table->GetBucket(b).GetNodeCounter();
+        }
+    }
+    return nodes;
+}
+
+#endif //PROJ3_WINDOWEDCOUNTER_H
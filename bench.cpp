@@ -0,0 +1,1733 @@
+/**************************************************************
+ * File:    bench.cpp
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ *
+ * Benchmarks for the word frequency structures.
+ *
+ * Every benchmark is a named section. The corpus is either a text file
+ * (--file) or a synthetic Zipf distributed corpus (--tokens, --vocab) so
+ * results can be reproduced without large inputs on disk.
+ *
+ * Usage: Bench.out [section|all] [--file f] [--tokens n] [--vocab n]
+ *************************************************************/
+#include "HashedSplays.h"
+#include "Exceptions.h"
+#include "ApproxCounter.h"
+#include "IngestPipeline.h"
+#include "WindowedCounter.h"
+#include "InvertedIndex.h"
+#include "Analytics.h"
+#include "AsyncReader.h"
+#include "PerfCounter.h"
+#include <iostream>
+#include <fstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <cstdlib>
+#include <set>
+#include <unordered_set>
+#include <atomic>
+#include <new>
+#include <malloc.h>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Counting allocator, every heap allocation in the benchmark goes through it
+static atomic<unsigned long long> g_allocations(0);
+
+void* operator new(size_t size)
+{
+    g_allocations.fetch_add(1, memory_order_relaxed);
+    void* memory = malloc(size == 0 ? 1 : size);
+    if (memory == NULL)
+    {
+        throw bad_alloc();
+    }
+    return memory;
+}
+
+void operator delete(void* memory) noexcept
+{
+    free(memory);
+}
+
+void operator delete(void* memory, size_t) noexcept
+{
+    free(memory);
+}
+
+// Options shared by every section
+struct BenchOptions
+{
+    string file;
+    int tokens;
+    int vocab;
+};
+
+// Seconds since start
+static double Elapsed(Clock::time_point start)
+{
+    return chrono::duration<double>(Clock::now() - start).count();
+}
+
+// Deterministic pseudo random lowercase word for a rank
+static string SyntheticWord(unsigned int rank)
+{
+    unsigned int seed = rank * 2654435761u + 17;
+    int length = 3 + seed % 8;
+    string word;
+    for (int i = 0; i < length; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        word += char('a' + (seed >> 16) % 26);
+    }
+    return word;
+}
+
+// Zipf distributed sample of ranks in [0, vocab), exponent 1
+static vector<unsigned int> ZipfRanks(int count, int vocab, unsigned int seed)
+{
+    vector<double> cdf(vocab);
+    double total = 0.0;
+    for (int r = 0; r < vocab; ++r)
+    {
+        total += 1.0 / (r + 1);
+        cdf[r] = total;
+    }
+
+    vector<unsigned int> ranks(count);
+    for (int i = 0; i < count; ++i)
+    {
+        seed = seed * 1664525 + 1013904223;
+        double draw = (seed / 4294967296.0) * total;
+        ranks[i] = lower_bound(cdf.begin(), cdf.end(), draw) - cdf.begin();
+    }
+    return ranks;
+}
+
+// Raw tokens from the file, or a synthetic corpus when no file was given
+static vector<string> LoadCorpus(const BenchOptions& options)
+{
+    vector<string> words;
+    if (options.file.length() > 0)
+    {
+        ifstream ifs(options.file.c_str());
+        if (!ifs)
+        {
+            throw IllegalArgumentException();
+        }
+        string word;
+        while (ifs >> word)
+        {
+            words.push_back(word);
+        }
+        return words;
+    }
+
+    vector<unsigned int> ranks = ZipfRanks(options.tokens, options.vocab, 221);
+    words.reserve(ranks.size());
+    for (size_t i = 0; i < ranks.size(); ++i)
+    {
+        words.push_back(SyntheticWord(ranks[i]));
+    }
+    return words;
+}
+
+// Stripped words to use as lookup keys, in corpus order
+static vector<string> QueryWords(const vector<string>& corpus, size_t count)
+{
+    vector<string> queries;
+    for (size_t i = 0; queries.size() < count && i < corpus.size() * 2; ++i)
+    {
+        string word = Util::Strip(corpus[(i * 7919) % corpus.size()]);
+        if (word.length() > 0)
+        {
+            queries.push_back(word);
+        }
+    }
+    return queries;
+}
+
+/*
+ * Section lookup: lookup throughput under each splay policy, and the read
+ * only path shared by several threads
+ */
+static void BenchLookup(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    vector<string> queries = QueryWords(corpus, 1000000);
+
+    struct Policy { const char* name; SplayPolicy policy; double fraction; };
+    Policy policies[] = {
+        { "always", SPLAY_ALWAYS, 1.0 },
+        { "sometimes-0.10", SPLAY_SOMETIMES, 0.10 },
+        { "sometimes-0.01", SPLAY_SOMETIMES, 0.01 },
+        { "never", SPLAY_NEVER, 1.0 },
+    };
+
+    cout << "policy               lookups/s     splays" << endl;
+    for (size_t p = 0; p < sizeof(policies) / sizeof(policies[0]); ++p)
+    {
+        HashedSplays table(ALPHABET_SIZE);
+        for (size_t i = 0; i < corpus.size(); ++i)
+        {
+            table.InsertWord(corpus[i]);
+        }
+        table.SetSplayPolicy(policies[p].policy, policies[p].fraction);
+
+        long splaysBefore = 0;
+        for (int b = 0; b < table.m_trees; ++b)
+        {
+            splaysBefore += table.GetBucket(b).GetSplayCounter();
+        }
+
+        long checksum = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < queries.size(); ++i)
+        {
+            checksum += table.LookupFrequency(queries[i]);
+        }
+        double seconds = Elapsed(start);
+
+        long splaysAfter = 0;
+        for (int b = 0; b < table.m_trees; ++b)
+        {
+            splaysAfter += table.GetBucket(b).GetSplayCounter();
+        }
+        printf("%-18s %12.0f %10ld   (checksum %ld)\n", policies[p].name,
+               queries.size() / seconds, splaysAfter - splaysBefore, checksum);
+    }
+
+    // read only lookups from several threads at once, no locking needed
+    HashedSplays table(ALPHABET_SIZE);
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        table.InsertWord(corpus[i]);
+    }
+    for (int threads = 1; threads <= 4; threads *= 2)
+    {
+        vector<thread> readers;
+        vector<long> checksums(threads, 0);
+        Clock::time_point start = Clock::now();
+        for (int t = 0; t < threads; ++t)
+        {
+            readers.push_back(thread([&, t]() {
+                for (size_t i = t; i < queries.size(); i += threads)
+                {
+                    checksums[t] += table.GetFrequency(queries[i]);
+                }
+            }));
+        }
+        for (int t = 0; t < threads; ++t)
+        {
+            readers[t].join();
+        }
+        double seconds = Elapsed(start);
+        printf("read-only x%d        %12.0f %10d\n", threads, queries.size() / seconds, 0);
+    }
+}
+
+/*
+ * Section filter: cost per token of the stopword lookup against ordinary
+ * sets, and ingestion time with and without the filter
+ */
+static void BenchFilter(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+
+    // lowercase stripped tokens, the filter input, with some stopwords mixed in
+    vector<string> lowered;
+    size_t count = sizeof(BUILTIN_STOPWORDS) / sizeof(BUILTIN_STOPWORDS[0]);
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        string word = Util::Lower(Util::Strip(corpus[i]));
+        if (word.length() > 0)
+        {
+            lowered.push_back(i % 3 == 0 ? string(BUILTIN_STOPWORDS[i % count]) : word);
+        }
+    }
+
+    PerfectHashSet perfect;
+    perfect.Build(vector<string>(BUILTIN_STOPWORDS, BUILTIN_STOPWORDS + count));
+    set<string> ordered(BUILTIN_STOPWORDS, BUILTIN_STOPWORDS + count);
+    unordered_set<string> hashed(BUILTIN_STOPWORDS, BUILTIN_STOPWORDS + count);
+
+    long hits = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < lowered.size(); ++i)
+    {
+        hits += perfect.Contains(lowered[i].data(), lowered[i].length());
+    }
+    printf("perfect hash       %8.2f ns/token  (%ld stopwords)\n", Elapsed(start) * 1e9 / lowered.size(), hits);
+
+    hits = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < lowered.size(); ++i)
+    {
+        hits += ordered.count(lowered[i]);
+    }
+    printf("std::set           %8.2f ns/token  (%ld stopwords)\n", Elapsed(start) * 1e9 / lowered.size(), hits);
+
+    hits = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < lowered.size(); ++i)
+    {
+        hits += hashed.count(lowered[i]);
+    }
+    printf("std::unordered_set %8.2f ns/token  (%ld stopwords)\n", Elapsed(start) * 1e9 / lowered.size(), hits);
+
+    // whole ingestion, the stopwords mixed in above go to the hottest buckets
+    TokenFilter filter;
+    filter.UseBuiltinStopwords();
+    for (int filtered = 0; filtered < 2; ++filtered)
+    {
+        HashedSplays table(ALPHABET_SIZE);
+        if (filtered)
+        {
+            table.SetFilter(&filter);
+        }
+        start = Clock::now();
+        for (size_t i = 0; i < lowered.size(); ++i)
+        {
+            table.InsertWord(lowered[i]);
+        }
+        printf("ingest %-11s %8.2f ns/token\n", filtered ? "filtered" : "unfiltered",
+               Elapsed(start) * 1e9 / lowered.size());
+    }
+}
+
+/*
+ * Section approx: accuracy against memory of the sketch with heavy hitters,
+ * compared with the exact HashedSplays counts
+ */
+static void BenchApprox(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+
+    HashedSplays exact(ALPHABET_SIZE);
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        exact.InsertWord(corpus[i]);
+    }
+
+    // exact memory: one tree node per distinct word plus long word storage
+    vector<Node> words;
+    size_t exactBytes = 0;
+    for (int b = 0; b < exact.m_trees; ++b)
+    {
+        exact.GetBucket(b).inOrder([&](const Node& node) {
+            words.push_back(node);
+            exactBytes += sizeof(Node) + 2 * sizeof(void*);
+            if (node.GetWord().length() > 15)
+            {
+                exactBytes += node.GetWord().length() + 1;
+            }
+        });
+    }
+    vector<Node> exactTop;
+    exact.CollectTopK(100, exactTop);
+    printf("exact: %zu distinct words, %zu bytes\n", words.size(), exactBytes);
+
+    printf("epsilon     bytes   mem%%  mean-abs-err  max-abs-err  top100-recall\n");
+    double epsilons[] = { 0.01, 0.001, 0.0001, 0.00001 };
+    for (size_t e = 0; e < sizeof(epsilons) / sizeof(epsilons[0]); ++e)
+    {
+        ApproxCounter approx(epsilons[e], 0.01, 1000);
+        for (size_t i = 0; i < corpus.size(); ++i)
+        {
+            approx.InsertWord(corpus[i]);
+        }
+
+        double totalError = 0.0;
+        long maxError = 0;
+        for (size_t w = 0; w < words.size(); ++w)
+        {
+            long error = labs((long)approx.GetFrequency(words[w].GetWord()) - (long)words[w].GetFrequency());
+            totalError += error;
+            maxError = max(maxError, error);
+        }
+
+        vector<Node> approxTop;
+        approx.CollectTopK(100, approxTop);
+        int recalled = 0;
+        for (size_t i = 0; i < exactTop.size(); ++i)
+        {
+            for (size_t j = 0; j < approxTop.size(); ++j)
+            {
+                recalled += exactTop[i].GetWord() == approxTop[j].GetWord();
+            }
+        }
+        printf("%-9g %8zu %6.1f %13.3f %12ld %14.2f\n", epsilons[e], approx.GetMemoryBytes(),
+               100.0 * approx.GetMemoryBytes() / exactBytes, totalError / words.size(), maxError,
+               exactTop.empty() ? 1.0 : recalled / (double)exactTop.size());
+    }
+}
+
+/*
+ * Section frozen: lookups and prefix ranges on the frozen table against the
+ * live splay trees
+ */
+static void BenchFrozen(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    vector<string> queries = QueryWords(corpus, 1000000);
+
+    HashedSplays table(ALPHABET_SIZE);
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        table.InsertWord(corpus[i]);
+    }
+
+    long checksum = 0;
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        checksum += table.LookupFrequency(queries[i]);
+    }
+    printf("live splaying      %12.0f lookups/s  (checksum %ld)\n", queries.size() / Elapsed(start), checksum);
+
+    checksum = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        checksum += table.GetFrequency(queries[i]);
+    }
+    printf("live read only     %12.0f lookups/s  (checksum %ld)\n", queries.size() / Elapsed(start), checksum);
+
+    start = Clock::now();
+    table.Freeze();
+    printf("freeze             %12.3f ms\n", Elapsed(start) * 1000);
+
+    checksum = 0;
+    start = Clock::now();
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        checksum += table.GetFrequency(queries[i]);
+    }
+    printf("frozen             %12.0f lookups/s  (checksum %ld)\n", queries.size() / Elapsed(start), checksum);
+
+    // case sensitive prefix ranges, three letter prefixes of the queries
+    vector<string> prefixes;
+    for (size_t i = 0; i < queries.size() && prefixes.size() < 100000; i += 10)
+    {
+        prefixes.push_back(queries[i].substr(0, 3));
+    }
+
+    long matched = 0;
+    start = Clock::now();
+    for (size_t p = 0; p < prefixes.size(); ++p)
+    {
+        int index = Util::Lower(prefixes[p]).at(0) - 'a';
+        const string& prefix = prefixes[p];
+        table.GetBucket(index).inOrder([&](const Node& node) {
+            matched += node.GetWord().compare(0, prefix.length(), prefix) == 0;
+        });
+    }
+    printf("live prefix        %12.0f ranges/s   (%ld words)\n", prefixes.size() / Elapsed(start), matched);
+
+    matched = 0;
+    start = Clock::now();
+    for (size_t p = 0; p < prefixes.size(); ++p)
+    {
+        int index = Util::Lower(prefixes[p]).at(0) - 'a';
+        size_t first, last;
+        table.GetFrozenBucket(index).PrefixRange(prefixes[p].data(), prefixes[p].length(), first, last);
+        matched += last - first;
+    }
+    printf("frozen prefix      %12.0f ranges/s   (%ld words)\n", prefixes.size() / Elapsed(start), matched);
+}
+
+/*
+ * Section parallel: per bucket operations on the executor as the thread
+ * count grows
+ */
+static void BenchParallel(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    vector<string> queries = QueryWords(corpus, 500);
+
+    HashedSplays table(ALPHABET_SIZE);
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        table.InsertWord(corpus[i]);
+    }
+    vector<string> prefixes;
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        prefixes.push_back(queries[i].substr(0, 2));
+    }
+
+    unsigned int cores = thread::hardware_concurrency();
+    printf("threads   topk-ms  find-all-ms  freeze-ms  dump-ms  (%u cores)\n", cores);
+    for (int threads = 1; threads <= 8; threads *= 2)
+    {
+        BucketExecutor executor(threads);
+        table.SetExecutor(&executor);
+
+        vector<Node> top;
+        Clock::time_point start = Clock::now();
+        table.CollectTopK(100, top);
+        double topk = Elapsed(start);
+
+        // FindAllBatch prints, its output is thrown away here
+        ostringstream discard;
+        streambuf* saved = cout.rdbuf(discard.rdbuf());
+        start = Clock::now();
+        table.FindAllBatch(prefixes);
+        double findAll = Elapsed(start);
+        cout.rdbuf(saved);
+
+        start = Clock::now();
+        table.Freeze();
+        double freeze = Elapsed(start);
+        table.Thaw();
+
+        ostringstream dumped;
+        start = Clock::now();
+        table.DumpTable(dumped);
+        double dump = Elapsed(start);
+
+        printf("%7d %9.2f %12.2f %10.2f %8.2f\n", threads, topk * 1000, findAll * 1000, freeze * 1000, dump * 1000);
+        table.SetExecutor(NULL);
+    }
+}
+
+/*
+ * Section pipeline: FileReader against the threaded ingestion pipeline
+ * with a growing number of insert stages
+ */
+static void BenchPipeline(const BenchOptions& options)
+{
+    // the pipeline reads a file, so a synthetic corpus is written out first
+    string path = options.file;
+    if (path.empty())
+    {
+        vector<string> corpus = LoadCorpus(options);
+        path = "bench_pipeline.tmp";
+        ofstream ofs(path.c_str());
+        for (size_t i = 0; i < corpus.size(); ++i)
+        {
+            ofs << corpus[i] << (i % 12 == 11 ? '\n' : ' ');
+        }
+    }
+    vector<string> queries;
+    {
+        BenchOptions sample = options;
+        sample.file = path;
+        queries = QueryWords(LoadCorpus(sample), 1000);
+    }
+
+    HashedSplays baseline(ALPHABET_SIZE);
+    Clock::time_point start = Clock::now();
+    baseline.FileReader(path);
+    double serial = Elapsed(start);
+
+    unsigned int cores = thread::hardware_concurrency();
+    printf("reader          seconds  speedup  matches  (%u cores)\n", cores);
+    printf("%-14s %8.3f %8.2f %8s\n", "FileReader", serial, 1.0, "-");
+    for (int inserters = 1; inserters <= 8; inserters *= 2)
+    {
+        HashedSplays table(ALPHABET_SIZE);
+        IngestPipeline pipeline(table, inserters);
+        start = Clock::now();
+        pipeline.FileReader(path);
+        double seconds = Elapsed(start);
+
+        bool matches = true;
+        for (size_t i = 0; i < queries.size(); ++i)
+        {
+            matches = matches && table.GetFrequency(queries[i]) == baseline.GetFrequency(queries[i]);
+        }
+        char name[32];
+        snprintf(name, sizeof(name), "pipeline x%d", inserters);
+        printf("%-14s %8.3f %8.2f %8s\n", name, seconds, serial / seconds, matches ? "yes" : "NO");
+        if (inserters == 8)
+        {
+            pipeline.PrintMetrics();
+        }
+    }
+
+    if (options.file.empty())
+    {
+        remove(path.c_str());
+    }
+}
+
+/*
+ * Section batch: per token InsertWord against InsertBatch as the batch
+ * size grows
+ */
+static void BenchBatch(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    vector<string> queries = QueryWords(corpus, 1000);
+
+    HashedSplays baseline(ALPHABET_SIZE);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        baseline.InsertWord(corpus[i]);
+    }
+    double single = Elapsed(start);
+
+    printf("batch size     seconds  speedup  matches\n");
+    printf("%-12s %9.3f %8.2f %8s\n", "per token", single, 1.0, "-");
+    for (size_t size = 16; size <= corpus.size() * 4; size *= 4)
+    {
+        HashedSplays table(ALPHABET_SIZE);
+        start = Clock::now();
+        for (size_t i = 0; i < corpus.size(); i += size)
+        {
+            table.InsertBatch(corpus.data() + i, min(size, corpus.size() - i));
+        }
+        double seconds = Elapsed(start);
+
+        bool matches = true;
+        for (size_t i = 0; i < queries.size(); ++i)
+        {
+            matches = matches && table.GetFrequency(queries[i]) == baseline.GetFrequency(queries[i]);
+        }
+        printf("%-12zu %9.3f %8.2f %8s\n", size, seconds, single / seconds, matches ? "yes" : "NO");
+    }
+}
+
+/*
+ * Section alloc: heap allocations per token of the insert path, against
+ * the copying path it replaced (by value token, node built from a copy of
+ * the word, node copied into the tree)
+ */
+static void BenchAlloc(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+
+    // synthetic words fit in the short string buffer, long ones do not
+    vector<string> longCorpus(corpus.size());
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        longCorpus[i] = corpus[i] + "internationalization";
+    }
+
+    printf("words  path       allocs/token   seconds\n");
+    for (int pass = 0; pass < 2; ++pass)
+    {
+        const vector<string>& words = pass == 0 ? corpus : longCorpus;
+        const char* label = pass == 0 ? "short" : "long";
+
+        vector<SplayTree<Node> > copying(ALPHABET_SIZE);
+        unsigned long long before = g_allocations;
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < words.size(); ++i)
+        {
+            string word = words[i];
+            string strippedWord = Util::Strip(word);
+            if (strippedWord.length() == 0)
+            {
+                continue;
+            }
+            string lowerWord = Util::Lower(strippedWord);
+            Node wordNode(strippedWord, 1);
+            SplayTree<Node>& tree = copying[lowerWord[0] - 'a'];
+            Node* found = tree.access(wordNode);
+            if (found != NULL)
+            {
+                found->IncrementFrequency();
+            }
+            else
+            {
+                tree.insert(wordNode);
+            }
+        }
+        double copySeconds = Elapsed(start);
+        double copyAllocs = (double)(g_allocations - before) / words.size();
+
+        HashedSplays table(ALPHABET_SIZE);
+        before = g_allocations;
+        start = Clock::now();
+        for (size_t i = 0; i < words.size(); ++i)
+        {
+            table.InsertWord(words[i]);
+        }
+        double moveSeconds = Elapsed(start);
+        double moveAllocs = (double)(g_allocations - before) / words.size();
+
+        printf("%-6s %-10s %12.3f %9.3f\n", label, "copying", copyAllocs, copySeconds);
+        printf("%-6s %-10s %12.3f %9.3f\n", label, "moving", moveAllocs, moveSeconds);
+    }
+}
+
+/*
+ * Section adversarial: InsertWord throughput as the input gets worse,
+ * malformed tokens are rejected without leaving the hot path
+ */
+static void BenchAdversarial(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+
+    struct Mix
+    {
+        const char* name;
+        int malformed;      // percent of tokens with non ASCII or control bytes
+        int punctuation;    // percent wrapped in punctuation and digits
+        int junk;           // percent of long tokens with nothing to count
+    };
+    const Mix mixes[] = {
+        { "clean", 0, 0, 0 },
+        { "punctuation 50%", 0, 50, 0 },
+        { "malformed 10%", 10, 0, 0 },
+        { "malformed 50%", 50, 0, 0 },
+        { "junk 10%", 0, 0, 10 },
+        { "everything", 20, 20, 20 },
+    };
+
+    printf("%-16s %12s %10s %12s\n", "input", "tokens/s", "rejected", "distinct");
+    for (size_t m = 0; m < sizeof(mixes) / sizeof(mixes[0]); ++m)
+    {
+        const Mix& mix = mixes[m];
+        vector<string> tokens(corpus.size());
+        unsigned int seed = 12345;
+        for (size_t i = 0; i < corpus.size(); ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            int roll = (seed >> 16) % 100;
+            if (roll < mix.malformed)
+            {
+                // UTF-8 letter in front, a stray control byte inside, or
+                // a UTF-8 dash alone, the only one of them rejected
+                if (roll % 3 == 2)
+                {
+                    tokens[i] = "\xe2\x80\x94";
+                }
+                else
+                {
+                    tokens[i] = (roll % 3 == 0 ? "\xc3\xa9" : "") + corpus[i] + (roll % 3 == 0 ? "" : "\x01");
+                }
+            }
+            else if (roll < mix.malformed + mix.punctuation)
+            {
+                tokens[i] = "\"--" + corpus[i] + "1999,\"";
+            }
+            else if (roll < mix.malformed + mix.punctuation + mix.junk)
+            {
+                tokens[i] = string(200, '-') + "42";
+            }
+            else
+            {
+                tokens[i] = corpus[i];
+            }
+        }
+
+        HashedSplays table(ALPHABET_SIZE);
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < tokens.size(); ++i)
+        {
+            table.InsertWord(tokens[i]);
+        }
+        double seconds = Elapsed(start);
+
+        unsigned long long distinct = 0;
+        for (int b = 0; b < ALPHABET_SIZE; ++b)
+        {
+            distinct += table.GetBucket(b).GetNodeCounter();
+        }
+        printf("%-16s %12.0f %10llu %12llu\n", mix.name, tokens.size() / seconds,
+               (unsigned long long)table.GetRejectCount(), distinct);
+    }
+}
+
+/*
+ * Section window: memory and query cost of a sliding window as the stream
+ * gets longer, both should level off once the ring is full
+ */
+static void BenchWindow(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    vector<string> queries = QueryWords(corpus, 1000);
+    const int epochs = 8;
+    const double epochTokens = max(1.0, corpus.size() / 32.0);
+
+    WindowedCounter windowed(epochs, epochTokens);
+    printf("%12s %12s %14s %12s\n", "tokens", "words held", "freq-us/query", "topk-ms");
+    size_t report = corpus.size() / 8;
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        windowed.AdvanceTo(i);
+        windowed.InsertWord(corpus[i]);
+        if ((i + 1) % report != 0)
+        {
+            continue;
+        }
+
+        Frequency checksum = 0;
+        Clock::time_point start = Clock::now();
+        for (size_t q = 0; q < queries.size(); ++q)
+        {
+            checksum += windowed.GetFrequency(queries[q], epochs);
+        }
+        double lookups = Elapsed(start);
+
+        vector<Node> top;
+        start = Clock::now();
+        windowed.CollectTopK(10, epochs, top);
+        double topk = Elapsed(start);
+        printf("%12zu %12llu %14.2f %12.2f\n", i + 1, (unsigned long long)windowed.GetNodeCount(),
+               lookups * 1e6 / queries.size(), topk * 1000);
+        if (checksum == 0)
+        {
+            printf("no query word found\n");
+        }
+    }
+}
+
+/*
+ * Section index: counting with postings against plain counting, per
+ * document size, with the compressed size and the cost of a document query
+ */
+static void BenchIndex(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    vector<string> queries = QueryWords(corpus, 1000);
+
+    HashedSplays baseline(ALPHABET_SIZE);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        baseline.InsertWord(corpus[i]);
+    }
+    double plain = Elapsed(start);
+
+    printf("%10s %9s %9s %10s %14s %12s %8s\n", "doc tokens", "seconds", "slowdown", "postings",
+           "bytes/posting", "docs-us/word", "matches");
+    printf("%10s %9.3f %9.2f %10s %14s %12s %8s\n", "none", plain, 1.0, "-", "-", "-", "-");
+    for (size_t docTokens = 10; docTokens <= 100000; docTokens *= 10)
+    {
+        HashedSplays table(ALPHABET_SIZE);
+        InvertedIndex index(table, DOC_LINE);
+        start = Clock::now();
+        for (size_t i = 0; i < corpus.size(); ++i)
+        {
+            index.IndexToken(corpus[i], i / docTokens, i % docTokens);
+        }
+        double seconds = Elapsed(start);
+
+        bool matches = true;
+        vector<uint32_t> docs;
+        size_t found = 0;
+        start = Clock::now();
+        for (size_t i = 0; i < queries.size(); ++i)
+        {
+            index.GetDocuments(queries[i], docs);
+            found += docs.size();
+            matches = matches && table.GetFrequency(queries[i]) == baseline.GetFrequency(queries[i]);
+        }
+        double lookups = Elapsed(start);
+        matches = matches && (found > 0 || queries.empty());
+
+        printf("%10zu %9.3f %9.2f %10llu %14.2f %12.2f %8s\n", docTokens, seconds, seconds / plain,
+               (unsigned long long)index.GetPostingCount(),
+               (double)index.GetPostingBytes() / max((uint64_t)1, index.GetPostingCount()),
+               lookups * 1e6 / max((size_t)1, queries.size()), matches ? "yes" : "NO");
+    }
+}
+
+/*
+ * Section keys: exact keys against folded keys on a corpus with sentence
+ * case and shouting mixed in, node count, insert time and prefix queries
+ */
+static void BenchKeys(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        if (i % 50 == 0)
+        {
+            corpus[i] = Util::Lower(corpus[i]);
+            transform(corpus[i].begin(), corpus[i].end(), corpus[i].begin(), ::toupper);
+        }
+        else if (i % 7 == 0)
+        {
+            corpus[i][0] = toupper(corpus[i][0]);
+        }
+    }
+    vector<string> prefixes;
+    vector<string> queries = QueryWords(corpus, 1000);
+    for (size_t i = 0; i < queries.size(); ++i)
+    {
+        prefixes.push_back(Util::Lower(queries[i].substr(0, min((size_t)3, queries[i].length()))));
+    }
+
+    const char* names[] = { "exact", "folded", "surface" };
+    KeyPolicy policies[] = { KEY_EXACT, KEY_FOLDED, KEY_SURFACE };
+    printf("%-8s %10s %10s %16s %10s\n", "keys", "nodes", "insert-s", "prefix-us/query", "matches");
+    for (int p = 0; p < 3; ++p)
+    {
+        HashedSplays table(ALPHABET_SIZE);
+        table.SetKeyPolicy(policies[p]);
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < corpus.size(); ++i)
+        {
+            table.InsertWord(corpus[i]);
+        }
+        double inserts = Elapsed(start);
+
+        size_t matches = 0;
+        vector<Node> found;
+        start = Clock::now();
+        for (size_t i = 0; i < prefixes.size(); ++i)
+        {
+            table.CollectPrefix(prefixes[i], found);
+            matches += found.size();
+        }
+        double lookups = Elapsed(start);
+
+        uint64_t nodes = 0;
+        for (int b = 0; b < ALPHABET_SIZE; ++b)
+        {
+            nodes += table.GetBucket(b).GetNodeCounter();
+        }
+        printf("%-8s %10llu %10.3f %16.2f %10zu\n", names[p], (unsigned long long)nodes, inserts,
+               lookups * 1e6 / max((size_t)1, prefixes.size()), matches);
+    }
+}
+
+/*
+ * Section multiget: LookupBatch against a loop of single lookups, on the
+ * live trees and frozen, as the batch grows
+ */
+static void BenchMultiget(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    HashedSplays table(ALPHABET_SIZE);
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        table.InsertWord(corpus[i]);
+    }
+
+    // a request draws from the corpus, with one word in ten unknown
+    vector<string> requests(corpus.size());
+    unsigned int seed = 42;
+    for (size_t i = 0; i < requests.size(); ++i)
+    {
+        seed = seed * 1664525 + 1013904223;
+        requests[i] = corpus[seed % corpus.size()];
+        if (seed % 10 == 0)
+        {
+            requests[i] += "qx";
+        }
+    }
+
+    vector<Frequency> expected(requests.size());
+    for (int frozen = 0; frozen < 2; ++frozen)
+    {
+        if (frozen)
+        {
+            table.Freeze();
+        }
+        Clock::time_point start = Clock::now();
+        for (size_t i = 0; i < requests.size(); ++i)
+        {
+            expected[i] = table.GetFrequency(requests[i]);
+        }
+        double single = Elapsed(start);
+        printf("%s: single lookups %.1f ns/key\n", frozen ? "frozen" : "trees", single * 1e9 / requests.size());
+
+        printf("%12s %12s %9s %8s\n", "batch", "ns/key", "speedup", "matches");
+        vector<Frequency> counts(requests.size());
+        for (size_t batch = 16; batch <= requests.size(); batch *= 8)
+        {
+            start = Clock::now();
+            for (size_t i = 0; i < requests.size(); i += batch)
+            {
+                table.LookupBatch(requests.data() + i, min(batch, requests.size() - i), counts.data() + i);
+            }
+            double seconds = Elapsed(start);
+            printf("%12zu %12.1f %9.2f %8s\n", batch, seconds * 1e9 / requests.size(), single / seconds,
+                   counts == expected ? "yes" : "NO");
+        }
+    }
+}
+
+/*
+ * Section adaptive: fixed splay policies against adaptive buckets on
+ * uniform reads, skewed reads and a read/write mix
+ */
+static void BenchAdaptive(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    vector<string> skewed = QueryWords(corpus, 1000000);
+
+    // every distinct word equally often
+    vector<string> uniform;
+    {
+        HashedSplays table(ALPHABET_SIZE);
+        table.InsertBatch(corpus);
+        for (int b = 0; b < ALPHABET_SIZE; ++b)
+        {
+            table.GetBucket(b).inOrder([&](const Node& node) {
+                uniform.push_back(node.GetWord());
+            });
+        }
+        unsigned int seed = 7;
+        for (size_t i = uniform.size(); i > 1; --i)
+        {
+            seed = seed * 1664525 + 1013904223;
+            swap(uniform[i - 1], uniform[seed % i]);
+        }
+        while (uniform.size() < skewed.size())
+        {
+            uniform.push_back(uniform[uniform.size() % (uniform.size() / 2 + 1)]);
+        }
+    }
+
+    struct Workload { const char* name; const vector<string>* queries; int writeEvery; };
+    Workload workloads[] = {
+        { "uniform reads", &uniform, 0 },
+        { "skewed reads", &skewed, 0 },
+        { "skewed 1:3 mix", &skewed, 4 },
+    };
+    const char* policies[] = { "always", "never", "adaptive" };
+
+    printf("%-16s %-10s %12s %s\n", "workload", "policy", "accesses/s", "final modes");
+    for (size_t w = 0; w < sizeof(workloads) / sizeof(workloads[0]); ++w)
+    {
+        const vector<string>& queries = *workloads[w].queries;
+        for (int p = 0; p < 3; ++p)
+        {
+            HashedSplays table(ALPHABET_SIZE);
+            for (size_t i = 0; i < corpus.size(); ++i)
+            {
+                table.InsertWord(corpus[i]);
+            }
+            table.SetAdaptive(p == 2);
+            table.SetSplayPolicy(p == 1 ? SPLAY_NEVER : SPLAY_ALWAYS);
+
+            Frequency checksum = 0;
+            Clock::time_point start = Clock::now();
+            for (size_t i = 0; i < queries.size(); ++i)
+            {
+                if (workloads[w].writeEvery > 0 && i % workloads[w].writeEvery == 0)
+                {
+                    table.InsertWord(queries[i]);
+                }
+                else
+                {
+                    checksum += table.LookupFrequency(queries[i]);
+                }
+            }
+            double seconds = Elapsed(start);
+
+            char modes[64] = "-";
+            if (p == 2)
+            {
+                int counts[3] = { 0, 0, 0 };
+                for (int b = 0; b < ALPHABET_SIZE; ++b)
+                {
+                    counts[table.GetBucketMode(b)]++;
+                }
+                snprintf(modes, sizeof(modes), "%d splaying, %d static, %d frozen", counts[BUCKET_SPLAY],
+                         counts[BUCKET_STATIC], counts[BUCKET_FROZEN]);
+            }
+            printf("%-16s %-10s %12.0f %s\n", workloads[w].name, policies[p], queries.size() / seconds, modes);
+            if (checksum == 0)
+            {
+                printf("no query word found\n");
+            }
+        }
+    }
+}
+
+// Util::Strip as it was, recursive, one copy per character removed. Kept
+// to check the single pass version against
+static string LegacyStrip(string inString)
+{
+    string newString;
+    if (inString == "") return inString;
+    else if (!isalpha(inString[0])) {
+        for (unsigned int i = 1; i < inString.length(); i++) {
+            newString += inString[i];
+        }
+        return LegacyStrip(newString);
+    }
+    else if (!isalpha(inString[inString.length() - 1])) {
+        for (unsigned int i = 0; i < inString.length() - 1; i++) {
+            newString += inString[i];
+        }
+        return LegacyStrip(newString);
+    }
+    bool contraction = false;
+    bool foundalpha = 0;
+    for (unsigned int i = 0; i < inString.length(); i++)
+    {
+        if (isalpha(inString[i])) {
+            newString += inString[i];
+            foundalpha = true;
+        } else if ((int(inString[i]) == 39 || int(inString[i]) == 45) &&
+            !contraction && foundalpha) {
+            newString += inString[i];
+            contraction = true;
+        }
+    }
+    return newString;
+}
+
+/*
+ * Section strip: fuzzes Util::Strip against the recursive version it
+ * replaced, then times both on punctuation heavy tokens
+ */
+static void BenchStrip(const BenchOptions& options)
+{
+    // random printable tokens, weighted towards the characters Strip treats
+    // specially
+    const char special[] = "'-'-.,;:!?\"()<>&#0123456789 ";
+    unsigned int seed = 2020;
+    size_t mismatches = 0;
+    const size_t cases = 200000;
+    for (size_t c = 0; c < cases; ++c)
+    {
+        seed = seed * 1103515245 + 12345;
+        size_t length = (seed >> 16) % 40;
+        string token;
+        for (size_t i = 0; i < length; ++i)
+        {
+            seed = seed * 1103515245 + 12345;
+            unsigned int draw = (seed >> 16) % 100;
+            if (draw < 40)
+            {
+                token += char('a' + draw % 26);
+            }
+            else if (draw < 50)
+            {
+                token += char('A' + draw % 26);
+            }
+            else if (draw < 90)
+            {
+                token += special[draw % (sizeof(special) - 1)];
+            }
+            else
+            {
+                token += char(32 + (seed >> 8) % 95);
+            }
+        }
+        string inPlace = token;
+        Util::StripInPlace(inPlace);
+        string expected = LegacyStrip(token);
+        if (Util::Strip(token) != expected || inPlace != expected)
+        {
+            if (mismatches++ < 5)
+            {
+                printf("MISMATCH on \"%s\": \"%s\" expected \"%s\"\n", token.c_str(), inPlace.c_str(), expected.c_str());
+            }
+        }
+    }
+    printf("fuzz: %zu random tokens, %zu mismatches\n\n", cases, mismatches);
+
+    printf("%-28s %14s %14s %12s\n", "token", "legacy-ns", "single-ns", "allocs/token");
+    for (size_t run = 1; run <= 4096; run *= 8)
+    {
+        string dashes(run, '-');
+        string shapes[] = { dashes + "word" + dashes, "&quot;" + dashes + "it's" + dashes + "&quot;" };
+        for (int shape = 0; shape < 2; ++shape)
+        {
+            const string& token = shapes[shape];
+            // the recursive version is quadratic, it gets fewer runs
+            size_t repeats = max((size_t)1, (size_t)options.tokens * 10 / token.length());
+            size_t legacyRepeats = max((size_t)1, repeats / run);
+
+            Clock::time_point start = Clock::now();
+            string expected;
+            for (size_t r = 0; r < legacyRepeats; ++r)
+            {
+                expected = LegacyStrip(token);
+            }
+            double legacy = Elapsed(start);
+
+            string buffer;
+            buffer.reserve(token.length());
+            unsigned long long allocations = g_allocations.load();
+            start = Clock::now();
+            for (size_t r = 0; r < repeats; ++r)
+            {
+                buffer.assign(token);
+                Util::StripInPlace(buffer);
+            }
+            double single = Elapsed(start);
+            allocations = g_allocations.load() - allocations;
+
+            char name[64];
+            snprintf(name, sizeof(name), "%s x%zu", shape == 0 ? "-word-" : "&quot;-it's-&quot;", run);
+            printf("%-28s %14.0f %14.0f %12.2f%s\n", name, legacy * 1e9 / legacyRepeats,
+                   single * 1e9 / repeats, (double)allocations / repeats, buffer == expected ? "" : "  MISMATCH");
+        }
+    }
+}
+
+/*
+ * Section analytics: what the growth curve adds to counting, and the one
+ * pass scan against a bare traversal and against the sort by frequency a
+ * rank/frequency table would otherwise need
+ */
+static void BenchAnalytics(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+
+    HashedSplays table(ALPHABET_SIZE);
+    Clock::time_point start = Clock::now();
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        table.InsertWord(corpus[i]);
+    }
+    double plain = Elapsed(start);
+
+    HashedSplays tracked(ALPHABET_SIZE);
+    VocabularyGrowth growth;
+    tracked.SetGrowthTracker(&growth);
+    start = Clock::now();
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        tracked.InsertWord(corpus[i]);
+    }
+    double withGrowth = Elapsed(start);
+
+    printf("%-22s %9s %9s\n", "ingest", "seconds", "slowdown");
+    printf("%-22s %9.3f %9.2f\n", "plain", plain, 1.0);
+    printf("%-22s %9.3f %9.2f\n", "with growth curve", withGrowth, withGrowth / plain);
+
+    // bare traversal, the floor for anything that looks at every word
+    uint64_t traversed = 0;
+    start = Clock::now();
+    for (int b = 0; b < table.m_trees; ++b)
+    {
+        table.GetBucket(b).inOrder([&](const Node& node) { traversed += node.GetFrequency(); });
+    }
+    double bare = Elapsed(start);
+
+    Analytics analytics;
+    start = Clock::now();
+    analytics.Scan(table);
+    double exponent, constant, r2;
+    analytics.FitZipf(exponent, constant, r2);
+    double scan = Elapsed(start);
+
+    // ranks the usual way, every node copied out and sorted
+    start = Clock::now();
+    vector<Frequency> frequencies;
+    for (int b = 0; b < table.m_trees; ++b)
+    {
+        table.GetBucket(b).inOrder([&](const Node& node) { frequencies.push_back(node.GetFrequency()); });
+    }
+    sort(frequencies.begin(), frequencies.end(), greater<Frequency>());
+    double sorted = Elapsed(start);
+
+    printf("\n%-22s %9s %9s\n", "statistics", "seconds", "x bare");
+    printf("%-22s %9.4f %9.2f\n", "bare traversal", bare, 1.0);
+    printf("%-22s %9.4f %9.2f\n", "one pass scan + fit", scan, scan / bare);
+    printf("%-22s %9.4f %9.2f\n", "copy and sort", sorted, sorted / bare);
+
+    double k, beta, heapsR2;
+    growth.FitHeaps(k, beta, heapsR2);
+    printf("\nzipf s %.3f (r2 %.3f)  heaps beta %.3f (r2 %.3f)  hapax %llu of %llu  tokens match %s\n",
+           exponent, r2, beta, heapsR2, (unsigned long long)analytics.GetHapax(),
+           (unsigned long long)analytics.GetDistinct(),
+           analytics.GetTokens() == traversed && growth.GetTokens() == traversed ? "yes" : "NO");
+}
+
+/*
+ * Section async: the corpus written out as many small files and as a few
+ * large ones, each set counted with FileReader per file, with read() one
+ * file at a time and with io_uring at two queue depths. The files are in
+ * the page cache after the first pass, so this measures system call and
+ * queueing overhead rather than the device
+ */
+static void BenchAsync(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    vector<string> queries = QueryWords(corpus, 1000);
+    size_t shapes[2] = { max((size_t)1, corpus.size() / 600), 4 };
+
+    for (int shape = 0; shape < 2; ++shape)
+    {
+        vector<string> paths;
+        size_t perFile = (corpus.size() + shapes[shape] - 1) / shapes[shape];
+        for (size_t first = 0; first < corpus.size(); first += perFile)
+        {
+            char path[64];
+            snprintf(path, sizeof(path), "bench_async_%zu.tmp", paths.size());
+            paths.push_back(path);
+            ofstream ofs(path);
+            for (size_t i = first; i < min(corpus.size(), first + perFile); ++i)
+            {
+                ofs << corpus[i] << (i % 12 == 11 ? '\n' : ' ');
+            }
+        }
+
+        HashedSplays baseline(ALPHABET_SIZE);
+        Clock::time_point start = Clock::now();
+        for (size_t f = 0; f < paths.size(); ++f)
+        {
+            baseline.FileReader(paths[f]);
+        }
+        double serial = Elapsed(start);
+
+        printf("%zu files\n%-22s %8s %8s %10s %8s\n", paths.size(), "reader", "seconds", "speedup", "syscalls",
+               "matches");
+        printf("%-22s %8.3f %8.2f %10s %8s\n", "FileReader", serial, 1.0, "-", "-");
+        int depths[3] = { 0, 32, 256 };
+        for (int d = 0; d < 3; ++d)
+        {
+            HashedSplays table(ALPHABET_SIZE);
+            AsyncReader reader(table, depths[d] == 0 ? 1 : depths[d], ASYNC_BUFFER, depths[d] > 0);
+            start = Clock::now();
+            reader.FileReader(paths);
+            double seconds = Elapsed(start);
+
+            bool matches = true;
+            for (size_t i = 0; i < queries.size(); ++i)
+            {
+                matches = matches && table.GetFrequency(queries[i]) == baseline.GetFrequency(queries[i]);
+            }
+            char name[32];
+            if (!reader.UsesUring())
+            {
+                snprintf(name, sizeof(name), depths[d] == 0 ? "read()" : "read() (no io_uring)");
+            }
+            else
+            {
+                snprintf(name, sizeof(name), "io_uring depth %d", depths[d]);
+            }
+            printf("%-22s %8.3f %8.2f %10llu %8s\n", name, seconds, serial / seconds,
+                   (unsigned long long)reader.GetSyscalls(), matches ? "yes" : "NO");
+        }
+        printf("\n");
+
+        for (size_t f = 0; f < paths.size(); ++f)
+        {
+            remove(paths[f].c_str());
+        }
+    }
+}
+
+// Resident set size in bytes, from /proc/self/statm
+static size_t ResidentBytes()
+{
+    ifstream statm("/proc/self/statm");
+    size_t pages = 0, resident = 0;
+    statm >> pages >> resident;
+    return resident * sysconf(_SC_PAGESIZE);
+}
+
+/*
+ * Section spill: a high cardinality stream (half the tokens long words
+ * never seen again, like URLs or IDs, half Zipf words) counted under
+ * shrinking memory budgets. The peak resident size is sampled while
+ * counting and the merged result is checked against counting in memory
+ */
+static void BenchSpill(const BenchOptions& options)
+{
+    vector<unsigned int> ranks = ZipfRanks(options.tokens / 2, options.vocab, 221);
+    size_t budgets[4] = { 4 << 20, 16 << 20, 64 << 20, 0 };
+
+    // the unlimited run goes first, to check the others against, and the
+    // heap it frees is trimmed so it does not hide the smaller peaks
+    uint64_t expectedWords = 0, expectedHash = 0;
+    vector<string> rows;
+    printf("%10s %9s %9s %10s %6s %10s %8s\n", "budget MB", "count s", "merge s", "peak RSS MB", "runs",
+           "spilled MB", "matches");
+    for (int b = 3; b >= 0; --b)
+    {
+        malloc_trim(0);
+        size_t before = ResidentBytes();
+        size_t peak = before;
+
+        HashedSplays table(ALPHABET_SIZE);
+        if (budgets[b] > 0)
+        {
+            table.SetMemoryBudget(budgets[b], ".");
+        }
+        Clock::time_point start = Clock::now();
+        for (int i = 0; i < options.tokens; ++i)
+        {
+            if (i % 2 == 0)
+            {
+                table.InsertWord(SyntheticWord(ranks[i / 2]));
+            }
+            else
+            {
+                table.InsertWord(SyntheticWord(options.vocab + i) + SyntheticWord(i * 31 + 7) + "id");
+            }
+            if (i % 16384 == 0)
+            {
+                peak = max(peak, ResidentBytes());
+            }
+        }
+        double counting = Elapsed(start);
+        peak = max(peak, ResidentBytes());
+
+        // order and totals of the merged table, compared with the run in memory
+        uint64_t words = 0, hash = 1469598103934665603ULL;
+        start = Clock::now();
+        table.ForEachMerged([&](const Node& node) {
+            for (size_t c = 0; c < node.GetWord().length(); ++c)
+            {
+                hash = (hash ^ (unsigned char)node.GetWord()[c]) * 1099511628211ULL;
+            }
+            hash = (hash ^ node.GetFrequency()) * 1099511628211ULL;
+            words++;
+        });
+        double merging = Elapsed(start);
+        if (budgets[b] == 0)
+        {
+            expectedWords = words;
+            expectedHash = hash;
+        }
+
+        const SpillStore* spill = table.GetSpillStore();
+        char line[160];
+        snprintf(line, sizeof(line), "%10s %9.3f %9.3f %10.1f %6d %10.1f %8s",
+                 budgets[b] == 0 ? "none" : to_string(budgets[b] >> 20).c_str(), counting, merging,
+                 (peak - before) / 1048576.0, spill == NULL ? 0 : spill->GetRunCount(),
+                 spill == NULL ? 0.0 : spill->GetBytesWritten() / 1048576.0,
+                 words == expectedWords && hash == expectedHash ? "yes" : "NO");
+        rows.push_back(line);
+    }
+    for (int r = (int)rows.size() - 1; r >= 0; --r)
+    {
+        printf("%s\n", rows[r].c_str());
+    }
+    printf("%llu distinct words\n", (unsigned long long)expectedWords);
+}
+
+// The order trees used before KeyOrder, a call to Node's operator<
+struct OperatorOrder
+{
+    static bool Less(const Node& a, const Node& b) { return a < b; }
+};
+
+// Count stripped words into one tree per bucket, the way InsertPrepared does
+template <typename Tree, typename IndexOf>
+static void CountInto(vector<Tree>& trees, const vector<string>& words, IndexOf indexOf)
+{
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        int index = indexOf(words[i]);
+        if (index < 0 || index >= (int)trees.size())
+        {
+            continue;
+        }
+        Node word(words[i], 1);
+        Node* found = trees[index].access(word);
+        if (found != NULL)
+        {
+            found->IncrementFrequency();
+        }
+        else
+        {
+            trees[index].insert(move(word));
+        }
+    }
+}
+
+/*
+ * Section traits: bucketing and tree comparisons per token, the run time
+ * path (lowercase copy, first letter - 97, Node::operator< out of line)
+ * against the compiled one (TableBuckets, inlined ByteOrder). Instructions
+ * come from perf_event_open when the machine has hardware counters
+ */
+static void BenchTraits(const BenchOptions& options)
+{
+    vector<string> corpus = LoadCorpus(options);
+    vector<string> words;
+    words.reserve(corpus.size());
+    for (size_t i = 0; i < corpus.size(); ++i)
+    {
+        string word = Util::Strip(corpus[i]);
+        if (word.length() > 0)
+        {
+            // sentence case now and then, so folding has work to do
+            if (i % 5 == 0)
+            {
+                word[0] = toupper(word[0]);
+            }
+            words.push_back(word);
+        }
+    }
+
+    PerfCounter instructions;
+    printf("%-28s %9s %10s %14s %8s\n", "path", "seconds", "ns/token", "instr/token", "matches");
+
+    vector<SplayTree<Node, OperatorOrder> > generic(ALPHABET_SIZE);
+    instructions.Start();
+    Clock::time_point start = Clock::now();
+    CountInto(generic, words, [](const string& word) { return int(Util::Lower(word)[0]) - 97; });
+    double genericSeconds = Elapsed(start);
+    uint64_t genericInstructions = instructions.Stop();
+
+    vector<SplayTree<Node> > compiled(ALPHABET_SIZE);
+    instructions.Start();
+    start = Clock::now();
+    CountInto(compiled, words, [](const string& word) { return TableBuckets::Index(word[0]); });
+    double compiledSeconds = Elapsed(start);
+    uint64_t compiledInstructions = instructions.Stop();
+
+    bool matches = true;
+    for (int b = 0; b < ALPHABET_SIZE; ++b)
+    {
+        vector<Node> a, c;
+        generic[b].inOrder([&](const Node& node) { a.push_back(node); });
+        compiled[b].inOrder([&](const Node& node) { c.push_back(node); });
+        matches = matches && a.size() == c.size();
+        for (size_t n = 0; matches && n < a.size(); ++n)
+        {
+            matches = a[n].GetWord() == c[n].GetWord() && a[n].GetFrequency() == c[n].GetFrequency();
+        }
+    }
+
+    // the whole insert path as the table runs it now, for scale
+    HashedSplays table(ALPHABET_SIZE);
+    instructions.Start();
+    start = Clock::now();
+    for (size_t i = 0; i < words.size(); ++i)
+    {
+        table.InsertWord(words[i]);
+    }
+    double tableSeconds = Elapsed(start);
+    uint64_t tableInstructions = instructions.Stop();
+
+    double n = max((size_t)1, words.size());
+    char count[32];
+    snprintf(count, sizeof(count), instructions.IsAvailable() ? "%.0f" : "n/a", genericInstructions / n);
+    printf("%-28s %9.3f %10.1f %14s %8s\n", "run time index, operator<", genericSeconds, genericSeconds * 1e9 / n,
+           count, "-");
+    snprintf(count, sizeof(count), instructions.IsAvailable() ? "%.0f" : "n/a", compiledInstructions / n);
+    printf("%-28s %9.3f %10.1f %14s %8s\n", "TableBuckets, ByteOrder", compiledSeconds, compiledSeconds * 1e9 / n,
+           count, matches ? "yes" : "NO");
+    snprintf(count, sizeof(count), instructions.IsAvailable() ? "%.0f" : "n/a", tableInstructions / n);
+    printf("%-28s %9.3f %10.1f %14s %8s\n", "HashedSplays::InsertWord", tableSeconds, tableSeconds * 1e9 / n,
+           count, "-");
+    if (!instructions.IsAvailable())
+    {
+        printf("no hardware instruction counter here, times only\n");
+    }
+}
+
+// Anonymous memory backed by transparent huge pages, from /proc/self/smaps_rollup
+static size_t AnonHugeBytes()
+{
+    ifstream rollup("/proc/self/smaps_rollup");
+    string key;
+    size_t kilobytes = 0;
+    while (rollup >> key)
+    {
+        if (key == "AnonHugePages:" && rollup >> kilobytes)
+        {
+            return kilobytes * 1024;
+        }
+        rollup.ignore(256, '\n');
+    }
+    return 0;
+}
+
+/*
+ * Section pages: a large table built in random order, then random
+ * lookups, with nodes from operator new and from NodeArena chunks of small,
+ * transparent huge and reserved huge pages. dTLB read misses come from
+ * perf_event_open where the machine has the counter. The last row fills
+ * the buckets from the executor's threads, each chunk placed on the NUMA
+ * node of the thread that mapped it
+ */
+static void BenchPages(const BenchOptions& options)
+{
+    // distinct words in a random order, so nodes are scattered in memory
+    vector<string> words;
+    for (int i = 0; i < options.tokens / 2; ++i)
+    {
+        words.push_back(SyntheticWord(i) + SyntheticWord(i * 7 + 3));
+    }
+    unsigned int seed = 2020;
+    for (size_t i = words.size() - 1; i > 0; --i)
+    {
+        seed = seed * 1103515245 + 12345;
+        swap(words[i], words[(seed >> 8) % (i + 1)]);
+    }
+    vector<string> queries = QueryWords(words, options.tokens);
+
+    PerfCounter misses(PERF_TYPE_HW_CACHE, PERF_COUNT_HW_CACHE_DTLB | (PERF_COUNT_HW_CACHE_OP_READ << 8)
+                                           | (PERF_COUNT_HW_CACHE_RESULT_MISS << 16));
+    const char* names[5] = { "operator new", "small pages", "transparent huge", "reserved huge",
+                             "transparent, threads" };
+    printf("%-22s %9s %12s %12s %10s %9s %12s\n", "nodes from", "build s", "lookup ns", "dTLB miss/op",
+           "THP MB", "huge pgs", "NUMA chunks");
+    for (int config = 0; config < 5; ++config)
+    {
+        size_t hugeBefore = AnonHugeBytes();
+        BucketExecutor executor(4);
+        HashedSplays table(ALPHABET_SIZE);
+        table.SetSplayPolicy(SPLAY_NEVER);
+        if (config > 0)
+        {
+            PageMode modes[5] = { PAGES_SMALL, PAGES_SMALL, PAGES_TRANSPARENT, PAGES_HUGE, PAGES_TRANSPARENT };
+            table.SetPageMode(modes[config]);
+        }
+
+        Clock::time_point start = Clock::now();
+        if (config < 4)
+        {
+            for (size_t i = 0; i < words.size(); ++i)
+            {
+                table.InsertWord(words[i]);
+            }
+        }
+        else
+        {
+            // every bucket filled by the worker that owns it for the call
+            vector<vector<string> > byBucket(ALPHABET_SIZE);
+            for (size_t i = 0; i < words.size(); ++i)
+            {
+                byBucket[TableBuckets::Index(words[i][0])].push_back(words[i]);
+            }
+            table.SetExecutor(&executor);
+            table.ForEachBucket([&](int b) {
+                for (size_t i = 0; i < byBucket[b].size(); ++i)
+                {
+                    table.InsertPrepared(b, byBucket[b][i]);
+                }
+            });
+        }
+        double build = Elapsed(start);
+        size_t hugeAfter = AnonHugeBytes();
+
+        Frequency found = 0;
+        misses.Start();
+        start = Clock::now();
+        for (size_t q = 0; q < queries.size(); ++q)
+        {
+            found += table.GetFrequency(queries[q]);
+        }
+        double lookup = Elapsed(start);
+        uint64_t missCount = misses.Stop();
+
+        size_t hugePages = 0;
+        vector<size_t> nodes(ARENA_MAX_NODES, 0);
+        for (int b = 0; b < ALPHABET_SIZE && config > 0; ++b)
+        {
+            hugePages += table.GetArena(b)->GetHugeChunkCount();
+            for (int n = 0; n < ARENA_MAX_NODES; ++n)
+            {
+                nodes[n] += table.GetArena(b)->GetNodeChunks()[n];
+            }
+        }
+        string placement = config > 0 ? "" : "-";
+        for (int n = 0; n < ARENA_MAX_NODES; ++n)
+        {
+            if (nodes[n] > 0)
+            {
+                placement += (placement.empty() ? "" : ",") + to_string(n) + ":" + to_string(nodes[n]);
+            }
+        }
+        char perOp[32];
+        snprintf(perOp, sizeof(perOp), misses.IsAvailable() ? "%.2f" : "n/a",
+                 (double)missCount / max((size_t)1, queries.size()));
+        printf("%-22s %9.3f %12.1f %12s %10.1f %9zu %12s%s\n", names[config], build,
+               lookup * 1e9 / max((size_t)1, queries.size()), perOp,
+               (hugeAfter > hugeBefore ? hugeAfter - hugeBefore : 0) / 1048576.0, hugePages, placement.c_str(),
+               found == 0 ? " (nothing found)" : "");
+    }
+    if (!misses.IsAvailable())
+    {
+        printf("no dTLB miss counter here, times only\n");
+    }
+}
+
+// Every section, in the order "all" runs them
+struct BenchSection
+{
+    const char* name;
+    const char* description;
+    void (*run)(const BenchOptions&);
+};
+
+static BenchSection sections[] = {
+    { "lookup", "lookup throughput per splay policy", BenchLookup },
+    { "filter", "stopword filter cost per token", BenchFilter },
+    { "approx", "count-min sketch accuracy against memory", BenchApprox },
+    { "frozen", "frozen Eytzinger buckets against live splay trees", BenchFrozen },
+    { "parallel", "per bucket operations as threads grow", BenchParallel },
+    { "pipeline", "threaded ingestion against FileReader", BenchPipeline },
+    { "batch", "batched sorted insertion against per token inserts", BenchBatch },
+    { "alloc", "heap allocations per insert, copying against moving", BenchAlloc },
+    { "adversarial", "insert throughput on malformed and noisy input", BenchAdversarial },
+    { "window", "sliding window memory and query cost over a long stream", BenchWindow },
+    { "index", "counting with an inverted index against plain counting", BenchIndex },
+    { "keys", "exact against case folded keys, nodes and prefix queries", BenchKeys },
+    { "multiget", "batched interleaved lookups against single lookups", BenchMultiget },
+    { "adaptive", "fixed splay policies against adaptive buckets", BenchAdaptive },
+    { "strip", "single pass Strip against the recursive one, fuzzed and timed", BenchStrip },
+    { "analytics", "distribution statistics in one scan, growth curve cost", BenchAnalytics },
+    { "async", "io_uring and read() against FileReader, many small and a few large files", BenchAsync },
+    { "spill", "peak memory and merge cost under a memory budget, high cardinality", BenchSpill },
+    { "traits", "compile time bucket table and inlined comparisons against the run time path", BenchTraits },
+    { "pages", "huge page and NUMA placed node arenas against operator new, lookups and dTLB misses", BenchPages },
+};
+
+int main(int argc, char *argv[])
+{
+    BenchOptions options;
+    options.tokens = 2000000;
+    options.vocab = 200000;
+    string selected = argc > 1 ? argv[1] : "all";
+
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--file") == 0 && i + 1 < argc)
+            options.file = argv[++i];
+        else if (strcmp(argv[i], "--tokens") == 0 && i + 1 < argc)
+            options.tokens = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--vocab") == 0 && i + 1 < argc)
+            options.vocab = atoi(argv[++i]);
+        else
+        {
+            cout << "Unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    bool ran = false;
+    try
+    {
+        for (size_t s = 0; s < sizeof(sections) / sizeof(sections[0]); ++s)
+        {
+            if (selected == "all" || selected == sections[s].name)
+            {
+                cout << "========== " << sections[s].name << ": " << sections[s].description << endl;
+                sections[s].run(options);
+                cout << endl;
+                ran = true;
+            }
+        }
+    }
+    catch (Exceptions &cException)
+    {
+        cout << "EXCEPTION: " << cException.GetMessage() << endl;
+        return 1;
+    }
+
+    if (!ran)
+    {
+        cout << "Sections:";
+        for (size_t s = 0; s < sizeof(sections) / sizeof(sections[0]); ++s)
+        {
+            cout << " " << sections[s].name;
+        }
+        cout << endl;
+        return 1;
+    }
+    return 0;
+}
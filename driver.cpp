@@ -12,17 +12,528 @@
 #include "HashedSplays.h"  // Includes constants
 // #include "dsexceptions.h"
 #include "Exceptions.h"
+#include "QueryServer.h"
+#include "Checkpoint.h"
+#include "ApproxCounter.h"
+#include "IngestPipeline.h"
+#include "ShardedCounter.h"
+#include "WindowedCounter.h"
+#include "InvertedIndex.h"
+#include "Analytics.h"
+#include "AsyncReader.h"
+#include <fstream>
+#include <chrono>
 #include <time.h>
+#include <cstring>
+#include <cstdlib>
 
 using namespace std;
 
 int main(int argc, char *argv[]) {
 
+    if (argc < 2) {
+        cout << "Usage: " << argv[0] << " <file> [--serve unix:/path|tcp:port] [--threads n]"
+             << " [--splay always|never|adaptive|fraction] [--incremental checkpoint]"
+             << " [--stopwords builtin|file] [--min-length n] [--max-length n] [--stem]"
+             << " [--approx epsilon] [--heavy n] [--freeze] [--workers n] [--pipeline n] [--batch n]"
+             << " [--processes n] [--window epochs:length(s|t)] [--index file|line] [--postings word,word,...]"
+             << " [--keys exact|folded|surface] [--analytics text|json[:file]]"
+             << " [--inputs list] [--async depth|read]"
+             << " [--memory bytes[k|m|g]] [--spill-dir dir] [--record trace]"
+             << " [--pages small|transparent|huge]"
+             << " [--find-all part,part,...] [--dump]" << endl;
+        return 1;
+    }
+
+    // optional modes follow the input file
+    string serveEndpoint;
+    int serveThreads = 1;
+    SplayPolicy splayPolicy = SPLAY_ALWAYS;
+    double splayFraction = 1.0;
+    bool adaptive = false;
+    string checkpointPath;
+    TokenFilter filter;
+    bool useFilter = false;
+    string stopwordSource;
+    double approxEpsilon = 0.0;
+    int windowEpochs = 0;
+    double windowLength = 0.0;
+    bool windowByTokens = false;
+    int heavyHitters = 1000;
+    bool freeze = false;
+    int workers = 1;
+    int pipelineInserters = 0;
+    int batchSize = 0;
+    int processes = 0;
+    vector<string> findAllParts;
+    bool buildIndex = false;
+    DocumentUnit indexUnit = DOC_FILE;
+    vector<string> postingWords;
+    KeyPolicy keyPolicy = KEY_EXACT;
+    string analyticsFormat;
+    vector<string> inputs;
+    int asyncDepth = 0;
+    size_t memoryBudget = 0;
+    string spillDirectory = ".";
+    string tracePath;
+    bool usePages = false;
+    PageMode pageMode = PAGES_TRANSPARENT;
+    bool asyncUring = true;
+    string analyticsPath;
+    bool dump = false;
+    size_t minLength = 0;
+    size_t maxLength = 0;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--serve") == 0 && i + 1 < argc) {
+            serveEndpoint = argv[++i];
+        }
+        else if (strcmp(argv[i], "--threads") == 0 && i + 1 < argc) {
+            serveThreads = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--stopwords") == 0 && i + 1 < argc) {
+            stopwordSource = argv[++i];
+            useFilter = true;
+        }
+        else if (strcmp(argv[i], "--min-length") == 0 && i + 1 < argc) {
+            minLength = atoi(argv[++i]);
+            useFilter = true;
+        }
+        else if (strcmp(argv[i], "--max-length") == 0 && i + 1 < argc) {
+            maxLength = atoi(argv[++i]);
+            useFilter = true;
+        }
+        else if (strcmp(argv[i], "--stem") == 0) {
+            filter.SetStemming(true);
+            useFilter = true;
+        }
+        else if (strcmp(argv[i], "--approx") == 0 && i + 1 < argc) {
+            approxEpsilon = atof(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--window") == 0 && i + 1 < argc) {
+            // epochs:length, length in seconds (s) or tokens (t)
+            string spec = argv[++i];
+            size_t colon = spec.find(':');
+            windowEpochs = atoi(spec.substr(0, colon).c_str());
+            windowLength = colon == string::npos ? 0.0 : atof(spec.substr(colon + 1).c_str());
+            windowByTokens = spec[spec.length() - 1] == 't';
+        }
+        else if (strcmp(argv[i], "--heavy") == 0 && i + 1 < argc) {
+            heavyHitters = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--pipeline") == 0 && i + 1 < argc) {
+            pipelineInserters = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--batch") == 0 && i + 1 < argc) {
+            batchSize = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--processes") == 0 && i + 1 < argc) {
+            processes = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--index") == 0 && i + 1 < argc) {
+            // what a document is, the whole file or each line
+            string unit = argv[++i];
+            buildIndex = true;
+            if (unit == "line") {
+                indexUnit = DOC_LINE;
+            }
+            else if (unit != "file") {
+                cout << "Unknown document unit " << unit << endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+            // fold case once at insert instead of in every comparison
+            string policy = argv[++i];
+            if (policy == "folded") {
+                keyPolicy = KEY_FOLDED;
+            }
+            else if (policy == "surface") {
+                keyPolicy = KEY_SURFACE;
+            }
+            else if (policy != "exact") {
+                cout << "Unknown key policy " << policy << endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--analytics") == 0 && i + 1 < argc) {
+            // distribution report, to cout or to the file after the colon
+            analyticsFormat = argv[++i];
+            size_t colon = analyticsFormat.find(':');
+            if (colon != string::npos) {
+                analyticsPath = analyticsFormat.substr(colon + 1);
+                analyticsFormat.erase(colon);
+            }
+            if (analyticsFormat != "text" && analyticsFormat != "json") {
+                cout << "Unknown report format " << analyticsFormat << endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--inputs") == 0 && i + 1 < argc) {
+            // more files to count after the first, one path per line
+            ifstream list(argv[++i]);
+            if (!list) {
+                cout << "Could not open " << argv[i] << endl;
+                return 1;
+            }
+            string path;
+            while (getline(list, path)) {
+                if (path.length() > 0) {
+                    inputs.push_back(path);
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--async") == 0 && i + 1 < argc) {
+            // reads in flight through io_uring, or read() one file at a time
+            string depth = argv[++i];
+            asyncDepth = depth == "read" ? ASYNC_DEPTH : atoi(depth.c_str());
+            asyncUring = depth != "read";
+            if (asyncDepth <= 0) {
+                cout << "Unknown read depth " << depth << endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--memory") == 0 && i + 1 < argc) {
+            // budget for the trees, buckets spill to disk past it
+            char* unit = NULL;
+            double amount = strtod(argv[++i], &unit);
+            double scale = *unit == 'k' ? 1024.0 : *unit == 'm' ? 1048576.0 : *unit == 'g' ? 1073741824.0 : 1.0;
+            memoryBudget = (size_t)(amount * scale);
+            if (memoryBudget == 0) {
+                cout << "Unknown memory budget " << argv[i] << endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--spill-dir") == 0 && i + 1 < argc) {
+            spillDirectory = argv[++i];
+        }
+        else if (strcmp(argv[i], "--pages") == 0 && i + 1 < argc) {
+            // tree nodes in 2 MB chunks of this page size, NUMA local
+            string pages = argv[++i];
+            usePages = true;
+            if (pages == "small") {
+                pageMode = PAGES_SMALL;
+            }
+            else if (pages == "transparent") {
+                pageMode = PAGES_TRANSPARENT;
+            }
+            else if (pages == "huge") {
+                pageMode = PAGES_HUGE;
+            }
+            else {
+                cout << "Unknown page size " << pages << endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--record") == 0 && i + 1 < argc) {
+            // every table operation from here on, for Replay.out
+            tracePath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--postings") == 0 && i + 1 < argc) {
+            stringstream words(argv[++i]);
+            string word;
+            while (getline(words, word, ',')) {
+                if (word.length() > 0) {
+                    postingWords.push_back(word);
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--find-all") == 0 && i + 1 < argc) {
+            // comma separated word segments
+            stringstream parts(argv[++i]);
+            string part;
+            while (getline(parts, part, ',')) {
+                if (part.length() > 0) {
+                    findAllParts.push_back(part);
+                }
+            }
+        }
+        else if (strcmp(argv[i], "--dump") == 0) {
+            dump = true;
+        }
+        else if (strcmp(argv[i], "--freeze") == 0) {
+            freeze = true;
+        }
+        else if (strcmp(argv[i], "--incremental") == 0 && i + 1 < argc) {
+            checkpointPath = argv[++i];
+        }
+        else if (strcmp(argv[i], "--splay") == 0 && i + 1 < argc) {
+            // always, never, or the fraction of accesses that splay
+            string policy = argv[++i];
+            if (policy == "always") {
+                splayPolicy = SPLAY_ALWAYS;
+            }
+            else if (policy == "never") {
+                splayPolicy = SPLAY_NEVER;
+            }
+            else if (policy == "adaptive") {
+                // every bucket picks splaying, static or frozen itself
+                adaptive = true;
+            }
+            else {
+                // the whole value must be a fraction in [0,1]
+                char* end = NULL;
+                splayFraction = strtod(policy.c_str(), &end);
+                if (policy.length() == 0 || *end != '\0' || !(splayFraction >= 0 && splayFraction <= 1)) {
+                    cout << "Unknown splay policy " << policy << endl;
+                    return 1;
+                }
+                splayPolicy = SPLAY_SOMETIMES;
+            }
+        }
+        else {
+            cout << "Unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    // the budget is kept by single threaded inserts in reading order
+    if (memoryBudget > 0 && (pipelineInserters > 0 || processes > 0 || batchSize > 0 || buildIndex
+                             || checkpointPath.length() > 0)) {
+        cout << "--memory needs the plain or --async reader" << endl;
+        return 1;
+    }
+
+    // they read the trees, which hold only part of the counts after a spill
+    if (memoryBudget > 0 && (serveEndpoint.length() > 0 || analyticsFormat.length() > 0 || freeze
+                             || !findAllParts.empty())) {
+        cout << "--memory cannot be used with --serve, --analytics, --freeze or --find-all" << endl;
+        return 1;
+    }
+
+    // those paths count one file, their checkpoint, stream or stats describe it
+    if (inputs.size() > 0 && (pipelineInserters > 0 || processes > 0 || checkpointPath.length() > 0
+                              || windowEpochs > 0 || approxEpsilon > 0.0)) {
+        cout << "--inputs needs the plain, --async, --batch or --index reader" << endl;
+        return 1;
+    }
+
+    // those paths count without InsertWord, a replay could not repeat them
+    if (tracePath.length() > 0 && (pipelineInserters > 0 || processes > 0 || batchSize > 0 || buildIndex)) {
+        cout << "--record needs the plain, --async or --incremental reader" << endl;
+        return 1;
+    }
+
     try {
+        // closed last, after the table is done with it
+        TraceRecorder recorder;
+        if (tracePath.length() > 0) {
+            recorder.Open(tracePath);
+        }
+
         // Instatiate the main object
         HashedSplays wordFrequecy(ALPHABET_SIZE);
+        if (tracePath.length() > 0) {
+            wordFrequecy.SetTraceRecorder(&recorder);
+        }
+        wordFrequecy.SetSplayPolicy(splayPolicy, splayFraction);
+        VocabularyGrowth growth;
+        if (memoryBudget > 0) {
+            wordFrequecy.SetMemoryBudget(memoryBudget, spillDirectory);
+        }
+        if (usePages) {
+            wordFrequecy.SetPageMode(pageMode);
+        }
+        wordFrequecy.SetKeyPolicy(keyPolicy);
+        if (adaptive) {
+            wordFrequecy.SetAdaptive(true);
+        }
+
+        // per bucket work fans out over this many threads
+        BucketExecutor executor(workers);
+        if (workers > 1) {
+            wordFrequecy.SetExecutor(&executor);
+        }
+        if (useFilter) {
+            if (stopwordSource == "builtin") {
+                filter.UseBuiltinStopwords();
+            }
+            else if (stopwordSource.length() > 0) {
+                filter.LoadStopwords(stopwordSource);
+            }
+            filter.SetLengthLimits(minLength, maxLength);
+            wordFrequecy.SetFilter(&filter);
+        }
+
+        // Windowed mode reads the input (- for stdin) as a stream
+        if (windowEpochs > 0) {
+            WindowedCounter windowed(windowEpochs, windowLength);
+            windowed.SetKeyPolicy(keyPolicy);
+            if (useFilter) {
+                windowed.SetFilter(&filter);
+            }
+            ifstream file;
+            if (strcmp(argv[1], "-") != 0) {
+                file.open(argv[1]);
+                if (!file) {
+                    throw IllegalArgumentException();
+                }
+            }
+            istream& in = strcmp(argv[1], "-") == 0 ? cin : file;
+
+            chrono::steady_clock::time_point start = chrono::steady_clock::now();
+            string word;
+            long long tokens = 0;
+            while (in >> word) {
+                // the clock is read every 256 tokens in seconds mode
+                if (windowByTokens) {
+                    windowed.AdvanceTo(tokens);
+                }
+                else if (tokens % 256 == 0) {
+                    windowed.AdvanceTo(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+                }
+                windowed.InsertWord(word);
+                tokens++;
+            }
+            if (!windowByTokens) {
+                windowed.AdvanceTo(chrono::duration<double>(chrono::steady_clock::now() - start).count());
+            }
+            windowed.PrintWindowResults(10);
+            return 0;
+        }
+
+        // Approximate mode counts in fixed memory, no trees are built
+        if (approxEpsilon > 0.0) {
+            ApproxCounter approx(approxEpsilon, 0.01, heavyHitters);
+            approx.SetFoldCase(keyPolicy != KEY_EXACT);
+            if (useFilter) {
+                approx.SetFilter(&filter);
+            }
+            approx.FileReader(argv[1]);
+            approx.PrintApproxResults(20);
+            return 0;
+        }
+
         // Build the trees
-        wordFrequecy.FileReader(argv[1]);
+        if (checkpointPath.length() > 0) {
+            // resume from the snapshot when the file only grew since the checkpoint
+            Checkpoint checkpoint;
+            string snapshotPath = checkpointPath + ".table";
+            if (!checkpoint.Load(checkpointPath) || !checkpoint.Matches(argv[1])
+                || !wordFrequecy.LoadSnapshot(snapshotPath, checkpoint.GetGeneration())) {
+                checkpoint = Checkpoint();
+            }
+            cout << "Counting " << argv[1] << " from byte " << checkpoint.GetOffset() << endl;
+
+            string carry = checkpoint.GetCarry();
+            long long offset = wordFrequecy.FileReaderFrom(argv[1], checkpoint.GetOffset(), carry);
+
+            // snapshot excludes the partial token, it is counted only in memory
+            uint64_t generation = Checkpoint::NewGeneration();
+            wordFrequecy.SaveSnapshot(snapshotPath, generation);
+            checkpoint.Capture(argv[1], offset, carry, generation);
+            checkpoint.Save(checkpointPath);
+            wordFrequecy.InsertWord(carry);
+        }
+        else if (pipelineInserters > 0) {
+            // read, tokenize and insert overlap on their own threads
+            IngestPipeline pipeline(wordFrequecy, pipelineInserters);
+            pipeline.FileReader(argv[1]);
+            pipeline.PrintMetrics();
+        }
+        else if (buildIndex) {
+            // postings are recorded as the words are counted
+            wordFrequecy.SetGrowthTracker(&growth);
+            InvertedIndex index(wordFrequecy, indexUnit);
+            index.FileReader(argv[1]);
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                index.FileReader(inputs[i]);
+            }
+            cout << "Indexed " << index.GetPostingCount() << " postings over " << index.GetDocumentCount()
+                 << " documents in " << index.GetPostingBytes() << " bytes" << endl;
+            for (size_t i = 0; i < postingWords.size(); ++i) {
+                index.PrintPostings(postingWords[i], 5);
+            }
+            cout << endl;
+        }
+        else if (processes > 0) {
+            // forked workers count shards into shared memory, merged here
+            ShardedCounter sharded(wordFrequecy, processes);
+            sharded.FileReader(argv[1]);
+            sharded.PrintShardStats();
+        }
+        else if (batchSize > 0) {
+            // repeats within a batch are merged before touching the trees
+            wordFrequecy.FileReaderBatched(argv[1], batchSize);
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                wordFrequecy.FileReaderBatched(inputs[i], batchSize);
+            }
+        }
+        else if (asyncDepth > 0) {
+            // every input's reads in flight together, counted as they land
+            inputs.insert(inputs.begin(), argv[1]);
+            AsyncReader reader(wordFrequecy, asyncDepth, ASYNC_BUFFER, asyncUring);
+            reader.FileReader(inputs);
+            reader.PrintStats();
+        }
+        else {
+            // tokens reach the trees in reading order only on this path
+            // and the index's, so only they can trace vocabulary growth
+            wordFrequecy.SetGrowthTracker(&growth);
+            wordFrequecy.FileReader(argv[1]);
+            for (size_t i = 0; i < inputs.size(); ++i) {
+                wordFrequecy.FileReader(inputs[i]);
+            }
+        }
+        wordFrequecy.SetGrowthTracker(NULL);
+
+        // malformed tokens were set aside rather than ending the run
+        wordFrequecy.PrintRejects();
+        wordFrequecy.PrintTuning();
+        wordFrequecy.PrintPageStats();
+
+        // spilled buckets only exist merged, the trees hold the rest
+        wordFrequecy.PrintSpillStats();
+        if (wordFrequecy.HasSpilled()) {
+            if (dump) {
+                wordFrequecy.DumpMerged(cout);
+            }
+            return 0;
+        }
+
+        // Zipf, Heaps, word lengths and hapax from one scan of the buckets
+        if (analyticsFormat.length() > 0) {
+            Analytics analytics;
+            analytics.Scan(wordFrequecy);
+            if (growth.GetTokens() > 0) {
+                analytics.SetGrowth(&growth);
+            }
+            ofstream reportFile;
+            if (analyticsPath.length() > 0) {
+                reportFile.open(analyticsPath.c_str());
+                if (!reportFile) {
+                    throw IllegalArgumentException();
+                }
+            }
+            ostream& reportOut = analyticsPath.length() > 0 ? (ostream&)reportFile : cout;
+            if (analyticsFormat == "json") {
+                JsonReportSink sink(reportOut);
+                analytics.Report(sink);
+            }
+            else {
+                TextReportSink sink(reportOut);
+                analytics.Report(sink);
+            }
+        }
+
+        // read only queries use the cache friendly copy from here on
+        if (freeze) {
+            wordFrequecy.Freeze();
+        }
+
+        // Server mode keeps the table resident and answers queries until SHUTDOWN
+        if (serveEndpoint.length() > 0) {
+            QueryServer server(wordFrequecy, serveEndpoint, serveThreads);
+            cout << "Serving " << argv[1] << " on " << serveEndpoint << endl;
+            server.Run();
+            return 0;
+        }
+
+        if (keyPolicy == KEY_SURFACE) {
+            wordFrequecy.PrintSurfaceForms(10);
+        }
 
         // Test methods to show hashed splay trees work
         wordFrequecy.PrintHashCountResults();
@@ -31,6 +542,15 @@ int main(int argc, char *argv[]) {
         wordFrequecy.PrintTree("K"); // should be mpty running input1
         wordFrequecy.FindAll("The"); // should find all the's (ignoring case)
         cout << endl << endl;
+
+        // many segments at once, searched bucket by bucket in parallel
+        if (!findAllParts.empty()) {
+            wordFrequecy.FindAllBatch(findAllParts);
+            cout << endl << endl;
+        }
+        if (dump) {
+            wordFrequecy.DumpTable(cout);
+        }
     }
     // Error catching
     catch (Exceptions &cException) {
@@ -40,6 +40,60 @@ public:
     ArrayIndexOutOfBoundsException() : Exceptions("Array Index Out of Bounds Exception") {}
 };
 
+/*
+ * Class Overflow Exception
+ * Error found when a counter would wrap around
+ */
+class OverflowException : public Exceptions {
+public:
+    OverflowException() : Exceptions("Overflow Exception") {}
+};
+
+/*
+ * Class Worker Failed Exception
+ * Error found when a worker process crashed or could not finish its share
+ */
+class WorkerFailedException : public Exceptions {
+public:
+    WorkerFailedException() : Exceptions("Worker Failed Exception") {}
+};
+
+/*
+ * Class Read Failed Exception
+ * Error found when reading an input file that opened fine failed
+ */
+class ReadFailedException : public Exceptions {
+public:
+    ReadFailedException() : Exceptions("Read Failed Exception") {}
+};
+
+/*
+ * Class Write Failed Exception
+ * Error found when counts could not be written out to disk
+ */
+class WriteFailedException : public Exceptions {
+public:
+    WriteFailedException() : Exceptions("Write Failed Exception") {}
+};
+
+/*
+ * Class Socket Failed Exception
+ * Error found when the server could not make a socket, epoll or event descriptor
+ */
+class SocketFailedException : public Exceptions {
+public:
+    SocketFailedException() : Exceptions("Socket Failed Exception") {}
+};
+
+/*
+ * Class Out Of Memory Exception
+ * Error found when the system would not map more memory for nodes
+ */
+class OutOfMemoryException : public Exceptions {
+public:
+    OutOfMemoryException() : Exceptions("Out Of Memory Exception") {}
+};
+
 /*
  * Class Iterator Out of Bounds Exception
  */
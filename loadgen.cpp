@@ -0,0 +1,258 @@
+/**************************************************************
+ * File:    loadgen.cpp
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ *
+ * Local load generator for the QueryServer.
+ *
+ * Opens a number of connections, each on its own thread, and keeps a
+ * pipeline of requests in flight on every connection. Every request is
+ * timed from the write that carried it to the line that answered it.
+ * Reports QPS and p50/p99/max latency.
+ *
+ * Usage: LoadGen.out <endpoint> [--words file] [--connections n]
+ *                    [--requests n] [--depth n] [--shutdown]
+ *************************************************************/
+#include "Util.h"
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <cstring>
+#include <cstdlib>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Connect to "unix:/path", "tcp:port" or a bare socket path, -1 on failure
+static int Connect(const string& endpoint)
+{
+    int fd;
+    if (endpoint.compare(0, 4, "tcp:") == 0)
+    {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(atoi(endpoint.substr(4).c_str()));
+        addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    }
+    else
+    {
+        string path = endpoint.compare(0, 5, "unix:") == 0 ? endpoint.substr(5) : endpoint;
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, path.c_str(), sizeof(addr.sun_path) - 1);
+        if (connect(fd, (sockaddr*)&addr, sizeof(addr)) != 0)
+        {
+            close(fd);
+            return -1;
+        }
+    }
+    return fd;
+}
+
+// Build a request mix from the words: mostly FREQ, some PREFIX, TOPK and BUCKET
+static vector<string> BuildRequests(const vector<string>& words, int count)
+{
+    vector<string> requests;
+    unsigned int seed = 221;
+    for (int i = 0; i < count; ++i)
+    {
+        seed = seed * 1103515245 + 12345;
+        const string& word = words[(seed >> 8) % words.size()];
+        int kind = (seed >> 4) % 20;
+        if (kind < 16)
+            requests.push_back("FREQ " + word + "\n");
+        else if (kind < 18)
+            requests.push_back("PREFIX " + word.substr(0, 2) + "\n");
+        else if (kind < 19)
+            requests.push_back("TOPK 10\n");
+        else
+            requests.push_back("BUCKET " + word.substr(0, 1) + "\n");
+    }
+    return requests;
+}
+
+// Drive one connection, latencies in microseconds appended to outLatencies
+static void RunConnection(string endpoint, vector<string> requests, int depth,
+                          vector<double>* outLatencies, int* outErrors)
+{
+    int fd = Connect(endpoint);
+    if (fd < 0)
+    {
+        *outErrors = (int)requests.size();
+        return;
+    }
+
+    vector<Clock::time_point> sentAt(requests.size());
+    size_t nextToSend = 0;
+    size_t nextAnswer = 0;
+    string pending;
+    char buffer[65536];
+
+    while (nextAnswer < requests.size())
+    {
+        // top the pipeline back up to depth requests, one write for all of them
+        string batch;
+        Clock::time_point now = Clock::now();
+        while (nextToSend < requests.size() && nextToSend - nextAnswer < (size_t)depth)
+        {
+            batch += requests[nextToSend];
+            sentAt[nextToSend++] = now;
+        }
+        if (batch.length() > 0 && send(fd, batch.data(), batch.length(), MSG_NOSIGNAL) != (ssize_t)batch.length())
+        {
+            break;
+        }
+
+        ssize_t got = read(fd, buffer, sizeof(buffer));
+        if (got <= 0)
+        {
+            break;
+        }
+        Clock::time_point received = Clock::now();
+        pending.append(buffer, got);
+
+        size_t start = 0;
+        size_t newline;
+        while ((newline = pending.find('\n', start)) != string::npos)
+        {
+            if (pending.compare(start, 3, "ERR") == 0)
+            {
+                (*outErrors)++;
+            }
+            outLatencies->push_back(chrono::duration<double, micro>(received - sentAt[nextAnswer]).count());
+            nextAnswer++;
+            start = newline + 1;
+        }
+        pending.erase(0, start);
+    }
+    *outErrors += (int)(requests.size() - nextAnswer);
+    close(fd);
+}
+
+int main(int argc, char *argv[])
+{
+    if (argc < 2)
+    {
+        cout << "Usage: " << argv[0] << " <endpoint> [--words file] [--connections n]"
+             << " [--requests n] [--depth n] [--shutdown]" << endl;
+        return 1;
+    }
+
+    string endpoint = argv[1];
+    string wordFile = "input2.txt";
+    int connections = 4;
+    int requestsPerConnection = 100000;
+    int depth = 32;
+    bool shutdownAfter = false;
+    for (int i = 2; i < argc; ++i)
+    {
+        if (strcmp(argv[i], "--words") == 0 && i + 1 < argc)
+            wordFile = argv[++i];
+        else if (strcmp(argv[i], "--connections") == 0 && i + 1 < argc)
+            connections = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--requests") == 0 && i + 1 < argc)
+            requestsPerConnection = atoi(argv[++i]);
+        else if (strcmp(argv[i], "--depth") == 0 && i + 1 < argc)
+            depth = max(1, atoi(argv[++i]));
+        else if (strcmp(argv[i], "--shutdown") == 0)
+            shutdownAfter = true;
+        else
+        {
+            cout << "Unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    // query words come from a text file, same normalization as the counter
+    vector<string> words;
+    ifstream ifs(wordFile.c_str());
+    string word;
+    while (ifs >> word)
+    {
+        word = Util::Strip(word);
+        if (word.length() > 0)
+        {
+            words.push_back(word);
+        }
+    }
+    if (words.empty())
+    {
+        cout << "No query words in " << wordFile << endl;
+        return 1;
+    }
+
+    vector<vector<double> > latencies(connections);
+    vector<int> errors(connections, 0);
+    vector<thread> workers;
+    Clock::time_point start = Clock::now();
+    for (int c = 0; c < connections; ++c)
+    {
+        workers.push_back(thread(RunConnection, endpoint, BuildRequests(words, requestsPerConnection),
+                                 depth, &latencies[c], &errors[c]));
+    }
+    for (int c = 0; c < connections; ++c)
+    {
+        workers[c].join();
+    }
+    double seconds = chrono::duration<double>(Clock::now() - start).count();
+
+    vector<double> all;
+    int errorCount = 0;
+    for (int c = 0; c < connections; ++c)
+    {
+        all.insert(all.end(), latencies[c].begin(), latencies[c].end());
+        errorCount += errors[c];
+    }
+    if (all.empty())
+    {
+        cout << "No responses from " << endpoint << endl;
+        return 1;
+    }
+    sort(all.begin(), all.end());
+
+    cout << "connections=" << connections << " depth=" << depth << endl;
+    cout << "requests=" << all.size() << " errors=" << errorCount << endl;
+    cout << "seconds=" << seconds << " qps=" << all.size() / seconds << endl;
+    cout << "p50_us=" << all[all.size() / 2] << " p99_us=" << all[all.size() * 99 / 100]
+         << " max_us=" << all.back() << endl;
+
+    if (shutdownAfter)
+    {
+        int fd = Connect(endpoint);
+        if (fd >= 0)
+        {
+            string bye = "SHUTDOWN\n";
+            ssize_t ignored = send(fd, bye.data(), bye.length(), MSG_NOSIGNAL);
+            (void)ignored;
+            ignored = read(fd, &bye[0], bye.length());
+            close(fd);
+        }
+    }
+    return errorCount == 0 ? 0 : 2;
+}
@@ -0,0 +1,349 @@
+/**************************************************************
+ * File:    replay.cpp
+ * Project: CSCE 221 - Project 3 - Word Frequency
+ * Author : Ian Stephenson
+ * Date   : 04/09/2020
+ * Section: 517
+ * E-mail: ims43@tamu.edu
+ *
+ * Replays a trace recorded with Driver.out --record against a fresh table.
+ *
+ * Every operation of the trace is run in order on one thread, as fast as
+ * it will go, and timed on its own. The table can be configured
+ * differently from the recording run (splay policy, key policy, workers,
+ * a frozen copy for the queries), and the same trace replayed against two
+ * builds compares them on identical work. Reports throughput, p50, p90,
+ * p99, p99.9 and max latency and the splays of each operation type, as
+ * text or JSON. Output of the prints is discarded unless --echo is given.
+ *
+ * Usage: Replay.out <trace> [--splay always|never|adaptive|fraction]
+ *                   [--keys exact|folded|surface] [--workers n] [--freeze]
+ *                   [--echo] [--report text|json[:file]]
+ *************************************************************/
+#include "HashedSplays.h"
+#include "ReportSink.h"
+#include "TraceRecorder.h"
+#include <iostream>
+#include <fstream>
+#include <streambuf>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <algorithm>
+#include <stdexcept>
+#include <cstring>
+#include <cstdlib>
+
+using namespace std;
+
+typedef chrono::steady_clock Clock;
+
+// Swallows everything written to it
+class NullBuffer : public streambuf {
+protected:
+    int overflow(int c) { return c; }
+    streamsize xsputn(const char*, streamsize count) { return count; }
+};
+
+// Latencies and splays of one operation type
+struct OpStats
+{
+    vector<uint64_t> nanos;
+    uint64_t splays;
+    uint64_t errors;
+    OpStats() : splays(0), errors(0) {}
+};
+
+// Splays of every bucket so far
+static uint64_t TotalSplays(const HashedSplays& table)
+{
+    uint64_t splays = 0;
+    for (int i = 0; i < table.m_trees; ++i)
+    {
+        splays += table.GetBucket(i).GetSplayCounter();
+    }
+    return splays;
+}
+
+// Run one record against the table
+static void Apply(HashedSplays& table, const TraceRecord& record)
+{
+    vector<Node> nodes;
+    switch (record.op)
+    {
+    case TRACE_INSERT:
+        table.InsertWord(record.strings[0]);
+        break;
+    case TRACE_FREQUENCY:
+        table.GetFrequency(record.strings[0]);
+        break;
+    case TRACE_LOOKUP:
+        table.LookupFrequency(record.strings[0]);
+        break;
+    case TRACE_LOOKUP_BATCH:
+    {
+        vector<Frequency> counts(record.strings.size());
+        table.LookupBatch(record.strings.data(), record.strings.size(), counts.data());
+        break;
+    }
+    case TRACE_PREFIX:
+        table.CollectPrefix(record.strings[0], nodes);
+        break;
+    case TRACE_TOP_K:
+        table.CollectTopK((int)record.integer, nodes);
+        break;
+    case TRACE_FIND_ALL:
+        table.FindAll(record.strings[0]);
+        break;
+    case TRACE_FIND_ALL_BATCH:
+        table.FindAllBatch(record.strings);
+        break;
+    case TRACE_PRINT_TREE:
+        table.PrintTree((int)record.integer);
+        break;
+    case TRACE_PRINT_LETTER:
+        table.PrintTree(record.strings[0]);
+        break;
+    case TRACE_PRINT_COUNTS:
+        table.PrintHashCountResults();
+        break;
+    case TRACE_DUMP:
+        table.DumpTable(cout);
+        break;
+    default:
+        break;
+    }
+}
+
+// Value at a fraction of the sorted latencies
+static uint64_t Percentile(const vector<uint64_t>& sorted, double fraction)
+{
+    size_t at = (size_t)(fraction * sorted.size());
+    return sorted[at < sorted.size() ? at : sorted.size() - 1];
+}
+
+int main(int argc, char *argv[]) {
+
+    if (argc < 2) {
+        cout << "Usage: " << argv[0] << " <trace> [--splay always|never|adaptive|fraction]"
+             << " [--keys exact|folded|surface] [--workers n] [--freeze] [--echo]"
+             << " [--report text|json[:file]]" << endl;
+        return 1;
+    }
+
+    string splayName = "always";
+    SplayPolicy splayPolicy = SPLAY_ALWAYS;
+    double splayFraction = 1.0;
+    bool adaptive = false;
+    string keyName = "exact";
+    KeyPolicy keyPolicy = KEY_EXACT;
+    int workers = 1;
+    bool freeze = false;
+    bool echo = false;
+    string reportFormat = "text";
+    string reportPath;
+    for (int i = 2; i < argc; ++i) {
+        if (strcmp(argv[i], "--splay") == 0 && i + 1 < argc) {
+            splayName = argv[++i];
+            if (splayName == "always") {
+                splayPolicy = SPLAY_ALWAYS;
+            }
+            else if (splayName == "never") {
+                splayPolicy = SPLAY_NEVER;
+            }
+            else if (splayName == "adaptive") {
+                adaptive = true;
+            }
+            else {
+                // the whole value must be a fraction in [0,1]
+                char* end = NULL;
+                splayFraction = strtod(splayName.c_str(), &end);
+                if (splayName.length() == 0 || *end != '\0' || !(splayFraction >= 0 && splayFraction <= 1)) {
+                    cout << "Unknown splay policy " << splayName << endl;
+                    return 1;
+                }
+                splayPolicy = SPLAY_SOMETIMES;
+            }
+        }
+        else if (strcmp(argv[i], "--keys") == 0 && i + 1 < argc) {
+            keyName = argv[++i];
+            if (keyName == "exact") {
+                keyPolicy = KEY_EXACT;
+            }
+            else if (keyName == "folded") {
+                keyPolicy = KEY_FOLDED;
+            }
+            else if (keyName == "surface") {
+                keyPolicy = KEY_SURFACE;
+            }
+            else {
+                cout << "Unknown key policy " << keyName << endl;
+                return 1;
+            }
+        }
+        else if (strcmp(argv[i], "--workers") == 0 && i + 1 < argc) {
+            workers = atoi(argv[++i]);
+        }
+        else if (strcmp(argv[i], "--freeze") == 0) {
+            // queries after the last insert run against the frozen copy
+            freeze = true;
+        }
+        else if (strcmp(argv[i], "--echo") == 0) {
+            echo = true;
+        }
+        else if (strcmp(argv[i], "--report") == 0 && i + 1 < argc) {
+            reportFormat = argv[++i];
+            size_t colon = reportFormat.find(':');
+            if (colon != string::npos) {
+                reportPath = reportFormat.substr(colon + 1);
+                reportFormat.erase(colon);
+            }
+            if (reportFormat != "text" && reportFormat != "json") {
+                cout << "Unknown report format " << reportFormat << endl;
+                return 1;
+            }
+        }
+        else {
+            cout << "Unknown option " << argv[i] << endl;
+            return 1;
+        }
+    }
+
+    try {
+        HashedSplays table(ALPHABET_SIZE);
+        table.SetSplayPolicy(splayPolicy, splayFraction);
+        table.SetKeyPolicy(keyPolicy);
+        if (adaptive) {
+            table.SetAdaptive(true);
+        }
+        BucketExecutor executor(workers);
+        if (workers > 1) {
+            table.SetExecutor(&executor);
+        }
+
+        // the whole trace in memory first, so reading it is not timed
+        TraceReader reader(argv[1]);
+        vector<TraceRecord> records;
+        TraceRecord record;
+        uint64_t recordedMicros = 0;
+        while (reader.Next(record)) {
+            recordedMicros += record.micros;
+            records.push_back(record);
+        }
+
+        // freezing needs the last insert, queries before it see the trees
+        size_t lastInsert = 0;
+        for (size_t r = 0; r < records.size(); ++r) {
+            if (records[r].op == TRACE_INSERT) {
+                lastInsert = r + 1;
+            }
+        }
+
+        NullBuffer discard;
+        streambuf* console = cout.rdbuf();
+        if (!echo) {
+            cout.rdbuf(&discard);
+        }
+
+        // every latency kept, sized up front so no push_back reallocates
+        vector<OpStats> stats(TRACE_OPS);
+        vector<size_t> counts(TRACE_OPS, 0);
+        for (size_t r = 0; r < records.size(); ++r) {
+            counts[records[r].op]++;
+        }
+        for (int o = 0; o < TRACE_OPS; ++o) {
+            stats[o].nanos.reserve(counts[o]);
+        }
+        uint64_t splays = TotalSplays(table);
+        Clock::time_point replayStart = Clock::now();
+        for (size_t r = 0; r < records.size(); ++r) {
+            if (freeze && r == lastInsert) {
+                table.Freeze();
+            }
+            OpStats& op = stats[records[r].op];
+            Clock::time_point start = Clock::now();
+            try {
+                Apply(table, records[r]);
+            }
+            catch (Exceptions&) {
+                op.errors++;
+            }
+            catch (out_of_range&) {
+                op.errors++;
+            }
+            op.nanos.push_back(chrono::duration_cast<chrono::nanoseconds>(Clock::now() - start).count());
+
+            // outside the timed part, 26 loads
+            uint64_t now = TotalSplays(table);
+            op.splays += now - splays;
+            splays = now;
+        }
+        double seconds = chrono::duration<double>(Clock::now() - replayStart).count();
+        cout.rdbuf(console);
+
+        ofstream reportFile;
+        if (reportPath.length() > 0) {
+            reportFile.open(reportPath.c_str());
+            if (!reportFile) {
+                throw IllegalArgumentException();
+            }
+        }
+        ostream& reportOut = reportPath.length() > 0 ? (ostream&)reportFile : cout;
+        ReportSink* report;
+        if (reportFormat == "json") {
+            report = new JsonReportSink(reportOut);
+        }
+        else {
+            report = new TextReportSink(reportOut);
+        }
+        ReportSink& sink = *report;
+
+        uint64_t nodes = 0;
+        for (int i = 0; i < table.m_trees; ++i) {
+            nodes += table.GetBucket(i).GetNodeCounter();
+        }
+        sink.BeginSection("replay");
+        sink.Text("trace", argv[1]);
+        sink.Text("splay", splayName);
+        sink.Text("keys", keyName);
+        sink.Integer("workers", workers);
+        sink.Integer("frozen", freeze ? 1 : 0);
+        sink.Integer("operations", records.size());
+        sink.Real("seconds", seconds);
+        sink.Real("operations_per_second", seconds > 0 ? records.size() / seconds : 0.0);
+        sink.Real("recorded_seconds", recordedMicros / 1e6);
+        sink.Integer("splays", splays);
+        sink.Integer("nodes", nodes);
+        sink.EndSection();
+
+        for (int o = 0; o < TRACE_OPS; ++o) {
+            vector<uint64_t>& nanos = stats[o].nanos;
+            if (nanos.empty()) {
+                continue;
+            }
+            uint64_t total = 0;
+            for (size_t n = 0; n < nanos.size(); ++n) {
+                total += nanos[n];
+            }
+            sort(nanos.begin(), nanos.end());
+            sink.BeginSection(TraceRecorder::OpName((TraceOp)o));
+            sink.Integer("count", nanos.size());
+            sink.Real("mean_ns", (double)total / nanos.size());
+            sink.Integer("p50_ns", Percentile(nanos, 0.50));
+            sink.Integer("p90_ns", Percentile(nanos, 0.90));
+            sink.Integer("p99_ns", Percentile(nanos, 0.99));
+            sink.Integer("p999_ns", Percentile(nanos, 0.999));
+            sink.Integer("max_ns", nanos.back());
+            sink.Real("splays_per_op", (double)stats[o].splays / nanos.size());
+            sink.Integer("errors", stats[o].errors);
+            sink.EndSection();
+        }
+        sink.Finish();
+        delete report;
+    }
+    catch (Exceptions &cException) {
+        cout << "EXCEPTION: " << cException.GetMessage() << endl;
+        return 1;
+    }
+    return 0;
+}